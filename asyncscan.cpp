@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+
+#include "meminfo_private.h"
+
+using ::android::dmabufinfo::DmaBuffer;
+
+namespace android {
+namespace meminfo {
+
+template <typename T>
+using ScanFunction = std::function<ScanStatus(const ScanRequest<T>& request, T* value)>;
+
+// Runs 'scan' as one task on 'executor' and returns the future of its result.
+template <typename T>
+static std::future<ScanResult<T>> run_scan(const Executor& executor, const ScanRequest<T>& request,
+                                           ScanFunction<T> scan) {
+    auto promise = std::make_shared<std::promise<ScanResult<T>>>();
+    std::future<ScanResult<T>> future = promise->get_future();
+    auto task = [promise, request, scan = std::move(scan)]() {
+        ScanResult<T> result;
+        // The scan may have been cancelled while the task was queued.
+        result.status = request.token->IsCancelled() ? ScanStatus::CANCELLED
+                                                     : scan(request, &result.value);
+        if (request.on_complete) {
+            request.on_complete(result);
+        }
+        promise->set_value(std::move(result));
+    };
+
+    if (executor) {
+        executor(std::move(task));
+    } else {
+        task();
+    }
+    return future;
+}
+
+static ScanStatus read_processes_usage(const std::vector<pid_t>& pids,
+                                       const ScanRequest<std::vector<ProcessUsage>>& request,
+                                       std::vector<ProcessUsage>* usages) {
+    const CancellationToken& token = *request.token;
+    for (size_t i = 0; i < pids.size(); i++) {
+        if (token.IsCancelled()) {
+            return ScanStatus::CANCELLED;
+        }
+
+        ProcessUsage proc = {.pid = pids[i]};
+        bool cancelled = false;
+        ProcMemInfo procmem(pids[i]);
+        // Stop reading smaps as soon as the scan is cancelled, the remaining vmas are not
+        // walked by the kernel at all.
+        bool success = procmem.ForEachVma([&](const Vma& vma) {
+            if (token.IsCancelled()) {
+                cancelled = true;
+                return false;
+            }
+            add_mem_usage(&proc.usage, vma.usage);
+            return true;
+        });
+        if (cancelled) {
+            return ScanStatus::CANCELLED;
+        }
+        // Skip processes that were killed in the meantime.
+        if (success) {
+            usages->emplace_back(proc);
+        }
+
+        if (request.on_progress) {
+            request.on_progress(i + 1, pids.size());
+        }
+    }
+    return ScanStatus::SUCCESS;
+}
+
+std::future<ScanResult<std::vector<ProcessUsage>>> ReadProcessesUsageAsync(
+        const std::vector<pid_t>& pids, const Executor& executor,
+        const ScanRequest<std::vector<ProcessUsage>>& request) {
+    return run_scan<std::vector<ProcessUsage>>(
+            executor, request,
+            [pids](const ScanRequest<std::vector<ProcessUsage>>& request,
+                   std::vector<ProcessUsage>* usages) {
+                return read_processes_usage(pids, request, usages);
+            });
+}
+
+bool list_pids(const std::string& procfs_path, std::vector<pid_t>* pids) {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(procfs_path.c_str()), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Failed to open " << procfs_path << " directory";
+        return false;
+    }
+
+    struct dirent* dent;
+    pid_t pid;
+    while ((dent = readdir(dir.get()))) {
+        if (dent->d_type != DT_DIR) continue;
+        if (!::android::base::ParseInt(dent->d_name, &pid, 1)) continue;
+        pids->push_back(pid);
+    }
+    return true;
+}
+
+static ScanStatus read_procfs_dmabufs(const std::string& procfs_path,
+                                      const ScanRequest<std::vector<DmaBuffer>>& request,
+                                      std::vector<DmaBuffer>* bufs) {
+    std::vector<pid_t> pids;
+    if (!list_pids(procfs_path, &pids)) {
+        return ScanStatus::FAILED;
+    }
+
+    const CancellationToken& token = *request.token;
+    for (size_t i = 0; i < pids.size(); i++) {
+        if (token.IsCancelled()) {
+            return ScanStatus::CANCELLED;
+        }
+        if (!::android::dmabufinfo::ReadDmaBufFdRefs(pids[i], bufs, procfs_path)) {
+            LOG(ERROR) << "Failed to read dmabuf fd references for pid " << pids[i];
+        }
+
+        if (token.IsCancelled()) {
+            return ScanStatus::CANCELLED;
+        }
+        if (!::android::dmabufinfo::ReadDmaBufMapRefs(pids[i], bufs, procfs_path)) {
+            LOG(ERROR) << "Failed to read dmabuf map references for pid " << pids[i];
+        }
+
+        if (request.on_progress) {
+            request.on_progress(i + 1, pids.size());
+        }
+    }
+    return ScanStatus::SUCCESS;
+}
+
+std::future<ScanResult<std::vector<DmaBuffer>>> ReadProcfsDmaBufsAsync(
+        const Executor& executor, const ScanRequest<std::vector<DmaBuffer>>& request,
+        const std::string& procfs_path) {
+    return run_scan<std::vector<DmaBuffer>>(
+            executor, request,
+            [procfs_path](const ScanRequest<std::vector<DmaBuffer>>& request,
+                          std::vector<DmaBuffer>* bufs) {
+                return read_procfs_dmabufs(procfs_path, request, bufs);
+            });
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "meminfo_private.h"
+
+using ::android::base::StringPrintf;
+
+namespace android {
+namespace meminfo {
+
+static bool write_damon_file(const std::string& path, const std::string& value) {
+    if (!::android::base::WriteStringToFile(value, path)) {
+        PLOG(ERROR) << "Failed to write " << value << " to " << path;
+        return false;
+    }
+    return true;
+}
+
+static bool write_damon_file(const std::string& path, uint64_t value) {
+    return write_damon_file(path, std::to_string(value));
+}
+
+static bool read_damon_file(const std::string& path, std::string* value) {
+    if (!::android::base::ReadFileToString(path, value)) {
+        PLOG(ERROR) << "Failed to read " << path;
+        return false;
+    }
+    *value = ::android::base::Trim(*value);
+    return true;
+}
+
+template <typename T>
+static bool read_damon_file(const std::string& path, T* value) {
+    std::string content;
+    if (!read_damon_file(path, &content)) {
+        return false;
+    }
+    if (!::android::base::ParseUint(content, value)) {
+        LOG(ERROR) << "Failed to parse " << path << ": " << content;
+        return false;
+    }
+    return true;
+}
+
+// Writes 'nr' to the nr_* file in 'dir', which makes the kernel create the child
+// directories 0 to nr - 1, and checks that they exist.
+static bool set_nr_children(const std::string& dir, const char* nr_file, uint64_t nr) {
+    if (!write_damon_file(dir + "/" + nr_file, nr)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < nr; i++) {
+        std::string child = StringPrintf("%s/%" PRIu64, dir.c_str(), i);
+        if (access(child.c_str(), F_OK) != 0) {
+            PLOG(ERROR) << "Missing " << child;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DamonMonitor::KdamondPath(size_t kdamond) const {
+    return StringPrintf("%s/kdamonds/%zu", admin_path_.c_str(), kdamond);
+}
+
+bool DamonMonitor::IsSupported() const {
+    std::string nr_kdamonds = admin_path_ + "/kdamonds/nr_kdamonds";
+    return access(nr_kdamonds.c_str(), R_OK | W_OK) == 0;
+}
+
+bool DamonMonitor::SetupKdamond(size_t kdamond, pid_t pid) const {
+    std::string contexts = KdamondPath(kdamond) + "/contexts";
+    if (!set_nr_children(contexts, "nr_contexts", 1)) {
+        return false;
+    }
+
+    std::string ctx = contexts + "/0";
+    std::string intervals = ctx + "/monitoring_attrs/intervals";
+    std::string nr_regions = ctx + "/monitoring_attrs/nr_regions";
+    if (!write_damon_file(ctx + "/operations", "vaddr") ||
+        !write_damon_file(intervals + "/sample_us", attrs_.sample_us) ||
+        !write_damon_file(intervals + "/aggr_us", attrs_.aggr_us) ||
+        !write_damon_file(intervals + "/update_us", attrs_.update_us) ||
+        !write_damon_file(nr_regions + "/min", attrs_.min_nr_regions) ||
+        !write_damon_file(nr_regions + "/max", attrs_.max_nr_regions)) {
+        return false;
+    }
+
+    std::string targets = ctx + "/targets";
+    if (!set_nr_children(targets, "nr_targets", 1) ||
+        !write_damon_file(targets + "/0/pid_target", pid)) {
+        return false;
+    }
+
+    // A scheme that only collects statistics and matches every region, its tried regions
+    // are all the regions of the target.
+    std::string schemes = ctx + "/schemes";
+    if (!set_nr_children(schemes, "nr_schemes", 1)) {
+        return false;
+    }
+    std::string pattern = schemes + "/0/access_pattern";
+    return write_damon_file(schemes + "/0/action", "stat") &&
+           write_damon_file(pattern + "/sz/min", 0) &&
+           write_damon_file(pattern + "/sz/max", std::numeric_limits<uint64_t>::max()) &&
+           write_damon_file(pattern + "/nr_accesses/min", 0) &&
+           write_damon_file(pattern + "/nr_accesses/max", std::numeric_limits<uint32_t>::max()) &&
+           write_damon_file(pattern + "/age/min", 0) &&
+           write_damon_file(pattern + "/age/max", std::numeric_limits<uint32_t>::max());
+}
+
+bool DamonMonitor::Start(const std::vector<pid_t>& pids) {
+    if (!pids_.empty()) {
+        LOG(ERROR) << "DAMON monitor is already started";
+        return false;
+    }
+
+    std::string kdamonds = admin_path_ + "/kdamonds";
+    uint64_t nr_kdamonds;
+    if (!read_damon_file(kdamonds + "/nr_kdamonds", &nr_kdamonds)) {
+        return false;
+    }
+    for (size_t i = 0; i < nr_kdamonds; i++) {
+        std::string state;
+        if (read_damon_file(KdamondPath(i) + "/state", &state) && state == "on") {
+            LOG(ERROR) << "DAMON is in use by kdamond " << i;
+            return false;
+        }
+    }
+
+    if (!set_nr_children(kdamonds, "nr_kdamonds", pids.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < pids.size(); i++) {
+        if (!SetupKdamond(i, pids[i]) || !write_damon_file(KdamondPath(i) + "/state", "on")) {
+            LOG(ERROR) << "Failed to start monitoring pid " << pids[i];
+            // Stop the kdamonds that were started already.
+            pids_.assign(pids.begin(), pids.begin() + i);
+            Stop();
+            return false;
+        }
+    }
+    pids_ = pids;
+    return true;
+}
+
+bool DamonMonitor::Stop() {
+    if (pids_.empty()) {
+        return true;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < pids_.size(); i++) {
+        // A kdamond stops by itself once its target exits.
+        std::string state;
+        if (read_damon_file(KdamondPath(i) + "/state", &state) && state == "off") {
+            continue;
+        }
+        success &= write_damon_file(KdamondPath(i) + "/state", "off");
+    }
+    success &= write_damon_file(admin_path_ + "/kdamonds/nr_kdamonds", 0);
+    pids_.clear();
+    return success;
+}
+
+bool DamonMonitor::ReadRegions(pid_t pid, std::vector<DamonRegion>* regions) const {
+    regions->clear();
+    auto it = std::find(pids_.begin(), pids_.end(), pid);
+    if (it == pids_.end()) {
+        LOG(ERROR) << "Pid " << pid << " is not monitored";
+        return false;
+    }
+
+    std::string kdamond = KdamondPath(it - pids_.begin());
+    if (!write_damon_file(kdamond + "/state", "update_schemes_tried_regions")) {
+        return false;
+    }
+
+    std::string tried_regions = kdamond + "/contexts/0/schemes/0/tried_regions";
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(tried_regions.c_str()), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Failed to open " << tried_regions;
+        return false;
+    }
+    std::vector<uint32_t> ids;
+    struct dirent* dent;
+    while ((dent = readdir(dir.get()))) {
+        uint32_t id;
+        if (::android::base::ParseUint(dent->d_name, &id)) {
+            ids.push_back(id);
+        }
+    }
+    // The regions are numbered in address order.
+    std::sort(ids.begin(), ids.end());
+
+    for (uint32_t id : ids) {
+        std::string path = StringPrintf("%s/%u/", tried_regions.c_str(), id);
+        DamonRegion region;
+        if (!read_damon_file(path + "start", &region.start) ||
+            !read_damon_file(path + "end", &region.end) ||
+            !read_damon_file(path + "nr_accesses", &region.nr_accesses) ||
+            !read_damon_file(path + "age", &region.age)) {
+            return false;
+        }
+        regions->push_back(region);
+    }
+    return true;
+}
+
+bool DamonMonitor::ReadVmaHeat(pid_t pid, const std::vector<Vma>& vmas,
+                               std::vector<VmaHeat>* heat,
+                               const DamonHeatThresholds& thresholds) const {
+    std::vector<DamonRegion> regions;
+    if (!ReadRegions(pid, &regions)) {
+        return false;
+    }
+    DamonVmaHeat(regions, vmas, attrs_, thresholds, heat);
+    return true;
+}
+
+void DamonVmaHeat(const std::vector<DamonRegion>& regions, const std::vector<Vma>& vmas,
+                  const DamonAttrs& attrs, const DamonHeatThresholds& thresholds,
+                  std::vector<VmaHeat>* heat) {
+    heat->assign(vmas.size(), VmaHeat());
+
+    const uint64_t max_nr_accesses = std::max<uint64_t>(attrs.aggr_us / attrs.sample_us, 1);
+    const uint64_t cold_age = thresholds.cold_idle_ms * 1000 / attrs.aggr_us;
+    size_t first_vma = 0;
+    for (const DamonRegion& region : regions) {
+        uint64_t VmaHeat::*bytes;
+        if (region.nr_accesses >= thresholds.hot_access_ratio * max_nr_accesses &&
+            region.nr_accesses > 0) {
+            bytes = &VmaHeat::hot_bytes;
+        } else if (region.nr_accesses == 0 && region.age >= cold_age) {
+            bytes = &VmaHeat::cold_bytes;
+        } else {
+            bytes = &VmaHeat::warm_bytes;
+        }
+
+        // Regions may span the gaps between vmas, only the mapped parts are counted.
+        while (first_vma < vmas.size() && vmas[first_vma].end <= region.start) {
+            first_vma++;
+        }
+        for (size_t i = first_vma; i < vmas.size() && vmas[i].start < region.end; i++) {
+            uint64_t start = std::max(vmas[i].start, region.start);
+            uint64_t end = std::min(vmas[i].end, region.end);
+            (*heat)[i].*bytes += end - start;
+        }
+    }
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include "meminfo_private.h"
+
+using ::android::dmabufinfo::DmaBuffer;
+using ::android::dmabufinfo::DrmClient;
+
+namespace android {
+namespace meminfo {
+
+FootprintSources DefaultFootprintSources(const std::string& procfs_path) {
+    return {
+            .read_usage =
+                    [procfs_path](pid_t pid, MemUsage* usage) {
+                        std::string path = ::android::base::StringPrintf(
+                                "%s/%d/%s", procfs_path.c_str(), pid,
+                                IsSmapsRollupSupported() ? "smaps_rollup" : "smaps");
+                        return SmapsOrRollupFromFile(path, usage);
+                    },
+            .read_swap_offsets =
+                    [](pid_t pid, std::vector<uint64_t>* swap_offsets) {
+                        // The pagemap is only available from the live system.
+                        *swap_offsets = ProcMemInfo(pid).SwapOffsets();
+                        return true;
+                    },
+            .read_dmabufs =
+                    [procfs_path](pid_t pid, std::vector<DmaBuffer>* dmabufs,
+                                  std::vector<DrmClient>* drm_clients) {
+                        return ::android::dmabufinfo::ReadFdInfoRefs(pid, dmabufs, drm_clients,
+                                                                     procfs_path) &&
+                               ::android::dmabufinfo::ReadDmaBufMapRefs(pid, dmabufs,
+                                                                        procfs_path);
+                    },
+            .read_gpu = ReadPerProcessGpuMem,
+            .list_pids =
+                    [procfs_path](std::vector<pid_t>* pids) {
+                        return list_pids(procfs_path, pids);
+                    },
+    };
+}
+
+bool ReadProcessFootprints(const std::vector<pid_t>& pids, bool read_swap_offsets,
+                           std::vector<ProcessFootprint>* footprints,
+                           const FootprintSources& sources) {
+    footprints->clear();
+
+    std::unordered_map<uint32_t, uint64_t> gpu_kb;
+    bool read_gpu = sources.read_gpu(&gpu_kb);
+    if (!read_gpu) {
+        gpu_kb.clear();
+    }
+
+    // The only pass over the processes, everything that depends on other processes is
+    // computed from the shared tables afterwards.
+    std::vector<DmaBuffer> dmabufs;
+    std::vector<DrmClient> drm_clients;
+    std::unordered_map<uint64_t, uint32_t> swap_refs;
+    std::vector<std::vector<uint64_t>> swap_offsets;
+    std::unordered_map<pid_t, size_t> footprint_ids;
+    for (pid_t pid : pids) {
+        ProcessFootprint footprint = {.pid = pid};
+        if (!sources.read_usage(pid, &footprint.usage)) {
+            continue;
+        }
+
+        std::vector<uint64_t> offsets;
+        if (read_swap_offsets && sources.read_swap_offsets(pid, &offsets)) {
+            for (uint64_t offset : offsets) {
+                swap_refs[offset]++;
+            }
+        }
+        if (!sources.read_dmabufs(pid, &dmabufs, &drm_clients)) {
+            LOG(WARNING) << "Failed to read the dmabufs of pid " << pid;
+        }
+
+        auto it = gpu_kb.find(pid);
+        footprint.gpu_kb = it == gpu_kb.end() ? 0 : it->second;
+        footprint_ids[pid] = footprints->size();
+        footprints->push_back(footprint);
+        swap_offsets.push_back(std::move(offsets));
+    }
+
+    // The other processes only add their references to the shared tables.
+    std::vector<pid_t> all_pids;
+    if (sources.list_pids && sources.list_pids(&all_pids)) {
+        std::unordered_set<pid_t> selected(pids.begin(), pids.end());
+        for (pid_t pid : all_pids) {
+            if (selected.count(pid)) {
+                continue;
+            }
+            std::vector<uint64_t> offsets;
+            if (read_swap_offsets && sources.read_swap_offsets(pid, &offsets)) {
+                for (uint64_t offset : offsets) {
+                    swap_refs[offset]++;
+                }
+            }
+            // Processes may exit in the meantime, kernel threads have no fdinfo to read.
+            sources.read_dmabufs(pid, &dmabufs, &drm_clients);
+        }
+    }
+
+    std::vector<uint64_t> dmabuf_pss(footprints->size());
+    for (const DmaBuffer& buf : dmabufs) {
+        for (pid_t pid : buf.pids()) {
+            auto it = footprint_ids.find(pid);
+            if (it != footprint_ids.end()) {
+                dmabuf_pss[it->second] += buf.Pss();
+            }
+        }
+    }
+    if (!read_gpu) {
+        std::vector<uint64_t> drm_pss(footprints->size());
+        for (const DrmClient& client : drm_clients) {
+            for (pid_t pid : client.pids) {
+                auto it = footprint_ids.find(pid);
+                if (it != footprint_ids.end()) {
+                    drm_pss[it->second] += client.Pss();
+                }
+            }
+        }
+        for (size_t i = 0; i < footprints->size(); i++) {
+            (*footprints)[i].gpu_kb = drm_pss[i] / 1024;
+        }
+    }
+
+    const uint64_t pagesz_kb = getpagesize() / 1024;
+    for (size_t i = 0; i < footprints->size(); i++) {
+        ProcessFootprint& footprint = (*footprints)[i];
+        footprint.dmabuf_pss_kb = dmabuf_pss[i] / 1024;
+        double proportional_swap_pages = 0;
+        for (uint64_t offset : swap_offsets[i]) {
+            uint32_t refs = swap_refs[offset];
+            proportional_swap_pages += 1.0 / refs;
+            footprint.unique_swap_kb += refs == 1 ? pagesz_kb : 0;
+        }
+        footprint.proportional_swap_kb = proportional_swap_pages * pagesz_kb;
+        footprint.total_kb = footprint.usage.pss + footprint.usage.swap_pss +
+                             footprint.dmabuf_pss_kb + footprint.gpu_kb;
+    }
+
+    return !footprints->empty();
+}
+
+}  // namespace meminfo
+}  // namespace android
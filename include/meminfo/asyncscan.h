@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dmabufinfo/dmabufinfo.h>
+#include <meminfo/meminfo.h>
+
+namespace android {
+namespace meminfo {
+
+class CancellationToken final {
+    // Lets the owner of a scan stop it from any thread. Scans check the token between
+    // processes and between vmas, so a cancelled scan stops reading procfs, and taking
+    // the mmap_lock of the process it is reading, after at most one more vma.
+  public:
+    CancellationToken() = default;
+
+    void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool IsCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+  private:
+    // Non-copyable & Non-movable
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    std::atomic<bool> cancelled_ = false;
+};
+
+// Runs a task asynchronously, e.g. by posting it to a thread pool or a looper owned by
+// the caller. Each scan runs as a single task.
+using Executor = std::function<void(std::function<void()> task)>;
+
+enum class ScanStatus { SUCCESS, FAILED, CANCELLED };
+
+template <typename T>
+struct ScanResult {
+    ScanStatus status = ScanStatus::FAILED;
+    // Partial if the scan was cancelled.
+    T value;
+};
+
+template <typename T>
+struct ScanRequest {
+    // Shared with the scan, cancel it to stop the scan.
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    // Called on the executor after each process with the number of processes scanned so
+    // far and the number of processes to scan.
+    std::function<void(size_t done, size_t total)> on_progress;
+    // Called on the executor with the result when the scan ends, including when it was
+    // cancelled, before the result is made available through the future.
+    std::function<void(const ScanResult<T>& result)> on_complete;
+};
+
+struct ProcessUsage {
+    pid_t pid;
+    MemUsage usage;
+};
+
+// Reads the memory usage of each process in 'pids' from its smaps on 'executor', or on
+// the calling thread if 'executor' is empty. Processes that exit during the scan are
+// skipped. The usage is the same as ProcMemInfo::Usage() after Smaps(), i.e. without
+// swap_pss, read one vma at a time so that the scan can be cancelled in the middle of a
+// process.
+std::future<ScanResult<std::vector<ProcessUsage>>> ReadProcessesUsageAsync(
+        const std::vector<pid_t>& pids, const Executor& executor,
+        const ScanRequest<std::vector<ProcessUsage>>& request = {});
+
+// Same as ::android::dmabufinfo::ReadProcfsDmaBufs() on 'executor', or on the calling
+// thread if 'executor' is empty. The processes are listed when the scan starts.
+std::future<ScanResult<std::vector<::android::dmabufinfo::DmaBuffer>>> ReadProcfsDmaBufsAsync(
+        const Executor& executor,
+        const ScanRequest<std::vector<::android::dmabufinfo::DmaBuffer>>& request = {},
+        const std::string& procfs_path = "/proc");
+
+}  // namespace meminfo
+}  // namespace android
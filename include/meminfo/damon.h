@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "meminfo.h"
+
+namespace android {
+namespace meminfo {
+
+// Monitoring attributes of a DAMON context, see Documentation/admin-guide/mm/damon/usage.rst
+// in the kernel.
+struct DamonAttrs {
+    // Each region is checked for accesses once per sampling interval, and the number of
+    // samples in which it was accessed is reported per aggregation interval.
+    uint64_t sample_us = 5000;
+    uint64_t aggr_us = 100000;
+    // The monitored address ranges follow the mappings of the process at this interval.
+    uint64_t update_us = 1000000;
+    // Bounds of the number of regions, i.e. the overhead and resolution of the monitoring.
+    uint32_t min_nr_regions = 10;
+    uint32_t max_nr_regions = 1000;
+};
+
+// An address range of a process monitored by DAMON.
+struct DamonRegion {
+    uint64_t start;
+    uint64_t end;
+    // Number of samples of the last aggregation interval in which the region was accessed,
+    // out of aggr_us / sample_us.
+    uint32_t nr_accesses;
+    // Number of aggregation intervals for which the region kept its access frequency.
+    uint32_t age;
+};
+
+struct DamonHeatThresholds {
+    // Regions accessed in at least this share of the samples of an aggregation interval are
+    // hot.
+    double hot_access_ratio = 0.5;
+    // Regions that were not accessed for at least this long are cold, all other regions
+    // are warm.
+    uint64_t cold_idle_ms = 10000;
+};
+
+// Bytes of a vma by how frequently they are accessed. Bytes that DAMON doesn't monitor
+// are in none of them.
+struct VmaHeat {
+    uint64_t hot_bytes = 0;
+    uint64_t warm_bytes = 0;
+    uint64_t cold_bytes = 0;
+};
+
+class DamonMonitor final {
+    // Working set estimation with DAMON through its sysfs interface. Instead of checking
+    // every page like idle page tracking, DAMON checks one random page per region each
+    // sampling interval and adapts the regions to the access pattern, so the overhead is
+    // bounded by the number of regions and the referenced bits used by reclaim are left
+    // alone. Each process is monitored by a kdamond of its own, as a kdamond only has a
+    // single context and the regions of a context don't tell which process they are from.
+    // The regions are read back through the tried regions of a "stat" scheme that matches
+    // every region.
+  public:
+    explicit DamonMonitor(const std::string& admin_path = "/sys/kernel/mm/damon/admin",
+                          const DamonAttrs& attrs = {})
+        : admin_path_(admin_path), attrs_(attrs) {}
+    ~DamonMonitor() { Stop(); }
+
+    // Returns true if the kernel has the DAMON sysfs interface.
+    bool IsSupported() const;
+
+    // Starts monitoring the virtual address space of each of 'pids'. Fails if DAMON is
+    // already in use, by this or any other monitor.
+    bool Start(const std::vector<pid_t>& pids);
+    // Stops monitoring and removes the kdamonds.
+    bool Stop();
+
+    // Reads the current regions of 'pid' in address order. The regions are updated by
+    // the kernel at the end of the next aggregation interval, so this blocks for up to
+    // aggr_us.
+    bool ReadRegions(pid_t pid, std::vector<DamonRegion>* regions) const;
+    // Reads the regions of 'pid' and adds them up per vma, see DamonVmaHeat().
+    bool ReadVmaHeat(pid_t pid, const std::vector<Vma>& vmas, std::vector<VmaHeat>* heat,
+                     const DamonHeatThresholds& thresholds = {}) const;
+
+    const std::vector<pid_t>& pids() const { return pids_; }
+    const DamonAttrs& attrs() const { return attrs_; }
+
+  private:
+    std::string KdamondPath(size_t kdamond) const;
+    bool SetupKdamond(size_t kdamond, pid_t pid) const;
+
+    // Non-copyable & Non-movable
+    DamonMonitor(const DamonMonitor&) = delete;
+    DamonMonitor& operator=(const DamonMonitor&) = delete;
+
+    std::string admin_path_;
+    DamonAttrs attrs_;
+    // Monitored pids, by kdamond.
+    std::vector<pid_t> pids_;
+};
+
+// Splits each of 'regions' over the 'vmas' it overlaps and classifies its bytes as hot,
+// warm or cold by 'thresholds'. Both 'regions' and 'vmas' must be sorted by address, e.g.
+// as read from DAMON and /proc/<pid>/maps. 'heat' is indexed like 'vmas'.
+void DamonVmaHeat(const std::vector<DamonRegion>& regions, const std::vector<Vma>& vmas,
+                  const DamonAttrs& attrs, const DamonHeatThresholds& thresholds,
+                  std::vector<VmaHeat>* heat);
+
+}  // namespace meminfo
+}  // namespace android
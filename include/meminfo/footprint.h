@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <dmabufinfo/dmabufinfo.h>
+#include <meminfo/meminfo.h>
+
+namespace android {
+namespace meminfo {
+
+// Memory of a process from all the sources that can be charged to it, in kB.
+struct ProcessFootprint {
+    pid_t pid;
+    // From smaps_rollup: PSS, USS (the unique memory of the process), SwapPss, etc.
+    MemUsage usage;
+    // Swapped out pages of this process that no other process refers to, and its share of
+    // all of its swapped out pages, counted from the swap offsets of all processes. Only
+    // read if swap offsets are read.
+    uint64_t unique_swap_kb;
+    uint64_t proportional_swap_kb;
+    // Size of the dmabufs the process refers to by file descriptor or mapping, each split
+    // evenly between all processes that refer to it.
+    uint64_t dmabuf_pss_kb;
+    // From the GPU memory BPF map where available, otherwise the private resident memory
+    // of the DRM clients the process has open, each split evenly between all processes
+    // that have it open.
+    uint64_t gpu_kb;
+    // PSS, SwapPss, dmabuf PSS and GPU memory.
+    uint64_t total_kb;
+};
+
+// Where the footprint is read from. Each source can be replaced, e.g. to run on a host
+// without dmabufs or GPU memory accounting.
+struct FootprintSources {
+    // Reads the usage of a process from its smaps_rollup.
+    std::function<bool(pid_t pid, MemUsage* usage)> read_usage;
+    // Reads the swap offsets of the swapped out pages of a process.
+    std::function<bool(pid_t pid, std::vector<uint64_t>* swap_offsets)> read_swap_offsets;
+    // Adds the dmabufs a process refers to to 'dmabufs' and the DRM clients it has open to
+    // 'drm_clients', merging the references to the ones that are already in there, like
+    // ::android::dmabufinfo::ReadFdInfoRefs().
+    std::function<bool(pid_t pid, std::vector<::android::dmabufinfo::DmaBuffer>* dmabufs,
+                       std::vector<::android::dmabufinfo::DrmClient>* drm_clients)>
+            read_dmabufs;
+    // Reads the GPU memory of all processes in kB, by pid. Returns false if it is not
+    // available, in which case it is read from the DRM clients.
+    std::function<bool(std::unordered_map<uint32_t, uint64_t>* gpu_kb)> read_gpu;
+    // Lists all processes of the system, whose references to dmabufs, DRM clients and swap
+    // slots are read to split them between all the processes that share them. If not set,
+    // or if it fails, they are split between the processes that are read only.
+    std::function<bool(std::vector<pid_t>* pids)> list_pids;
+};
+
+// Returns the sources of this system, with processes read from 'procfs_path'.
+FootprintSources DefaultFootprintSources(const std::string& procfs_path = "/proc");
+
+// Reads the footprint of each process in 'pids' into 'footprints' in a single pass over the
+// processes. The system wide structures are shared by all processes: the GPU memory is read
+// once, and the dmabufs and swap offsets of all processes are collected into a single table
+// each, from which the shares of each process are computed at the end. The references of
+// the processes that are not in 'pids' are read as well, so that the shares are the same
+// as when reading all processes. Reading the swap offsets walks the pagemap of each
+// process and is only done if 'read_swap_offsets' is set.
+// The DRM clients are read in the same pass over the fdinfo as the dmabufs.
+// Processes whose usage can't be read, e.g. because they exited, are skipped. Missing
+// dmabufs or GPU memory are counted as 0. Returns false if no process could be read.
+bool ReadProcessFootprints(const std::vector<pid_t>& pids, bool read_swap_offsets,
+                           std::vector<ProcessFootprint>* footprints,
+                           const FootprintSources& sources = DefaultFootprintSources());
+
+}  // namespace meminfo
+}  // namespace android
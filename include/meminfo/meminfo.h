@@ -48,6 +48,9 @@ struct MemUsage {
     uint64_t locked;
 
     uint64_t thp;
+    // Size of the mapping if the kernel may back it with transparent huge pages, as
+    // reported by 'THPeligible' in smaps.
+    uint64_t thp_eligible;
 
     MemUsage()
         : vss(0),
@@ -66,7 +69,8 @@ struct MemUsage {
           shared_hugetlb(0),
           private_hugetlb(0),
           locked(0),
-          thp(0) {}
+          thp(0),
+          thp_eligible(0) {}
 
     ~MemUsage() = default;
 
@@ -97,5 +101,82 @@ struct Vma {
     MemUsage usage;
 };
 
+// Page counts as reported by /proc/<pid>/numa_maps.
+struct NumaUsage {
+    uint64_t anon;
+    uint64_t dirty;
+    uint64_t mapped;
+    uint64_t swapcache;
+    uint64_t active;
+    uint64_t writeback;
+
+    // Resident pages on each node, indexed by node id.
+    std::vector<uint64_t> nodes;
+
+    NumaUsage() : anon(0), dirty(0), mapped(0), swapcache(0), active(0), writeback(0) {}
+    ~NumaUsage() = default;
+
+    void clear() {
+        anon = dirty = mapped = swapcache = active = writeback = 0;
+        nodes.clear();
+    }
+};
+
+struct NumaVma {
+    uint64_t start;
+    // Only known if the vma was matched against /proc/<pid>/maps, 0 otherwise.
+    uint64_t end;
+    // Memory policy of the vma, e.g. "default", "bind:0-1" or "interleave:0-3".
+    std::string policy;
+    // Backing file, "[heap]", "[stack]" or empty for other anonymous mappings.
+    std::string name;
+    bool is_huge;
+    // Maximum number of processes mapping a single page of this vma.
+    uint64_t mapmax;
+    uint64_t pagesize_kb;
+
+    NumaVma() : start(0), end(0), is_huge(false), mapmax(0), pagesize_kb(0) {}
+    ~NumaVma() = default;
+
+    void clear() {
+        start = end = mapmax = pagesize_kb = 0;
+        is_huge = false;
+        policy.clear();
+        name.clear();
+        usage.clear();
+    }
+
+    // Node placement of this mapping, in pages of 'pagesize_kb'.
+    NumaUsage usage;
+};
+
+// Transparent huge page usage of a process or a vma, all sizes in kB.
+struct ThpUsage {
+    uint64_t vss;
+    uint64_t rss;
+    // Memory mapped with huge pages, i.e. AnonHugePages + ShmemPmdMapped + FilePmdMapped.
+    uint64_t thp;
+    // Size of the mappings that the kernel may back with huge pages.
+    uint64_t eligible;
+    // Resident memory of the eligible mappings that is not backed by huge pages.
+    uint64_t eligible_unbacked;
+    // Subpages of huge pages that are kept allocated by the mappings but not mapped by
+    // them, e.g. after part of a huge page was unmapped. Only computed on request.
+    uint64_t bloat;
+
+    ThpUsage() { clear(); }
+    ~ThpUsage() = default;
+
+    void clear() { vss = rss = thp = eligible = eligible_unbacked = bloat = 0; }
+    void add(const ThpUsage& other) {
+        vss += other.vss;
+        rss += other.rss;
+        thp += other.thp;
+        eligible += other.eligible;
+        eligible_unbacked += other.eligible_unbacked;
+        bloat += other.bloat;
+    }
+};
+
 }  // namespace meminfo
 }  // namespace android
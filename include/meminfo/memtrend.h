@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <functional>
+#include <unordered_map>
+
+#include "meminfo.h"
+
+namespace android {
+namespace meminfo {
+
+class MemSeries final {
+    // Exponentially weighted statistics of a series of samples, e.g. the PSS of a process,
+    // updated in constant time and space per sample:
+    // a) the moving average of the samples,
+    // b) the trend, a line fitted to the samples by weighted least squares,
+    // c) the variance of the samples around the trend,
+    // d) a two sided CUSUM of the deviations from the trend, to find change points.
+    // The weight of a sample decays by (1 - alpha) with each newer sample.
+  public:
+    explicit MemSeries(double alpha = 0.1) : alpha_(alpha) { Reset(); }
+
+    // Adds the sample 'value' taken at 'time_s' seconds, which must not be earlier than
+    // the previous sample. The CUSUM measures deviations from the trend in standard
+    // deviations, but no less than 'noise_floor'.
+    void Add(double time_s, double value, double noise_floor);
+
+    // Drops all samples.
+    void Reset();
+    // Restarts the trend and the CUSUM from the last sample, e.g. after a change point.
+    // The variance is kept.
+    void Rebase();
+
+    uint64_t nr_samples() const { return nr_samples_; }
+    uint64_t nr_trend_samples() const { return nr_trend_samples_; }
+    double average() const { return average_; }
+    double stddev() const;
+    // Slope of the trend, in units per second.
+    double slope() const;
+    // Value of the trend at 'time_s'.
+    double Predict(double time_s) const;
+    // CUSUM of the deviations above and below the trend, in standard deviations.
+    double cusum_up() const { return cusum_up_; }
+    double cusum_down() const { return cusum_down_; }
+
+  private:
+    double alpha_;
+    uint64_t nr_samples_;
+    // Samples since the last Rebase(), the trend is only known from the second one on.
+    uint64_t nr_trend_samples_;
+    double average_;
+    double variance_;
+    double cusum_up_;
+    double cusum_down_;
+    // Time of the first sample of the trend, times are relative to it.
+    double time_origin_;
+    double last_time_;
+    double last_value_;
+    // Decayed sums of the weights, times, values, squared times and products of time and
+    // value of the samples of the trend.
+    double sum_w_;
+    double sum_t_;
+    double sum_v_;
+    double sum_tt_;
+    double sum_tv_;
+};
+
+struct MemTrendThresholds {
+    // Weight of the newest sample in the statistics of each series.
+    double alpha = 0.1;
+    // No alerts are raised for a series before it has this many samples.
+    uint32_t min_samples = 10;
+    // Raises an alert when the PSS or RSS of a process grows faster than this. The alert
+    // is raised again only after the growth slowed down to half of it.
+    double max_growth_kb_per_s = 64;
+    // Raises an alert when the CUSUM of the deviations of the PSS or RSS above the trend
+    // exceeds this many standard deviations, i.e. on a sudden increase.
+    double change_threshold = 5;
+    // Deviations smaller than this are never a change point, even in a series that
+    // hardly changes.
+    double noise_floor_kb = 256;
+};
+
+enum class MemAlertType { GROWTH, CHANGE_POINT };
+
+struct MemAlert {
+    pid_t pid;
+    MemAlertType type;
+    // "pss" or "rss".
+    const char* metric;
+    uint64_t time_ms;
+    // Last sample, moving average and standard deviation around the trend, in kB.
+    uint64_t value_kb;
+    double average_kb;
+    double stddev_kb;
+    // Slope of the trend, in kB per second. For a change point, it is the slope of the
+    // trend before the change.
+    double slope_kb_per_s;
+};
+
+using MemAlertCallback = std::function<void(const MemAlert& alert)>;
+
+class MemAnomalyDetector final {
+    // Finds leaks and spikes in the PSS and RSS of processes sampled periodically, keeping
+    // a MemSeries per process and metric instead of the samples, i.e. about 300 bytes per
+    // process. Alerts are delivered to the callback from the thread adding the sample.
+  public:
+    MemAnomalyDetector(const MemTrendThresholds& thresholds, const MemAlertCallback& callback)
+        : thresholds_(thresholds), callback_(callback) {}
+
+    // Adds the usage of 'pid' sampled at 'time_ms', e.g. from ProcMemInfo::SmapsOrRollup().
+    // Samples must be added in time order for each process.
+    void AddSample(pid_t pid, uint64_t time_ms, const MemUsage& usage);
+    // Reads the usage of 'pid' from its smaps_rollup and adds it, stamped with the
+    // CLOCK_MONOTONIC time. Returns false if the usage could not be read.
+    bool SampleProcess(pid_t pid);
+
+    // Drops the series of 'pid', e.g. once it has exited, so that a new process with the
+    // same pid starts afresh.
+    void RemoveProcess(pid_t pid) { procs_.erase(pid); }
+    size_t NrProcesses() const { return procs_.size(); }
+    // Returns the series of the PSS or RSS of 'pid', or nullptr if it has no samples.
+    const MemSeries* PssSeries(pid_t pid) const;
+    const MemSeries* RssSeries(pid_t pid) const;
+
+  private:
+    struct ProcessSeries {
+        MemSeries pss;
+        MemSeries rss;
+        bool pss_growing;
+        bool rss_growing;
+    };
+
+    void AddMetricSample(pid_t pid, const char* metric, uint64_t time_ms, uint64_t value_kb,
+                         MemSeries* series, bool* growing);
+
+    // Non-copyable & Non-movable
+    MemAnomalyDetector(const MemAnomalyDetector&) = delete;
+    MemAnomalyDetector& operator=(const MemAnomalyDetector&) = delete;
+
+    MemTrendThresholds thresholds_;
+    MemAlertCallback callback_;
+    std::unordered_map<pid_t, ProcessSeries> procs_;
+};
+
+}  // namespace meminfo
+}  // namespace android
@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/unique_fd.h>
@@ -37,10 +40,21 @@ class PageAcct final {
 
     bool InitPageAcct(bool pageidle_enable = false);
     bool PageFlags(uint64_t pfn, uint64_t* flags);
+    // Reads the flags of 'nr_pages' consecutive pages starting at 'pfn' with a single pread.
+    bool PageFlags(uint64_t pfn, size_t nr_pages, std::vector<uint64_t>* flags);
     bool PageMapCount(uint64_t pfn, uint64_t* mapcount);
 
+    // Same as PageFlags() and PageMapCount() for every page in 'pfns'. Runs of consecutive
+    // pfns are read with a single pread.
+    bool PageFlags(const std::vector<uint64_t>& pfns, std::vector<uint64_t>* flags);
+    bool PageMapCounts(const std::vector<uint64_t>& pfns, std::vector<uint64_t>* mapcounts);
+
     int IsPageIdle(uint64_t pfn);
 
+    // Reads the inode number of the memory cgroup that each page in 'pfns' is charged to
+    // from /proc/kpagecgroup. Runs of consecutive pfns are read with a single pread.
+    bool PageCgroups(const std::vector<uint64_t>& pfns, std::vector<uint64_t>* memcg_inos);
+
     // The only way to create PageAcct object
     static PageAcct& Instance() {
         static PageAcct instance;
@@ -50,7 +64,7 @@ class PageAcct final {
     ~PageAcct() = default;
 
   private:
-    PageAcct() : kpagecount_fd_(-1), kpageflags_fd_(-1), pageidle_fd_(-1) {}
+    PageAcct() : kpagecount_fd_(-1), kpageflags_fd_(-1), kpagecgroup_fd_(-1), pageidle_fd_(-1) {}
     int MarkPageIdle(uint64_t pfn) const;
     int GetPageIdle(uint64_t pfn) const;
 
@@ -62,9 +76,70 @@ class PageAcct final {
 
     ::android::base::unique_fd kpagecount_fd_;
     ::android::base::unique_fd kpageflags_fd_;
+    ::android::base::unique_fd kpagecgroup_fd_;
     ::android::base::unique_fd pageidle_fd_;
 };
 
+// Number of physical pages of each type, as found by ReadPageCensus().
+// The first group of counts partitions all PFNs, i.e. every PFN is counted
+// in exactly one of them. The second group describes properties of pages
+// that overlap with the first group and with each other.
+struct PageCensus {
+    // Number of PFNs walked
+    uint64_t total;
+
+    // Holes in the physical address space, or offline memory
+    uint64_t nopage;
+    // Free pages. Only the first page of each free block is marked by the kernel,
+    // the remaining pages of a free block are counted in 'other'.
+    uint64_t buddy;
+    uint64_t slab;
+    uint64_t pgtable;
+    // Anonymous and swap backed pages, including shmem
+    uint64_t anon;
+    // File backed pages on the LRU
+    uint64_t file;
+    // Everything else, e.g. vmalloc, kernel stacks or driver allocations
+    uint64_t other;
+
+    uint64_t thp;
+    uint64_t ksm;
+    uint64_t mlocked;
+    uint64_t unevictable;
+    uint64_t idle;
+    // Pages mapped into at least one process
+    uint64_t mmap;
+    uint64_t dirty;
+    // Pages with a mapcount > 1, only counted if kpagecount was read
+    uint64_t shared;
+
+    PageCensus() { clear(); }
+    void clear() { memset(this, 0, sizeof(*this)); }
+};
+
+// Classifies every physical page of the system by streaming /proc/kpageflags,
+// and /proc/kpagecount if 'read_mapcount' is true, in large sequential reads.
+// Returns false if the files can't be read, e.g. because of missing permissions.
+bool ReadPageCensus(PageCensus* census, bool read_mapcount = false,
+                    const std::string& kpageflags_path = "/proc/kpageflags",
+                    const std::string& kpagecount_path = "/proc/kpagecount");
+
+// Same as ReadPageCensus, except that pages are counted separately for each memory
+// cgroup they are charged to, as reported by /proc/kpagecgroup. Returns a map of
+// memcg inode number -> census of the pages charged to it. Pages that are not charged
+// to any memcg, e.g. most kernel allocations, are counted under inode 0.
+bool ReadMemcgPageCensus(std::map<uint64_t, PageCensus>* memcg_census, bool read_mapcount = false,
+                         const std::string& kpageflags_path = "/proc/kpageflags",
+                         const std::string& kpagecount_path = "/proc/kpagecount",
+                         const std::string& kpagecgroup_path = "/proc/kpagecgroup");
+
+// Walks the cgroup hierarchy mounted at 'cgroup_root' and returns a map of directory
+// inode number -> cgroup path relative to 'cgroup_root', so that the inode numbers in
+// /proc/kpagecgroup can be resolved to cgroups. Use "/dev/memcg" on devices with
+// a cgroup v1 memory controller.
+bool ReadMemcgPaths(std::unordered_map<uint64_t, std::string>* paths,
+                    const std::string& cgroup_root = "/sys/fs/cgroup");
+
 // Returns if the page present bit is set in the value
 // passed in.
 bool page_present(uint64_t pagemap_val);
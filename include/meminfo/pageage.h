@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace meminfo {
+
+class PageIdleAger final {
+    // System wide idle page aging through /sys/kernel/mm/page_idle/bitmap.
+    //
+    // Every generation, all pages are marked idle with large sequential writes
+    // to the bitmap. The kernel only sets the idle flag of user pages on the
+    // LRU and clears it again when such a page is accessed. At the end of the
+    // generation the bitmap is read back in bulk: pages that stayed idle get
+    // one generation older, accessed pages go back to age 0. Unlike resetting
+    // the referenced bits with /proc/<pid>/clear_refs, this doesn't disturb
+    // reclaim.
+    //
+    // Ages are kept in 4 bits per page, i.e. 512KB of memory per 4GB of RAM
+    // with 4K pages, and saturate at kMaxAge.
+  public:
+    static constexpr uint8_t kMaxAge = 15;
+
+    explicit PageIdleAger(const std::string& bitmap_path = "/sys/kernel/mm/page_idle/bitmap")
+        : bitmap_path_(bitmap_path), nr_pfns_(0), generations_(0) {}
+
+    // Opens the bitmap, sizes the age counters for all pages in the system and starts the
+    // first generation. Any previous ages are dropped.
+    bool Init();
+
+    // Ends the current generation by updating the age of every page, then starts
+    // the next one.
+    bool Age();
+
+    // Returns the age of the page, i.e. the number of generations it has not been
+    // accessed in. Pages that are not user pages on the LRU always have age 0.
+    uint8_t PageAge(uint64_t pfn) const {
+        if (pfn >= nr_pfns_) return 0;
+        return (ages_[pfn / 2] >> ((pfn % 2) * 4)) & 0xf;
+    }
+
+    // Reads the pagemap of the process and adds the size of its resident pages, in kB, to
+    // 'kb_by_age' indexed by the age of the page. 'kb_by_age' is resized to kMaxAge + 1.
+    bool ProcessAgeHistogram(pid_t pid, std::vector<uint64_t>* kb_by_age) const;
+
+    uint64_t nr_pfns() const { return nr_pfns_; }
+    uint32_t generations() const { return generations_; }
+
+  private:
+    bool MarkAllIdle();
+
+    // Non-copyable & Non-movable
+    PageIdleAger(const PageIdleAger&) = delete;
+    PageIdleAger& operator=(const PageIdleAger&) = delete;
+
+    std::string bitmap_path_;
+    ::android::base::unique_fd bitmap_fd_;
+    uint64_t nr_pfns_;
+    uint32_t generations_;
+    // Two 4 bit ages per byte, the lower nibble holds the even pfn.
+    std::vector<uint8_t> ages_;
+};
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "meminfo.h"
+
+namespace android {
+namespace meminfo {
+
+// Page cache residency of a single file. All counts are in pages.
+struct PageCacheStats {
+    uint64_t size;
+    uint64_t cached;
+    uint64_t dirty;
+    uint64_t writeback;
+    uint64_t evicted;
+    uint64_t recently_evicted;
+    // True if the stats were read with cachestat(2). Otherwise only 'size'
+    // and 'cached' are valid, as mincore(2) can't tell dirty or evicted pages.
+    bool from_cachestat;
+
+    PageCacheStats()
+        : size(0),
+          cached(0),
+          dirty(0),
+          writeback(0),
+          evicted(0),
+          recently_evicted(0),
+          from_cachestat(false) {}
+
+    void clear() { *this = PageCacheStats(); }
+};
+
+struct PageCacheFile {
+    // (st_dev, st_ino) of the file
+    std::pair<dev_t, ino_t> key;
+    // First path the file was discovered with
+    std::string path;
+    // Path used to open the file, may be a /proc/<pid>/map_files/ entry for
+    // files that can't be reached through 'path' anymore.
+    std::string open_path;
+    bool queried;
+    PageCacheStats stats;
+};
+
+// Maps a file path to the name of the group it is accounted under, e.g. the library name.
+using PageCacheGroupFn = std::function<std::string(const std::string&)>;
+
+class PageCacheInfo final {
+    // Class to query page cache residency of files mapped by processes.
+    // Files are identified by (dev, inode), so that a file mapped by several
+    // processes (or several times) is only queried once per scan.
+  public:
+    PageCacheInfo() = default;
+
+    // Adds all file backed vmas of the process to the scan.
+    bool AddProcess(pid_t pid);
+    // Adds the file backing 'vma' to the scan. The vma name is used to reach the file,
+    // unless it has been replaced or deleted, in which case /proc/<pid>/map_files is
+    // used if 'pid' is valid.
+    bool AddVma(const Vma& vma, pid_t pid = -1);
+    // Adds a file by path to the scan.
+    bool AddFile(const std::string& path);
+
+    // Queries page cache residency of every file added since the last call.
+    // Results of files already queried are reused.
+    bool Scan();
+
+    const std::map<std::pair<dev_t, ino_t>, PageCacheFile>& Files() const { return files_; }
+
+    // Sums the stats of all queried files by group. If 'group_fn' is empty, files are
+    // grouped by path.
+    std::map<std::string, PageCacheStats> GroupStats(const PageCacheGroupFn& group_fn = {}) const;
+
+    // Drops all files and cached results so that the next scan starts over.
+    void Reset();
+
+  private:
+    bool AddFileAt(const std::string& path, const std::string& open_path, ino_t inode);
+
+    std::map<std::pair<dev_t, ino_t>, PageCacheFile> files_;
+    // Paths already resolved to a (dev, inode) pair during this scan.
+    std::unordered_map<std::string, std::pair<dev_t, ino_t>> path_keys_;
+};
+
+// Reads the page cache residency of an open file. cachestat(2) is used if supported
+// by the kernel and 'use_cachestat' is true, otherwise the file is mapped read-only
+// and private, and mincore(2) is used to count the cached pages.
+bool PageCacheStatsFromFd(int fd, PageCacheStats* stats, bool use_cachestat = true);
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "meminfo.h"
+
+namespace android {
+namespace meminfo {
+
+// Contents of the sampled anonymous pages of a process, or of all vmas with the same name.
+struct PageContentStats {
+    // Resident anonymous pages, not counting page frames already sampled from another
+    // mapping, and the ones that were read.
+    uint64_t resident_pages;
+    uint64_t sampled_pages;
+    // Sampled pages filled with zeros.
+    uint64_t zero_pages;
+    // Sampled pages filled with a single repeated word, including zero pages. zram stores
+    // them without compressing them, see same_pages in /sys/block/zram<id>/mm_stat.
+    uint64_t same_filled_pages;
+    // Sampled pages that merging all sampled pages with the same content would free, e.g.
+    // with KSM. Each of the n copies of a content counts as (n - 1) / n pages.
+    double duplicate_pages;
+    // As 'duplicate_pages', only merging pages of the same process.
+    double self_duplicate_pages;
+    // Savings of merging duplicate pages and of storing same filled pages in zram, scaled
+    // from the sampled pages to all resident pages of each process.
+    uint64_t ksm_savings_bytes;
+    uint64_t zram_same_bytes;
+
+    // The following are only computed if the sampler compresses pages.
+    // Size of the sampled pages in zram if compressed with LZ4. Same filled pages take no
+    // space, pages that don't compress are stored whole.
+    uint64_t compressed_bytes;
+    // compressed_bytes over the size of the sampled pages, and the half width of its 95%
+    // confidence interval.
+    double compression_ratio;
+    double compression_ratio_error;
+    // Size of all resident pages in zram, scaled from the sampled pages.
+    uint64_t zram_bytes;
+};
+
+class PageContentSampler final {
+    // Reads the contents of resident anonymous pages with process_vm_readv() to find zero
+    // pages, same filled pages and duplicate pages within and across processes, which
+    // smaps can't tell.
+    //
+    // At most 'page_budget' pages are read from each process, spread evenly over its
+    // resident anonymous pages. Only a 64 bit hash of each sampled page is kept. Duplicates
+    // are only found if all their copies are sampled, i.e. they are underestimated when
+    // a process has more resident pages than the budget.
+    //
+    // Reading the memory of another process requires ptrace access to it. If page frame
+    // numbers are readable from the pagemap, i.e. with CAP_SYS_ADMIN, a page frame is only
+    // sampled once, so that memory that is already shared, e.g. copy-on-write after fork,
+    // is not counted as duplicate.
+    //
+    // If 'compress' is set, the sampled pages are also compressed with LZ4, as zram does,
+    // to estimate how well the memory of each process compresses, which differs a lot
+    // between e.g. Java heaps and media buffers.
+  public:
+    explicit PageContentSampler(uint64_t page_budget, bool compress = false)
+        : page_budget_(page_budget), compress_(compress) {}
+
+    // Samples the resident pages of all anonymous vmas of the process.
+    bool AddProcess(pid_t pid);
+    // Samples the resident pages of 'vmas' of the process, which should all be anonymous.
+    // Each call has its own budget, and only finds duplicates within the process among the
+    // pages it samples.
+    bool AddVmas(pid_t pid, const std::vector<Vma>& vmas);
+
+    // Fills 'stats' with the stats of each process added so far.
+    void ProcessStats(std::map<pid_t, PageContentStats>* stats) const;
+    // Fills 'stats' with the stats of all sampled vmas with the same name, across processes.
+    // Vmas without a name are reported as "[anon]".
+    void VmaNameStats(std::map<std::string, PageContentStats>* stats) const;
+
+  private:
+    struct SampledPage {
+        uint64_t hash;
+        uint32_t proc;
+        uint32_t name;
+        uint32_t compressed_size;
+        bool zero;
+        bool same_filled;
+    };
+
+    struct SampledProcess {
+        pid_t pid;
+        uint64_t resident_pages;
+        // Resident pages per sampled page that could be read.
+        double scale;
+    };
+
+    // Fills 'nr_copies' and 'nr_self_copies' with the number of sampled pages with the
+    // same content as each sampled page, overall and in its process.
+    void CountCopies(std::vector<uint32_t>* nr_copies, std::vector<uint32_t>* nr_self_copies) const;
+    // Adds each sampled page i to (*stats)[groups[i]], whose resident pages must be set.
+    void GroupStats(const std::vector<uint32_t>& groups,
+                    std::vector<PageContentStats>* stats) const;
+
+    // Non-copyable & Non-movable
+    PageContentSampler(const PageContentSampler&) = delete;
+    PageContentSampler& operator=(const PageContentSampler&) = delete;
+
+    uint64_t page_budget_;
+    bool compress_;
+    std::vector<SampledProcess> procs_;
+    std::vector<SampledPage> pages_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> name_ids_;
+    // Resident pages of the vmas with each name.
+    std::vector<uint64_t> name_resident_pages_;
+    // Sampled page frames, only known with CAP_SYS_ADMIN.
+    std::unordered_set<uint64_t> sampled_pfns_;
+};
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <array>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "meminfo.h"
+
+namespace android {
+namespace meminfo {
+
+// Resident pages of a vma, bucketed by how many times they are mapped: bucket i counts
+// the pages mapped [2^i, 2^(i+1)) times, the last bucket also counts the pages mapped
+// more times.
+struct VmaSharingHistogram {
+    static constexpr size_t kNrBuckets = 10;
+
+    uint64_t start;
+    uint64_t end;
+    std::string name;
+    // By the mapcount of the page in /proc/kpagecount, i.e. by all mappings in the system.
+    std::array<uint64_t, kNrBuckets> pages;
+    // By the number of processes in the index that map the page.
+    std::array<uint64_t, kNrBuckets> indexed_pages;
+};
+
+// Memory of a process split by who else maps it, in bytes.
+struct ZygoteSharing {
+    // Mapped by this process only.
+    uint64_t private_bytes;
+    // Also mapped by a zygote, i.e. memory inherited from or shared with the zygote.
+    uint64_t zygote_shared_bytes;
+    // Shared with other processes, but not with a zygote.
+    uint64_t other_shared_bytes;
+};
+
+class PageSharingIndex final {
+    // Index from physical page to the set of processes that map it, built from the pagemap
+    // of each process.
+    //
+    // The index is a list of runs of consecutive page frames that are mapped by the same
+    // processes, sorted by page frame number. Each distinct set of sharers is stored once,
+    // as a sorted list of 16 bit process indices, and runs refer to it by id. As most
+    // shared pages are mapped by the same few sets of processes (e.g. all children of a
+    // zygote), the sets are few and small, and reports over all pairs of processes are
+    // computed once per set rather than once per page.
+  public:
+    PageSharingIndex() = default;
+
+    // Adds the resident pages of all vmas of the process, read from its pagemap, and their
+    // mapcounts, read from /proc/kpagecount. Page frame numbers are only reported with
+    // CAP_SYS_ADMIN.
+    bool AddProcess(pid_t pid);
+    // Adds 'pfns', the page frame numbers of the resident pages of 'vma', to the pages
+    // mapped by 'pid'. 'mapcounts' are the mapcounts of the pages, in the same order.
+    bool AddVmaPages(pid_t pid, const Vma& vma, const std::vector<uint64_t>& pfns,
+                     const std::vector<uint64_t>& mapcounts);
+
+    // Builds the index from the pages of all processes added so far. Processes can't be
+    // added afterwards.
+    void Build();
+
+    // Processes in the order they were added, the indices of the reports below.
+    const std::vector<pid_t>& Processes() const { return pids_; }
+    size_t NrRuns() const { return runs_.size(); }
+    size_t NrSharerSets() const { return set_offsets_.empty() ? 0 : set_offsets_.size() - 1; }
+
+    // Returns the processes that map 'pfn', or an empty list if none does.
+    std::vector<pid_t> Sharers(uint64_t pfn) const;
+
+    // Fills 'matrix' with the number of bytes mapped by both process i and process j at
+    // [i * n + j], for the n processes in Processes(). The diagonal holds the bytes
+    // mapped by each process, counting pages mapped more than once by it only once.
+    void SharedBytesMatrix(std::vector<uint64_t>* matrix) const;
+
+    // Splits the memory of each process in Processes() into private, zygote shared and
+    // other shared memory. 'zygote_pids' are the pids of the zygotes, which must be in
+    // the index.
+    void ZygoteSharingStats(const std::set<pid_t>& zygote_pids,
+                            std::vector<ZygoteSharing>* stats) const;
+
+    // Fills 'histograms' with the sharing histogram of each vma of 'pid' with resident
+    // pages, in the order they were added. Returns false if 'pid' is not in the index.
+    bool VmaSharingHistograms(pid_t pid, std::vector<VmaSharingHistogram>* histograms) const;
+
+  private:
+    struct VmaPages {
+        uint64_t start;
+        uint64_t end;
+        std::string name;
+    };
+
+    struct ProcessPages {
+        std::vector<VmaPages> vmas;
+        // Page frame number and vma index of each resident page, sorted by Build().
+        std::vector<uint64_t> pages;
+        // Buckets of VmaSharingHistogram::pages and indexed_pages of each page, filled by
+        // Build().
+        std::vector<uint8_t> buckets;
+        std::vector<uint8_t> indexed_buckets;
+    };
+
+    struct Run {
+        uint64_t pfn;
+        uint32_t nr_pages;
+        uint32_t set;
+    };
+
+    // Returns the run that contains 'pfn', or nullptr.
+    const Run* FindRun(uint64_t pfn) const;
+
+    // Non-copyable & Non-movable
+    PageSharingIndex(const PageSharingIndex&) = delete;
+    PageSharingIndex& operator=(const PageSharingIndex&) = delete;
+
+    bool built_ = false;
+    std::vector<pid_t> pids_;
+    std::vector<ProcessPages> procs_;
+    std::unordered_map<pid_t, uint16_t> proc_ids_;
+    // Page frame number above the mapcount of each added page, capped to the id bits.
+    std::vector<uint64_t> mapcounts_;
+
+    std::vector<Run> runs_;
+    // Members of set i are set_members_[set_offsets_[i], set_offsets_[i + 1]).
+    std::vector<uint32_t> set_offsets_;
+    std::vector<uint16_t> set_members_;
+    // Number of pages mapped by each set of sharers.
+    std::vector<uint64_t> set_pages_;
+};
+
+}  // namespace meminfo
+}  // namespace android
@@ -16,11 +16,15 @@
 
 #pragma once
 
+#include <stdio.h>
 #include <sys/types.h>
 
 #include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "meminfo.h"
@@ -29,6 +33,9 @@ namespace android {
 namespace meminfo {
 
 using VmaCallback = std::function<bool(Vma&)>;
+using VmaPredicate = std::function<bool(const Vma&)>;
+using NumaVmaCallback = std::function<bool(NumaVma&)>;
+using ThpVmaCallback = std::function<void(const Vma&, const ThpUsage&)>;
 
 class ProcMemInfo final {
     // Per-process memory accounting
@@ -55,6 +62,11 @@ class ProcMemInfo final {
     // usage will be populated in kilobytes instead of bytes.
     bool FillInVmaStats(Vma& vma, bool use_kb = false);
 
+    // Same as FillInVmaStats() with 'use_kb' for each of 'vmas', reading the pagemap
+    // through a single file descriptor. The vmas don't have to be in 'maps_', e.g. a large
+    // vma can be read in parts, each on a separate ProcMemInfo object.
+    bool FillInVmasStats(std::vector<Vma>* vmas);
+
     // If ReadMaps (with get_usage_stats == false) or MapsWithoutUsageStats was
     // called, this function will fill in usage stats for all vmas in 'maps_'.
     bool GetUsageStats(bool get_wss, bool use_pageidle = false, bool update_mem_usage = true);
@@ -77,6 +89,10 @@ class ProcMemInfo final {
     // passed to the callback.
     // Returns 'false' if the file is malformed.
     bool ForEachVma(const VmaCallback& callback, bool use_smaps = true);
+    // Same as above, with a callback that can be inlined, e.g. a lambda, which avoids the
+    // indirect call per vma of a VmaCallback.
+    template <typename F>
+    bool ForEachVma(F&& callback, bool use_smaps = true);
 
     // Reads all VMAs from /proc/<pid>/maps and calls the callback() for each one of them.
     // Returns false in case of failure during parsing.
@@ -86,11 +102,40 @@ class ProcMemInfo final {
     // to store the /proc/<pid>/maps content
     bool ForEachVmaFromMaps(const VmaCallback& callback, std::string& mapsBuffer);
 
+    // Calls predicate() with the maps level fields of every vma, i.e. its range, flags,
+    // offset, inode and name. Usage stats are then read from /proc/<pid>/pagemap only for
+    // the vmas that the predicate accepts, and callback() is called with each of them. The
+    // cost thus scales with the size of the matching vmas rather than the whole address
+    // space. The vmas are enumerated with the PROCMAP_QUERY ioctl if the kernel supports it,
+    // and from /proc/<pid>/maps otherwise. Usage is in kB.
+    // Returns false if the vmas or their usage could not be read, or if the callback
+    // returns false.
+    bool ForEachMatchingVma(const VmaPredicate& predicate, const VmaCallback& callback);
+
     // Takes the existing VMAs in 'maps_' and calls the callback() for each one
     // of them. This is intended to avoid parsing /proc/<pid>/maps or
     // /proc/<pid>/smaps twice.
     // Returns false if 'maps_' is empty.
     bool ForEachExistingVma(const VmaCallback& callback);
+    template <typename F>
+    bool ForEachExistingVma(F&& callback);
+
+    // Reads /proc/<pid>/numa_maps and calls the callback() for each vma found. The end
+    // address of each vma is filled in from /proc/<pid>/maps.
+    // Returns false if the file is malformed or the callback returns false.
+    bool ForEachNumaVma(const NumaVmaCallback& callback);
+
+    // Reads /proc/<pid>/numa_maps and records the node placement of the whole process
+    // in 'usage'. Unlike the per vma counts, all values are in kB so that mappings of
+    // different page sizes can be added up.
+    bool NumaUsageKb(NumaUsage* usage) const;
+
+    // Reads /proc/<pid>/smaps once and records the transparent huge page usage of the
+    // process in 'usage'. If not null, callback() is called with the usage of each vma.
+    // If 'get_bloat' is true, the pagemap of the process is also walked to find huge pages
+    // that are only partially mapped, which requires CAP_SYS_ADMIN.
+    bool ThpUsageKb(ThpUsage* usage, const ThpVmaCallback& callback = nullptr,
+                    bool get_bloat = false) const;
 
     // Used to parse either of /proc/<pid>/{smaps, smaps_rollup} and record the process's
     // Pss and Private memory usage in 'stats'.  In particular, the method only populates the fields
@@ -121,6 +166,14 @@ class ProcMemInfo final {
 
     const std::vector<uint64_t>& SwapOffsets();
 
+    // Attributes every resident page of the process to the memory cgroup it is charged to,
+    // as reported by /proc/kpagecgroup. Shared pages are charged to the memcg of the
+    // process that faulted them in first, which may not be the memcg of this process.
+    // Returns a map of memcg inode number -> usage of the pages charged to it, in kB. Use
+    // ReadMemcgPaths() to resolve the inode numbers. The working set is attributed instead
+    // of the usage if the object was created with 'get_wss'.
+    const std::map<uint64_t, MemUsage>& MemcgUsage();
+
     // Reads /proc/<pid>/pagemap for this process for each page within
     // the 'vma' and stores that in 'pagemap'. It is assumed that the 'vma'
     // is obtained by calling Maps() or 'ForEachVma' for the same object. No special checks
@@ -131,10 +184,13 @@ class ProcMemInfo final {
     ~ProcMemInfo() = default;
 
   private:
+    // Path of /proc/<pid>/smaps or /proc/<pid>/maps.
+    std::string VmaFilePath(bool use_smaps) const;
     bool ReadMaps(bool get_wss, bool use_pageidle = false, bool get_usage_stats = true,
                   bool update_mem_usage = true);
     bool ReadVmaStats(int pagemap_fd, Vma& vma, bool get_wss, bool use_pageidle,
-                      bool update_mem_usage, bool update_swap_usage);
+                      bool update_mem_usage, bool update_swap_usage,
+                      std::map<uint64_t, MemUsage>* memcg_usage = nullptr);
 
     pid_t pid_;
     bool get_wss_;
@@ -145,6 +201,41 @@ class ProcMemInfo final {
 
     MemUsage usage_;
     std::vector<uint64_t> swap_offsets_;
+    std::map<uint64_t, MemUsage> memcg_usage_;
+    bool memcg_usage_read_;
+};
+
+class VmaFileReader final {
+    // Reads the vmas of a file one at a time. If 'read_smaps_fields' is 'true', the file
+    // is expected to be in the same format as /proc/<pid>/smaps, else the file is expected
+    // to be formatted as /proc/<pid>/maps.
+  public:
+    VmaFileReader(const std::string& path, bool read_smaps_fields);
+    ~VmaFileReader();
+
+    // Reads the next vma into 'vma'. Returns false at the end of the file, or if the file
+    // could not be read, see ok().
+    bool Next(Vma* vma);
+    // Returns false if the file could not be opened or is malformed.
+    bool ok() const { return ok_; }
+
+  private:
+    bool ReadLine();
+
+    // Non-copyable & Non-movable
+    VmaFileReader(const VmaFileReader&) = delete;
+    VmaFileReader& operator=(const VmaFileReader&) = delete;
+
+    std::string path_;
+    bool read_smaps_fields_;
+    std::unique_ptr<FILE, decltype(&fclose)> fp_;
+    // getline() managed buffer.
+    char* line_ = nullptr;
+    size_t line_alloc_ = 0;
+    // Whether 'line_' holds the first line of the next vma, which is read while looking
+    // for the end of the smaps fields of the previous one.
+    bool pending_ = false;
+    bool ok_;
 };
 
 // Makes callback for each 'vma' or 'map' found in file provided.
@@ -155,6 +246,38 @@ class ProcMemInfo final {
 bool ForEachVmaFromFile(const std::string& path, const VmaCallback& callback,
                         bool read_smaps_fields = true);
 
+// Same as above, with a callback that can be inlined, e.g. a lambda, which avoids the
+// indirect call per vma of a VmaCallback.
+template <typename F>
+bool ForEachVmaFromFile(const std::string& path, F&& callback, bool read_smaps_fields = true) {
+    VmaFileReader reader(path, read_smaps_fields);
+    Vma vma;
+    while (reader.Next(&vma)) {
+        if (!callback(vma)) {
+            return false;
+        }
+    }
+    return reader.ok();
+}
+
+template <typename F>
+bool ProcMemInfo::ForEachVma(F&& callback, bool use_smaps) {
+    return ForEachVmaFromFile(VmaFilePath(use_smaps), std::forward<F>(callback), use_smaps);
+}
+
+template <typename F>
+bool ProcMemInfo::ForEachExistingVma(F&& callback) {
+    if (maps_.empty()) {
+        return false;
+    }
+    for (auto& vma : maps_) {
+        if (!callback(vma)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Returns if the kernel supports /proc/<pid>/smaps_rollup. Assumes that the
 // calling process has access to the /proc/<pid>/smaps_rollup.
 // Returns 'false' if the file doesn't exist.
@@ -174,6 +297,20 @@ bool SmapsOrRollupPssFromFile(const std::string& path, uint64_t* pss);
 // The file MUST be in the same format as /proc/<pid>/status.
 bool StatusVmRSSFromFile(const std::string& path, uint64_t* rss);
 
+// Same as ProcMemInfo::ForEachNumaVma but reads the vmas directly from a
+// file. The file MUST be in the same format as /proc/<pid>/numa_maps. As
+// there is no maps file to match against, the 'end' of every vma is 0.
+bool ForEachNumaVmaFromFile(const std::string& path, const NumaVmaCallback& callback);
+
+// Same as ProcMemInfo::NumaUsageKb but reads the vmas directly from a file.
+// The file MUST be in the same format as /proc/<pid>/numa_maps.
+bool NumaUsageKbFromFile(const std::string& path, NumaUsage* usage);
+
+// Same as ProcMemInfo::ThpUsageKb without 'get_bloat' but reads the vmas directly
+// from a file. The file MUST be in the same format as /proc/<pid>/smaps.
+bool ThpUsageKbFromFile(const std::string& path, ThpUsage* usage,
+                        const ThpVmaCallback& callback = nullptr);
+
 // The output format that can be specified by user.
 enum class Format { INVALID = 0, RAW, JSON, CSV };
 
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace meminfo {
+
+// Memory related fields of /proc/<pid>/stat.
+struct ProcStat {
+    pid_t pid;
+    // Truncated if longer than the buffer. Kernel threads may have names longer than
+    // TASK_COMM_LEN, e.g. "kworker/u16:3-events_unbound".
+    char comm[64];
+    char state;
+    pid_t ppid;
+    // PF_* flags of the task, e.g. PF_KTHREAD
+    uint32_t flags;
+    uint64_t minflt;
+    uint64_t majflt;
+    // In clock ticks
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t num_threads;
+    // Time the process started after boot, in clock ticks
+    uint64_t starttime;
+    // In bytes
+    uint64_t vsize;
+    // In pages
+    uint64_t rss;
+
+    ProcStat() { clear(); }
+    void clear() { memset(this, 0, sizeof(*this)); }
+};
+
+// Change of a process's stat between two consecutive samples.
+struct ProcStatDelta {
+    uint64_t minflt;
+    uint64_t majflt;
+    // utime + stime, in clock ticks
+    uint64_t cpu_time;
+    // In pages
+    int64_t rss;
+    // In bytes
+    int64_t vsize;
+    // Time between the two samples
+    uint64_t interval_ms;
+};
+
+// Parses the content of /proc/<pid>/stat without allocating. The comm field may contain
+// spaces and parentheses, so it is delimited by the first '(' and the last ')'.
+// Returns false if the content is malformed.
+bool ParseProcStat(const char* buf, size_t len, ProcStat* stat);
+
+// Same as ParseProcStat but reads the content from a file.
+bool ProcStatFromFile(const std::string& path, ProcStat* stat);
+
+// Returns true if the task is a kernel thread, from the PF_KTHREAD flag.
+bool IsKernelThread(const ProcStat& stat);
+
+// Returns true if the task has no user address space, i.e. it is a kernel thread or a
+// zombie that already released its memory. Reading the memory usage of such a task
+// always finds nothing.
+bool IsMmlessTask(const ProcStat& stat);
+
+class ProcStatReader final {
+    // Reads /proc/<pid>/stat of a set of processes repeatedly. The stat file of each
+    // process stays open between samples and is re-read with pread, so a sample costs
+    // one syscall per process. The previous sample is kept to report deltas.
+  public:
+    using SampleCallback =
+            std::function<void(const ProcStat& stat, const ProcStatDelta* delta)>;
+
+    ProcStatReader() = default;
+
+    // Opens /proc/<pid>/stat. Returns false if the process doesn't exist.
+    bool AddPid(pid_t pid);
+    void RemovePid(pid_t pid);
+    std::vector<pid_t> Pids() const;
+
+    // Reads the stat of all processes. Processes that exited since the last sample are
+    // removed and added to 'exited', if not null.
+    bool Sample(std::vector<pid_t>* exited = nullptr);
+
+    // Returns the latest sample of the process, or nullptr if it isn't tracked or was
+    // not sampled yet.
+    const ProcStat* Stat(pid_t pid) const;
+
+    // Fills in 'delta' with the change between the last two samples of the process.
+    // Returns false if the process was sampled less than twice.
+    bool Delta(pid_t pid, ProcStatDelta* delta) const;
+
+    // Calls 'callback' for each process with its latest sample and the delta to the previous
+    // one. 'delta' is nullptr for processes that were only sampled once.
+    void ForEachSample(const SampleCallback& callback) const;
+
+  private:
+    struct Entry {
+        ::android::base::unique_fd fd;
+        ProcStat cur;
+        ProcStat prev;
+        uint64_t cur_ms;
+        uint64_t prev_ms;
+        uint32_t nr_samples;
+    };
+
+    static bool ComputeDelta(const Entry& entry, ProcStatDelta* delta);
+
+    std::unordered_map<pid_t, Entry> entries_;
+};
+
+}  // namespace meminfo
+}  // namespace android
@@ -80,6 +80,11 @@ class SysMemInfo final {
                      const char* path = "/proc/meminfo");
     bool ReadMemInfo(std::vector<uint64_t>* out, const char* path = "/proc/meminfo");
 
+    // Parse <node_root>/node<node>/meminfo and read the values of that NUMA node. The
+    // per node meminfo has no Buffers, SwapTotal, SwapFree or MemAvailable, and reports
+    // the page cache as FilePages, so mem_cached_kb() etc. read 0.
+    bool ReadNodeMemInfo(int node, const std::string& node_root = "/sys/devices/system/node");
+
     // Parse /proc/vmallocinfo and return total physical memory mapped
     // in vmalloc area by the kernel.
     // Note that this deliberately ignores binder buffers. They are _always_
@@ -121,6 +126,14 @@ class SysMemInfo final {
     bool GetTotalMemCompacted(const char* zram_dev, uint64_t* out_mem_compacted);
     bool ReadMemInfo(const char* path, size_t ntags, const std::string_view* tags,
                      std::function<void(std::string_view, uint64_t)> store_val);
+    bool ParseMemInfo(char* buffer, const char* path, size_t ntags, const std::string_view* tags,
+                      std::function<void(std::string_view, uint64_t)> store_val);
+    // Same as above, with 'store_val' inlined into the loop over the tags.
+    template <typename F>
+    bool ReadMemInfo(const char* path, size_t ntags, const std::string_view* tags, F&& store_val);
+    template <typename F>
+    bool ParseMemInfo(char* buffer, const char* path, size_t ntags, const std::string_view* tags,
+                      F&& store_val);
     // Convenience function to avoid duplicating code for each memory category.
     uint64_t find_mem_by_tag(const char kTag[]) const {
         auto it = mem_in_kb_.find(kTag);
@@ -136,6 +149,11 @@ class SysMemInfo final {
 // _always_ mapped in a process and are counted for in each process.
 uint64_t ReadVmallocInfo(const char* path = "/proc/vmallocinfo");
 
+// Read the meminfo of every NUMA node under 'node_root'. Returns a map of node id -> SysMemInfo
+// of that node, see SysMemInfo::ReadNodeMemInfo.
+bool ReadNodesMemInfo(std::map<int, SysMemInfo>* nodes,
+                      const std::string& node_root = "/sys/devices/system/node");
+
 // Read ION heaps allocation size in kb
 bool ReadIonHeapsSizeKb(
     uint64_t* size, const std::string& path = "/sys/kernel/ion/total_heaps_kb");
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "asyncscan.h"
+
+namespace android {
+namespace meminfo {
+
+class WorkStealingPool final {
+    // Runs tasks on a fixed number of threads, each with its own deque of tasks. A worker
+    // runs the newest task of its own deque and, once it is empty, steals the oldest task
+    // of another worker. A task may spawn more tasks, e.g. a scan of a process that turns
+    // out to be large can split the rest of it, and the parts that its worker doesn't get
+    // to are picked up by the idle workers. Tasks run in no particular order, so they
+    // should write their results to separate slots that are merged once Run() returns.
+  public:
+    using Task = std::function<void()>;
+
+    // Uses one thread per cpu if 'nr_workers' is 0.
+    explicit WorkStealingPool(size_t nr_workers = 0);
+
+    // Runs 'tasks' and all the tasks they spawn, on the calling thread and nr_workers() - 1
+    // threads started for the run. Returns once all of them are done.
+    void Run(std::vector<Task> tasks);
+    // Adds 'task' to the deque of the calling worker. Must only be called from a task
+    // run by this pool.
+    void Spawn(Task task);
+
+    size_t nr_workers() const { return workers_.size(); }
+
+  private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void Push(size_t worker, Task task);
+    // Takes the newest task of 'worker', or else the oldest task of another worker.
+    bool Pop(size_t worker, Task* task);
+    void WorkerLoop(size_t worker);
+
+    // Non-copyable & Non-movable
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Tasks that haven't finished, and tasks waiting in a deque.
+    std::atomic<size_t> nr_pending_ = 0;
+    std::atomic<size_t> nr_queued_ = 0;
+    // Idle workers wait for a task to be queued or for the run to end.
+    std::mutex idle_lock_;
+    std::condition_variable idle_cv_;
+};
+
+// Processes are split into parts of this many pages of address space by default.
+static constexpr uint64_t kDefaultScanSplitPages = 16384;
+
+// Reads the usage of each process in 'pids' from its pagemap on 'pool', the same as
+// ProcMemInfo::Usage(). Each process is a task, which splits its vmas into parts of at
+// most 'split_pages' pages and spawns a task for each part but the first, so that a few
+// large processes don't leave the other workers idle. The parts are added up in order
+// once all tasks are done, and 'usages' is in the order of 'pids', regardless of the
+// number of workers. Processes that exit during the scan are skipped. The PSS of a split
+// process is rounded down to kB per part rather than per vma.
+bool ReadProcessesUsageParallel(const std::vector<pid_t>& pids, WorkStealingPool* pool,
+                                std::vector<ProcessUsage>* usages,
+                                uint64_t split_pages = kDefaultScanSplitPages);
+
+}  // namespace meminfo
+}  // namespace android
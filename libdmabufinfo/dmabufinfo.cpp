@@ -26,6 +26,8 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include <android-base/file.h>
@@ -51,8 +53,51 @@ enum FdInfoResult {
     ERROR,
 };
 
+// Parses the value of a DRM memory key of fdinfo, e.g. "1024 KiB", in bytes.
+static uint64_t ParseDrmMemory(const char* c) {
+    char* end;
+    uint64_t val = strtoull(c, &end, 10);
+    while (isspace(*end)) end++;
+    if (strncmp(end, "KiB", 3) == 0) return val << 10;
+    if (strncmp(end, "MiB", 3) == 0) return val << 20;
+    if (strncmp(end, "GiB", 3) == 0) return val << 30;
+    return val;
+}
+
+// Parses a "drm-" line of fdinfo, see Documentation/gpu/drm-usage-stats.rst in the kernel.
+static void ParseDrmFdInfoLine(const char* line, DrmClient* client, bool* is_drm_client) {
+    const char* colon = strchr(line, ':');
+    if (!colon) {
+        return;
+    }
+    std::string_view key(line, colon - line);
+    const char* c = colon + 1;
+
+    if (key == "drm-driver") {
+        client->driver = ::android::base::Trim(c);
+        *is_drm_client = true;
+    } else if (key == "drm-pdev") {
+        client->pdev = ::android::base::Trim(c);
+    } else if (key == "drm-client-id") {
+        client->client_id = strtoull(c, nullptr, 10);
+    } else if (::android::base::ConsumePrefix(&key, "drm-total-")) {
+        client->regions[std::string(key)].total = ParseDrmMemory(c);
+    } else if (::android::base::ConsumePrefix(&key, "drm-shared-")) {
+        client->regions[std::string(key)].shared = ParseDrmMemory(c);
+    } else if (::android::base::ConsumePrefix(&key, "drm-resident-") ||
+               ::android::base::ConsumePrefix(&key, "drm-memory-")) {
+        // drm-memory-* is the deprecated name of drm-resident-*.
+        DrmMemoryRegion& region = client->regions[std::string(key)];
+        region.resident = ParseDrmMemory(c);
+        region.has_resident = true;
+    }
+}
+
+// Reads the fdinfo of a file descriptor. The DRM keys are only parsed if 'drm_client' is
+// not nullptr.
 static FdInfoResult ReadDmaBufFdInfo(pid_t pid, int fd, std::string* name, std::string* exporter,
                              uint64_t* count, uint64_t* size, uint64_t* inode, bool* is_dmabuf_file,
+                             DrmClient* drm_client, bool* is_drm_client,
                              const std::string& procfs_path) {
     std::string fdinfo =
             ::android::base::StringPrintf("%s/%d/fdinfo/%d", procfs_path.c_str(), pid, fd);
@@ -74,6 +119,11 @@ static FdInfoResult ReadDmaBufFdInfo(pid_t pid, int fd, std::string* name, std::
                     *count = strtoull(c, nullptr, 10);
                 }
                 break;
+            case 'd':
+                if (drm_client && strncmp(line, "drm-", 4) == 0) {
+                    ParseDrmFdInfoLine(line, drm_client, is_drm_client);
+                }
+                break;
             case 'e':
                 if (strncmp(line, "exp_name:", 9) == 0) {
                     const char* c = line + 9;
@@ -105,9 +155,32 @@ static FdInfoResult ReadDmaBufFdInfo(pid_t pid, int fd, std::string* name, std::
     return OK;
 }
 
+// Adds 'client' of 'pid' to 'drm_clients', unless it is already in there.
+static void AddDrmClient(pid_t pid, DrmClient&& client, std::vector<DrmClient>* drm_clients) {
+    if (client.client_id != 0) {
+        auto it = std::find_if(drm_clients->begin(), drm_clients->end(),
+                               [&client](const DrmClient& other) {
+                                   return other.client_id == client.client_id &&
+                                          other.driver == client.driver &&
+                                          other.pdev == client.pdev;
+                               });
+        if (it != drm_clients->end()) {
+            it->pids.insert(pid);
+            return;
+        }
+    }
+    client.pids.insert(pid);
+    drm_clients->emplace_back(std::move(client));
+}
+
 // Public methods
 bool ReadDmaBufFdRefs(int pid, std::vector<DmaBuffer>* dmabufs,
                              const std::string& procfs_path) {
+    return ReadFdInfoRefs(pid, dmabufs, nullptr, procfs_path);
+}
+
+bool ReadFdInfoRefs(pid_t pid, std::vector<DmaBuffer>* dmabufs,
+                    std::vector<DrmClient>* drm_clients, const std::string& procfs_path) {
     constexpr char permission_err_msg[] =
             "Failed to read fdinfo - requires either PTRACE_MODE_READ or root depending on "
             "the device kernel";
@@ -142,9 +215,12 @@ bool ReadDmaBufFdRefs(int pid, std::vector<DmaBuffer>* dmabufs,
         uint64_t size = 0;
         uint64_t inode = -1;
         bool is_dmabuf_file = false;
+        DrmClient drm_client;
+        bool is_drm_client = false;
 
         auto fdinfo_result = ReadDmaBufFdInfo(pid, fd, &name, &exporter, &count, &size, &inode,
-                                              &is_dmabuf_file, procfs_path);
+                                              &is_dmabuf_file, drm_clients ? &drm_client : nullptr,
+                                              &is_drm_client, procfs_path);
         if (fdinfo_result != OK) {
             if (fdinfo_result == NOT_FOUND) {
                 continue;
@@ -159,6 +235,9 @@ bool ReadDmaBufFdRefs(int pid, std::vector<DmaBuffer>* dmabufs,
             }
             return false;
         }
+        if (is_drm_client) {
+            AddDrmClient(pid, std::move(drm_client), drm_clients);
+        }
         if (!is_dmabuf_file) {
             continue;
         }
@@ -278,6 +278,17 @@ class DmaBufProcessStatsTest : public ::testing::Test {
         ASSERT_TRUE(android::base::WriteStringToFile(fdinfo, fdinfo_file_path));
     }
 
+    void AddDrmFdInfo(const std::filesystem::path& fdinfo_path, uint64_t client_id,
+                      const std::string& memory) {
+        std::string fdinfo = android::base::StringPrintf(
+                "pos:\t0\nflags:\t02100002\nmnt_id:\t24\nino:\t%d\ndrm-driver:\tmsm\n"
+                "drm-pdev:\t0000:00:02.0\ndrm-client-id:\t%" PRIu64 "\n%s",
+                fd, client_id, memory.c_str());
+
+        auto fdinfo_file_path = fdinfo_path / android::base::StringPrintf("%d", fd++);
+        ASSERT_TRUE(android::base::WriteStringToFile(fdinfo, fdinfo_file_path));
+    }
+
     void AddSysfsDmaBufStats(unsigned int inode, unsigned int size, unsigned int mmap_count) {
         auto buffer_path = dmabuf_sysfs_path / android::base::StringPrintf("%u", inode);
         ASSERT_TRUE(fs::create_directory(buffer_path));
@@ -393,6 +404,59 @@ TEST_F(DmaBufProcessStatsTest, TestReadDmaBufFdRefs) {
     ASSERT_EQ(pid_fdrefs2->second, 1);
 }
 
+TEST_F(DmaBufProcessStatsTest, TestReadFdInfoRefs) {
+    AddFdInfo(1, 1024, false);
+    AddFdInfo(2, 2048, true);
+    std::string memory =
+            "drm-engine-gfx:\t1000 ns\ndrm-total-vram:\t8 MiB\ndrm-shared-vram:\t2 MiB\n"
+            "drm-resident-vram:\t6 MiB\ndrm-total-system:\t4096\n";
+    AddDrmFdInfo(pid_fdinfo_path, 5, memory);
+    // The same client through another file descriptor.
+    AddDrmFdInfo(pid_fdinfo_path, 5, memory);
+    // A client of an older driver that only reports drm-memory-*.
+    AddDrmFdInfo(pid_fdinfo_path, 6, "drm-memory-gtt:\t512 KiB\n");
+
+    // Another process with the first client open, e.g. after fork().
+    auto other_fdinfo_path = procfs_path / "11" / "fdinfo";
+    ASSERT_TRUE(fs::create_directories(other_fdinfo_path));
+    AddDrmFdInfo(other_fdinfo_path, 5, memory);
+
+    std::vector<DmaBuffer> dmabufs;
+    std::vector<DrmClient> drm_clients;
+    ASSERT_TRUE(ReadFdInfoRefs(pid, &dmabufs, &drm_clients, procfs_path));
+    ASSERT_TRUE(ReadFdInfoRefs(11, &dmabufs, &drm_clients, procfs_path));
+    ASSERT_EQ(dmabufs.size(), 1u);
+    EXPECT_EQ(dmabufs[0].inode(), 2u);
+    ASSERT_EQ(drm_clients.size(), 2u);
+
+    auto client1 = std::find_if(drm_clients.begin(), drm_clients.end(),
+                                [](const DrmClient& client) { return client.client_id == 5; });
+    ASSERT_NE(client1, drm_clients.end());
+    EXPECT_EQ(client1->driver, "msm");
+    EXPECT_EQ(client1->pdev, "0000:00:02.0");
+    EXPECT_EQ(client1->pids, std::set<pid_t>({pid, 11}));
+    ASSERT_EQ(client1->regions.size(), 2u);
+    const DrmMemoryRegion& vram = client1->regions.at("vram");
+    EXPECT_EQ(vram.total, 8u << 20);
+    EXPECT_EQ(vram.shared, 2u << 20);
+    EXPECT_EQ(vram.resident, 6u << 20);
+    // The system region doesn't report the resident memory, the total is used instead.
+    EXPECT_EQ(client1->regions.at("system").Resident(), 4096u);
+    EXPECT_EQ(client1->PrivateResident(), (4u << 20) + 4096);
+    EXPECT_EQ(client1->Pss(), ((4u << 20) + 4096) / 2);
+
+    auto client2 = std::find_if(drm_clients.begin(), drm_clients.end(),
+                                [](const DrmClient& client) { return client.client_id == 6; });
+    ASSERT_NE(client2, drm_clients.end());
+    EXPECT_EQ(client2->pids, std::set<pid_t>({pid}));
+    EXPECT_EQ(client2->Pss(), 512u << 10);
+
+    // The DRM keys are ignored when only the dmabufs are read.
+    dmabufs.clear();
+    ASSERT_TRUE(ReadDmaBufFdRefs(pid, &dmabufs, procfs_path));
+    ASSERT_EQ(dmabufs.size(), 1u);
+}
+
 TEST_F(DmaBufProcessStatsTest, TestReadDmaBufMapRefs) {
     std::vector<std::string> map_entries;
     map_entries.emplace_back(CreateMapEntry(1, 1024, false));
@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <map>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -88,6 +90,42 @@ struct DmaBuffer {
     }
 };
 
+// Memory of a DRM client in one memory region, e.g. "vram" or "system", in bytes, as
+// reported by the drm-total-*, drm-shared-* and drm-resident-* keys of fdinfo.
+struct DrmMemoryRegion {
+    uint64_t total = 0;
+    // Memory shared with other clients, i.e. exported buffers, which are also dmabufs.
+    uint64_t shared = 0;
+    uint64_t resident = 0;
+    // Older drivers only report drm-memory-*, which is the resident memory, newer drivers
+    // don't have to report the resident memory.
+    bool has_resident = false;
+
+    uint64_t Resident() const { return has_resident ? resident : total; }
+};
+
+// A DRM file, i.e. a GPU context, as described by the drm-* keys of the fdinfo of the
+// file descriptors it is open through.
+struct DrmClient {
+    std::string driver;
+    std::string pdev;
+    // Unique per device, 0 if the driver doesn't report it.
+    uint64_t client_id = 0;
+    std::map<std::string, DrmMemoryRegion> regions;
+    // Processes that have the client open.
+    std::set<pid_t> pids;
+
+    // Resident memory of the client that isn't shared with other clients, in bytes.
+    uint64_t PrivateResident() const {
+        uint64_t bytes = 0;
+        for (const auto& [name, region] : regions) {
+            bytes += region.Resident() - std::min(region.shared, region.Resident());
+        }
+        return bytes;
+    }
+    uint64_t Pss() const { return pids.empty() ? 0 : PrivateResident() / pids.size(); }
+};
+
 // Read and return dmabuf objects for a given process without the help
 // of DEBUGFS
 // Returns false if something went wrong with the function, true otherwise.
@@ -105,6 +143,16 @@ bool ReadDmaBufInfo(pid_t pid, std::vector<DmaBuffer>* dmabufs, bool read_fdrefs
 bool ReadDmaBufFdRefs(int pid, std::vector<DmaBuffer>* dmabufs,
                       const std::string& procfs_path = "/proc");
 
+// Same as ReadDmaBufFdRefs(), and in the same pass over the fdinfo of the process,
+// appends the DRM clients it has open to 'drm_clients'. A client that is open through
+// several file descriptors, also of other processes, is only added once, with each of
+// the processes in its pids. Clients are told apart by their driver, device and
+// drm-client-id. 'drm_clients' may be nullptr.
+// Returns true on success, otherwise false.
+bool ReadFdInfoRefs(pid_t pid, std::vector<DmaBuffer>* dmabufs,
+                    std::vector<DrmClient>* drm_clients,
+                    const std::string& procfs_path = "/proc");
+
 // Appends new mapped dmabuf objects from a given process to an existing vector.
 // If the vector contains an existing element with a matching inode, the reference
 // counts are updated.
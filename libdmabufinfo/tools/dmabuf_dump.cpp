@@ -20,17 +20,18 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-#include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
-#include <set>
-#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <dmabufinfo/dmabuf_sysfs_stats.h>
 #include <dmabufinfo/dmabufinfo.h>
@@ -45,8 +46,9 @@ std::unique_ptr<DmabufOutputHelper> outputHelper;
 
 [[noreturn]] static void usage(int exit_status) {
     fprintf(stderr,
-            "Usage: %s [-abh] [PID] [-o <raw|csv>]\n"
+            "Usage: %s [-abhs] [PID] [-o <raw|csv>]\n"
             "-a\t show all dma buffers (ion) in big table, [buffer x process] grid \n"
+            "-s\t with -a, only list the cells of the grid with references, one per line \n"
             "-b\t show DMA-BUF per-buffer, per-exporter and per-device statistics \n"
             "-o\t [raw][csv] print output in the specified format.\n"
             "-h\t show this help\n"
@@ -57,17 +59,38 @@ std::unique_ptr<DmabufOutputHelper> outputHelper;
     exit(exit_status);
 }
 
-static std::string GetProcessComm(const pid_t pid) {
-    std::string pid_path = android::base::StringPrintf("/proc/%d/comm", pid);
-    std::ifstream in{pid_path};
-    if (!in) return std::string("N/A");
-    std::string line;
-    std::getline(in, line);
-    if (!in) return std::string("N/A");
-    return line;
+// Returns the comm of the process, which is only read once per process.
+static const std::string& GetProcessComm(const pid_t pid) {
+    static std::unordered_map<pid_t, std::string> comms;
+    auto [it, inserted] = comms.try_emplace(pid);
+    if (inserted) {
+        std::string pid_path = android::base::StringPrintf("/proc/%d/comm", pid);
+        if (!android::base::ReadFileToString(pid_path, &it->second) || it->second.empty()) {
+            it->second = "N/A";
+        } else {
+            it->second.resize(strcspn(it->second.c_str(), "\n"));
+        }
+    }
+    return it->second;
+}
+
+// Returns the sorted pids of all processes that reference any of the buffers.
+static std::vector<pid_t> GetBufferPids(const std::vector<DmaBuffer>& bufs) {
+    std::vector<pid_t> pids;
+    for (auto& buf : bufs) {
+        pids.insert(pids.end(), buf.pids().begin(), buf.pids().end());
+    }
+    std::sort(pids.begin(), pids.end());
+    pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+    return pids;
+}
+
+static int GetPidRefs(const std::unordered_map<pid_t, int>& refs, pid_t pid) {
+    auto it = refs.find(pid);
+    return it == refs.end() ? 0 : it->second;
 }
 
-static void PrintDmaBufTable(const std::vector<DmaBuffer>& bufs) {
+static void PrintDmaBufTable(const std::vector<DmaBuffer>& bufs, bool sparse) {
     if (bufs.empty()) {
         printf("dmabuf info not found ¯\\_(ツ)_/¯\n");
         return;
@@ -75,63 +98,81 @@ static void PrintDmaBufTable(const std::vector<DmaBuffer>& bufs) {
 
     printf("\n----------------------- DMA-BUF Table buffer x process --------------------------\n");
 
-    // Find all unique pids in the input vector, create a set
-    std::set<pid_t> pid_set;
-    for (auto& buf : bufs) {
-        pid_set.insert(buf.pids().begin(), buf.pids().end());
-    }
+    // All processes are the columns of the table, sorted by pid.
+    std::vector<pid_t> pids = GetBufferPids(bufs);
 
-    outputHelper->BufTableMainHeaders();
-    for (auto pid : pid_set) {
-        std::string process = GetProcessComm(pid);
-        outputHelper->BufTableProcessHeader(pid, process);
+    if (sparse) {
+        outputHelper->BufTableSparseHeader();
+    } else {
+        outputHelper->BufTableMainHeaders();
+        for (auto pid : pids) {
+            outputHelper->BufTableProcessHeader(pid, GetProcessComm(pid));
+        }
+        printf("\n");
     }
-    printf("\n");
 
-    // holds per-process dmabuf size in kB
-    std::map<pid_t, uint64_t> per_pid_size = {};
+    // holds per-process dmabuf size in kB, indexed like 'pids'
+    std::vector<uint64_t> per_pid_size(pids.size(), 0);
     uint64_t dmabuf_total_size = 0;
 
-    // Iterate through all dmabufs and collect per-process sizes, refs
+    // Iterate through all dmabufs and collect per-process sizes, refs. Only the processes
+    // referencing a buffer are looked up, the other cells of the row are empty.
     for (auto& buf : bufs) {
-        outputHelper->BufTableStats(buf);
-        // Iterate through each process to find out per-process references for each buffer,
-        // gather total size used by each process etc.
-        for (pid_t pid : pid_set) {
-            int pid_fdrefs = 0, pid_maprefs = 0;
-            if (buf.fdrefs().count(pid) == 1) {
-                // Get the total number of ref counts the process is holding
-                // on this buffer. We don't differentiate between mmap or fd.
-                pid_fdrefs += buf.fdrefs().at(pid);
-            }
-            if (buf.maprefs().count(pid) == 1) {
-                pid_maprefs += buf.maprefs().at(pid);
+        if (!sparse) outputHelper->BufTableStats(buf);
+        size_t col = 0;
+        for (pid_t pid : buf.pids()) {
+            // Both the columns and the pids of the buffer are sorted.
+            for (; pids[col] != pid; col++) {
+                if (!sparse) outputHelper->BufTableProcessSize(0, 0);
             }
 
-            if (pid_fdrefs || pid_maprefs) {
-                // Add up the per-pid total size. Note that if a buffer is mapped
-                // in 2 different processes, the size will be shown as mapped or opened
-                // in both processes. This is intended for visibility.
-                //
-                // If one wants to get the total *unique* dma buffers, they can simply
-                // sum the size of all dma bufs shown by the tool
-                per_pid_size[pid] += buf.size() / 1024;
+            // Get the total number of ref counts the process is holding
+            // on this buffer. We don't differentiate between mmap or fd.
+            int pid_fdrefs = GetPidRefs(buf.fdrefs(), pid);
+            int pid_maprefs = GetPidRefs(buf.maprefs(), pid);
+
+            // Add up the per-pid total size. Note that if a buffer is mapped
+            // in 2 different processes, the size will be shown as mapped or opened
+            // in both processes. This is intended for visibility.
+            //
+            // If one wants to get the total *unique* dma buffers, they can simply
+            // sum the size of all dma bufs shown by the tool
+            per_pid_size[col] += buf.size() / 1024;
+            if (sparse) {
+                outputHelper->BufTableSparseCell(buf, pid, GetProcessComm(pid), pid_fdrefs,
+                                                 pid_maprefs);
+            } else {
+                outputHelper->BufTableProcessSize(pid_fdrefs, pid_maprefs);
             }
-            outputHelper->BufTableProcessSize(pid_fdrefs, pid_maprefs);
+            col++;
         }
         dmabuf_total_size += buf.size() / 1024;
-        printf("\n");
+        if (!sparse) {
+            for (; col < pids.size(); col++) {
+                outputHelper->BufTableProcessSize(0, 0);
+            }
+            printf("\n");
+        }
     }
 
     printf("------------------------------------\n");
+    if (sparse) {
+        outputHelper->BufTableSparseTotalHeader();
+        for (size_t i = 0; i < pids.size(); i++) {
+            outputHelper->BufTableSparseTotalProcessStats(pids[i], GetProcessComm(pids[i]),
+                                                          per_pid_size[i]);
+        }
+        outputHelper->BufTableSparseTotalStats(dmabuf_total_size);
+        return;
+    }
+
     outputHelper->BufTableTotalHeader();
-    for (auto pid : pid_set) {
-        std::string process = GetProcessComm(pid);
-        outputHelper->BufTableTotalProcessHeader(pid, process);
+    for (auto pid : pids) {
+        outputHelper->BufTableTotalProcessHeader(pid, GetProcessComm(pid));
     }
 
     outputHelper->BufTableTotalStats(dmabuf_total_size);
-    for (auto const& [pid, pid_size] : per_pid_size) {
+    for (uint64_t pid_size : per_pid_size) {
         outputHelper->BufTableTotalProcessStats(pid_size);
     }
     printf("\n");
@@ -143,33 +184,36 @@ static void PrintDmaBufPerProcess(const std::vector<DmaBuffer>& bufs) {
         return;
     }
 
-    // Create a reverse map from pid to dmabufs
-    std::unordered_map<pid_t, std::set<ino_t>> pid_to_inodes = {};
+    // Visit the buffers by inode, so the buffers of each process are listed in inode order.
+    std::vector<const DmaBuffer*> bufs_by_inode;
+    bufs_by_inode.reserve(bufs.size());
     uint64_t userspace_size = 0;  // Size of userspace dmabufs in the system
     for (auto& buf : bufs) {
-        for (auto pid : buf.pids()) {
-            pid_to_inodes[pid].insert(buf.inode());
-        }
+        bufs_by_inode.push_back(&buf);
         userspace_size += buf.size();
     }
-    // Create an inode to dmabuf map. We know inodes are unique..
-    std::unordered_map<ino_t, DmaBuffer> inode_to_dmabuf;
-    for (auto buf : bufs) {
-        inode_to_dmabuf[buf.inode()] = buf;
+    std::sort(bufs_by_inode.begin(), bufs_by_inode.end(),
+              [](const DmaBuffer* a, const DmaBuffer* b) { return a->inode() < b->inode(); });
+
+    // Create a reverse map from pid to dmabufs. We know inodes are unique..
+    std::map<pid_t, std::vector<const DmaBuffer*>> pid_to_bufs;
+    for (const DmaBuffer* buf : bufs_by_inode) {
+        for (auto pid : buf->pids()) {
+            pid_to_bufs[pid].push_back(buf);
+        }
     }
 
     uint64_t total_rss = 0, total_pss = 0;
-    for (auto& [pid, inodes] : pid_to_inodes) {
+    for (auto& [pid, pid_bufs] : pid_to_bufs) {
         uint64_t pss = 0;
         uint64_t rss = 0;
 
         outputHelper->PerProcessHeader(GetProcessComm(pid), pid);
 
-        for (auto& inode : inodes) {
-            DmaBuffer& buf = inode_to_dmabuf[inode];
-            outputHelper->PerProcessBufStats(buf);
-            rss += buf.size();
-            pss += buf.Pss();
+        for (const DmaBuffer* buf : pid_bufs) {
+            outputHelper->PerProcessBufStats(*buf);
+            rss += buf->size();
+            pss += buf->Pss();
         }
 
         outputHelper->PerProcessTotalStat(pss, rss);
@@ -224,13 +268,15 @@ int main(int argc, char* argv[]) {
     struct option longopts[] = {{"all", no_argument, nullptr, 'a'},
                                 {"per-buffer", no_argument, nullptr, 'b'},
                                 {"help", no_argument, nullptr, 'h'},
+                                {"sparse", no_argument, nullptr, 's'},
                                 {0, 0, nullptr, 0}};
 
     int opt;
     bool show_table = false;
     bool show_dmabuf_sysfs_stats = false;
+    bool sparse_table = false;
     Format format = Format::RAW;
-    while ((opt = getopt_long(argc, argv, "abho:", longopts, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "abho:s", longopts, nullptr)) != -1) {
         switch (opt) {
             case 'a':
                 show_table = true;
@@ -254,6 +300,9 @@ int main(int argc, char* argv[]) {
                 break;
             case 'h':
                 usage(EXIT_SUCCESS);
+            case 's':
+                sparse_table = true;
+                break;
             default:
                 usage(EXIT_FAILURE);
         }
@@ -263,6 +312,11 @@ int main(int argc, char* argv[]) {
         outputHelper = std::make_unique<RawOutput>();
     }
 
+    if (sparse_table && !show_table) {
+        fprintf(stderr, "Invalid arguments: -s is only valid with -a\n");
+        usage(EXIT_FAILURE);
+    }
+
     pid_t pid = -1;
     if (optind < argc) {
         if (show_table || show_dmabuf_sysfs_stats) {
@@ -304,7 +358,7 @@ int main(int argc, char* argv[]) {
     // Show the old dmabuf table, inode x process
     if (show_table) {
         printf("%s", (show_dmabuf_sysfs_stats) ? "\n\n" : "");
-        PrintDmaBufTable(bufs);
+        PrintDmaBufTable(bufs, sparse_table);
         return 0;
     }
 
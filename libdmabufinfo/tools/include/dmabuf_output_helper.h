@@ -41,6 +41,16 @@ class DmabufOutputHelper {
     virtual void BufTableTotalStats(const uint64_t dmabuf_total_size) = 0;
     virtual void BufTableTotalProcessStats(const uint64_t pid_size) = 0;
 
+    // Sparse table buffer x process, one line per buffer referenced by a process
+    virtual void BufTableSparseHeader() = 0;
+    virtual void BufTableSparseCell(const android::dmabufinfo::DmaBuffer& buf, const pid_t pid,
+                                    const std::string& process, int pid_fdrefs,
+                                    int pid_maprefs) = 0;
+    virtual void BufTableSparseTotalHeader() = 0;
+    virtual void BufTableSparseTotalProcessStats(const pid_t pid, const std::string& process,
+                                                 const uint64_t pid_size) = 0;
+    virtual void BufTableSparseTotalStats(const uint64_t dmabuf_total_size) = 0;
+
     // Per Process
     virtual void PerProcessHeader(const std::string& process, const pid_t pid) = 0;
     virtual void PerProcessBufStats(const android::dmabufinfo::DmaBuffer& buf) = 0;
@@ -95,6 +105,32 @@ class CsvOutput final : public DmabufOutputHelper {
         printf(",%" PRIu64 "", pid_size);
     }
 
+    // Sparse table buffer x process
+    void BufTableSparseHeader() override {
+        printf("\"Dmabuf Inode\",\"Size(kB)\",\"Process\",\"PID\",\"Fd Ref Counts\","
+               "\"Map Ref Counts\"\n");
+    }
+
+    void BufTableSparseCell(const android::dmabufinfo::DmaBuffer& buf, const pid_t pid,
+                            const std::string& process, int pid_fdrefs,
+                            int pid_maprefs) override {
+        printf("%ju,%" PRIu64 ",\"%s\",%d,%d,%d\n", static_cast<uintmax_t>(buf.inode()),
+               buf.size() / 1024, process.c_str(), pid, pid_fdrefs, pid_maprefs);
+    }
+
+    void BufTableSparseTotalHeader() override {
+        printf("\"Process\",\"PID\",\"Size(kB)\"\n");
+    }
+
+    void BufTableSparseTotalProcessStats(const pid_t pid, const std::string& process,
+                                         const uint64_t pid_size) override {
+        printf("\"%s\",%d,%" PRIu64 "\n", process.c_str(), pid, pid_size);
+    }
+
+    void BufTableSparseTotalStats(const uint64_t dmabuf_total_size) override {
+        printf("\"TOTAL\",,%" PRIu64 "\n", dmabuf_total_size);
+    }
+
     // Per Process
     void PerProcessHeader(const std::string& process, const pid_t pid) override {
         printf("\t%s:%d\n", process.c_str(), pid);
@@ -181,6 +217,32 @@ class RawOutput final : public DmabufOutputHelper {
         printf("%19" PRIu64 " kB |", pid_size);
     }
 
+    // Sparse table buffer x process
+    void BufTableSparseHeader() override {
+        printf("    Dmabuf Inode |            Size | %22s | %16s\n", "Process:PID", "Fd(Map) Refs");
+    }
+
+    void BufTableSparseCell(const android::dmabufinfo::DmaBuffer& buf, const pid_t pid,
+                            const std::string& process, int pid_fdrefs,
+                            int pid_maprefs) override {
+        printf("%16ju |%13" PRIu64 " kB | %16s:%-5d | %9d(%6d)\n",
+               static_cast<uintmax_t>(buf.inode()), buf.size() / 1024, process.c_str(), pid,
+               pid_fdrefs, pid_maprefs);
+    }
+
+    void BufTableSparseTotalHeader() override {
+        printf("%22s | %16s\n", "Process:PID", "Size");
+    }
+
+    void BufTableSparseTotalProcessStats(const pid_t pid, const std::string& process,
+                                         const uint64_t pid_size) override {
+        printf("%16s:%-5d | %13" PRIu64 " kB\n", process.c_str(), pid, pid_size);
+    }
+
+    void BufTableSparseTotalStats(const uint64_t dmabuf_total_size) override {
+        printf("%22s | %13" PRIu64 " kB\n", "TOTALS", dmabuf_total_size);
+    }
+
     // PerProcess
     void PerProcessHeader(const std::string& process, const pid_t pid) override {
         printf("%16s:%-5d\n", process.c_str(), pid);
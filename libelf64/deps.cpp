@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <libelf64/deps.h>
+#include <libelf64/parse.h>
+
+#include <elf.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace elf64 {
+
+// Only the ELF64 shared objects are parsed, which are the libraries and the position
+// independent executables. The other files of the partitions are not read past the header.
+static bool IsElf64SharedObject(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    Elf64_Ehdr ehdr;
+    if (!stream.read((char*)&ehdr, sizeof(ehdr))) {
+        return false;
+    }
+    return memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 && ehdr.e_ident[EI_CLASS] == ELFCLASS64 &&
+           ehdr.e_type == ET_DYN;
+}
+
+// Parses the library at 'path' on the device, read from 'file'.
+static bool ParseLibrary(const std::string& file, const std::string& path, Elf64Library* lib) {
+    Elf64Binary elf64Binary;
+    if (!Elf64Parser::ParseElfFile(file, elf64Binary)) {
+        return false;
+    }
+
+    lib->path = path;
+    for (const Elf64_Phdr& phdr : elf64Binary.phdrs) {
+        if (phdr.p_type == PT_LOAD) {
+            lib->file_size += phdr.p_filesz;
+            lib->mem_size += phdr.p_memsz;
+        }
+    }
+
+    std::vector<Elf64_Dyn> dynEntries;
+    elf64Binary.AppendDynamicEntries(&dynEntries);
+    std::string runpath;
+    std::string rpath;
+    for (const Elf64_Dyn& dynEntry : dynEntries) {
+        switch (dynEntry.d_tag) {
+            case DT_NEEDED:
+                lib->needed.push_back(elf64Binary.GetStrFromDynStrTable(dynEntry.d_un.d_val));
+                break;
+            case DT_RUNPATH:
+                runpath = elf64Binary.GetStrFromDynStrTable(dynEntry.d_un.d_val);
+                break;
+            case DT_RPATH:
+                rpath = elf64Binary.GetStrFromDynStrTable(dynEntry.d_un.d_val);
+                break;
+        }
+    }
+
+    // The linker ignores DT_RPATH when there is a DT_RUNPATH.
+    if (runpath.empty()) {
+        runpath = rpath;
+    }
+    std::string origin = std::filesystem::path(path).parent_path();
+    for (const std::string& dir : ::android::base::Split(runpath, ":")) {
+        if (!dir.empty()) {
+            lib->runpath.push_back(::android::base::StringReplace(dir, "$ORIGIN", origin, true));
+        }
+    }
+    return true;
+}
+
+// Returns the lib64 directory of the partition or APEX that 'path' is in, e.g.
+// /vendor/lib64 for /vendor/lib64/hw/foo.so and /apex/com.android.art/lib64 for
+// /apex/com.android.art/lib64/libart.so.
+static std::string PartitionLibDir(const std::string& path) {
+    std::vector<std::string> parts = ::android::base::Split(path, "/");
+    // The path is absolute, so the first part is empty.
+    if (parts.size() < 3) {
+        return "";
+    }
+    if (parts[1] == "apex") {
+        return parts.size() < 4 ? "" : "/apex/" + parts[2] + "/lib64";
+    }
+    return "/" + parts[1] + "/lib64";
+}
+
+Elf64DepGraph::Elf64DepGraph(const std::vector<std::string>& default_lib_paths,
+                             const std::string& root)
+    : default_lib_paths_(default_lib_paths) {
+    if (!root.empty()) {
+        root_ = std::filesystem::weakly_canonical(root).string();
+        // The device paths are appended to 'root_', which is then empty for "/".
+        if (root_.ends_with('/')) {
+            root_.pop_back();
+        }
+    }
+}
+
+int Elf64DepGraph::Scan(const std::vector<std::string>& roots, size_t nr_threads) {
+    // Files to parse, under 'root_'.
+    std::vector<std::string> files;
+    for (const std::string& root : roots) {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(
+                root_ + root, std::filesystem::directory_options::skip_permission_denied, ec);
+        if (ec) {
+            LOG(ERROR) << "Failed to open " << root << ": " << ec.message();
+            continue;
+        }
+        for (; it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) {
+                LOG(ERROR) << "Failed to scan " << root << ": " << ec.message();
+                break;
+            }
+            const std::filesystem::directory_entry& entry = *it;
+            if (entry.is_symlink(ec)) {
+                continue;
+            }
+            if (entry.is_directory(ec)) {
+                if (entry.path().filename().string().find('@') != std::string::npos) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+            if (entry.is_regular_file(ec)) {
+                files.emplace_back(entry.path());
+            }
+        }
+    }
+
+    if (nr_threads == 0) {
+        nr_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nr_threads = std::min(nr_threads, std::max<size_t>(files.size(), 1));
+
+    // Each thread takes the next file to parse, and the parsed libraries are added to the
+    // graph once all threads are done.
+    std::vector<Elf64Library> parsed(files.size());
+    // Not a vector<bool>, the threads write to their elements concurrently.
+    std::vector<char> ok(files.size());
+    std::atomic<size_t> next = 0;
+    auto parse = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            ok[i] = IsElf64SharedObject(files[i]) &&
+                    ParseLibrary(files[i], files[i].substr(root_.size()), &parsed[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nr_threads; i++) {
+        threads.emplace_back(parse);
+    }
+    parse();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int nr_added = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (ok[i] && libs_.emplace(parsed[i].path, std::move(parsed[i])).second) {
+            nr_added++;
+        }
+    }
+    return nr_added;
+}
+
+const Elf64Library* Elf64DepGraph::FindPath(const std::string& path) const {
+    auto it = libs_.find(path);
+    if (it != libs_.end()) {
+        return &it->second;
+    }
+
+    // The scan skips symbolic links, e.g. /system/lib64/libc.so that links to the runtime
+    // APEX, so a link is looked up by its target.
+    std::error_code ec;
+    std::string real = std::filesystem::canonical(root_ + path, ec).string();
+    if (ec || !real.starts_with(root_ + "/")) {
+        return nullptr;
+    }
+    it = libs_.find(real.substr(root_.size()));
+    return it == libs_.end() ? nullptr : &it->second;
+}
+
+const Elf64Library* Elf64DepGraph::Find(const std::string& name) const {
+    if (name.starts_with("/")) {
+        return FindPath(name);
+    }
+    for (const std::string& dir : default_lib_paths_) {
+        if (const Elf64Library* lib = FindPath(dir + "/" + name)) {
+            return lib;
+        }
+    }
+    return nullptr;
+}
+
+const Elf64Library* Elf64DepGraph::Resolve(const std::string& soname,
+                                           const Elf64Library& from) const {
+    if (soname.find('/') != std::string::npos) {
+        return FindPath(soname);
+    }
+
+    for (const std::string& dir : from.runpath) {
+        if (const Elf64Library* lib = FindPath(dir + "/" + soname)) {
+            return lib;
+        }
+    }
+    std::string partition_dir = PartitionLibDir(from.path);
+    if (!partition_dir.empty()) {
+        if (const Elf64Library* lib = FindPath(partition_dir + "/" + soname)) {
+            return lib;
+        }
+    }
+    return Find(soname);
+}
+
+void Elf64DepGraph::AddClosure(const Elf64Library* root,
+                               std::unordered_set<const Elf64Library*>* visited,
+                               Elf64LoadCost* cost) const {
+    if (!visited->insert(root).second) {
+        return;
+    }
+
+    // Breadth first, which is the order the linker loads the libraries in.
+    std::deque<const Elf64Library*> queue = {root};
+    while (!queue.empty()) {
+        const Elf64Library* lib = queue.front();
+        queue.pop_front();
+
+        cost->paths.push_back(lib->path);
+        cost->file_size += lib->file_size;
+        cost->mem_size += lib->mem_size;
+
+        for (const std::string& soname : lib->needed) {
+            const Elf64Library* dep = Resolve(soname, *lib);
+            if (!dep) {
+                if (std::find(cost->missing.begin(), cost->missing.end(), soname) ==
+                    cost->missing.end()) {
+                    cost->missing.push_back(soname);
+                }
+                continue;
+            }
+            if (visited->insert(dep).second) {
+                queue.push_back(dep);
+            }
+        }
+    }
+}
+
+bool Elf64DepGraph::LoadClosure(const std::string& name, Elf64LoadCost* cost) const {
+    return IncrementalLoadCost(name, {}, cost);
+}
+
+bool Elf64DepGraph::IncrementalLoadCost(const std::string& name,
+                                        const std::vector<std::string>& loaded,
+                                        Elf64LoadCost* cost) const {
+    *cost = {};
+    const Elf64Library* root = Find(name);
+    if (!root) {
+        LOG(ERROR) << "Library " << name << " not found";
+        return false;
+    }
+
+    std::unordered_set<const Elf64Library*> visited;
+    Elf64LoadCost loaded_cost;
+    for (const std::string& loaded_name : loaded) {
+        const Elf64Library* lib = Find(loaded_name);
+        if (!lib) {
+            LOG(WARNING) << "Loaded library " << loaded_name << " not found";
+            continue;
+        }
+        AddClosure(lib, &visited, &loaded_cost);
+    }
+
+    AddClosure(root, &visited, cost);
+    return true;
+}
+
+}  // namespace elf64
+}  // namespace android
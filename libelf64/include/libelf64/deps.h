@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace elf64 {
+
+// A shared library or position independent executable in the dependency graph.
+struct Elf64Library {
+    std::string path;
+    // DT_NEEDED entries, in the order the linker loads them.
+    std::vector<std::string> needed;
+    // DT_RUNPATH, or DT_RPATH if there is no DT_RUNPATH, with $ORIGIN expanded.
+    std::vector<std::string> runpath;
+    // Sums of p_filesz and p_memsz of the PT_LOAD segments, i.e. the bytes mapped from
+    // the file and the bytes of address space including .bss.
+    uint64_t file_size = 0;
+    uint64_t mem_size = 0;
+};
+
+// A set of libraries loaded together and their summed sizes.
+struct Elf64LoadCost {
+    // Paths of the libraries, in breadth first order from the root library.
+    std::vector<std::string> paths;
+    uint64_t file_size = 0;
+    uint64_t mem_size = 0;
+    // DT_NEEDED entries that didn't resolve to a scanned library.
+    std::vector<std::string> missing;
+};
+
+// Usage example:
+//
+//       android::elf64::Elf64DepGraph graph;
+//       graph.Scan();
+//       android::elf64::Elf64LoadCost cost;
+//       // Cost of loading libfoo.so into a process that already loaded libandroid_runtime.so.
+//       graph.IncrementalLoadCost("libfoo.so", {"libandroid_runtime.so"}, &cost);
+//
+class Elf64DepGraph {
+    // Graph of the DT_NEEDED entries of the ELF64 libraries and executables on the device.
+    // A DT_NEEDED entry is resolved like the dynamic linker does, in simplified form: the
+    // DT_RUNPATH of the library first, then the lib64 directory of the partition or APEX
+    // the library is in, then the default library paths. Linker namespaces are not
+    // modelled, so a library may resolve to one that it isn't allowed to load on device.
+  public:
+    // All paths are paths on the device. They are read from under 'root' if it is not
+    // empty, e.g. from the images of a build mounted or unpacked on a host. Symbolic links
+    // are then only followed if they stay under 'root'.
+    explicit Elf64DepGraph(const std::vector<std::string>& default_lib_paths = {"/system/lib64"},
+                           const std::string& root = "");
+
+    // Parses the ELF64 libraries and executables under 'roots' on 'nr_threads' threads, one
+    // per cpu if 0, and adds them to the graph. Symbolic links and the versioned mount
+    // points of APEXes, e.g. /apex/com.android.art@340000000, are skipped so that no
+    // library is counted twice. Returns the number of files added.
+    int Scan(const std::vector<std::string>& roots = {"/system", "/vendor", "/apex"},
+             size_t nr_threads = 0);
+
+    // Returns the library at 'name' if it is a path, or else the library that the soname
+    // 'name' resolves to from the default library paths. Returns nullptr if not found.
+    const Elf64Library* Find(const std::string& name) const;
+    // Returns the library that the DT_NEEDED entry 'soname' of 'from' resolves to, or
+    // nullptr if not found.
+    const Elf64Library* Resolve(const std::string& soname, const Elf64Library& from) const;
+
+    // Fills 'cost' with the transitive DT_NEEDED closure of 'name', including itself.
+    // Returns false if 'name' is not found.
+    bool LoadClosure(const std::string& name, Elf64LoadCost* cost) const;
+    // Same as above, but without the libraries in the closure of 'loaded', e.g. the
+    // libraries the zygote preloads. This is what loading 'name' adds to such a process.
+    bool IncrementalLoadCost(const std::string& name, const std::vector<std::string>& loaded,
+                             Elf64LoadCost* cost) const;
+
+    const std::unordered_map<std::string, Elf64Library>& libraries() const { return libs_; }
+
+  private:
+    const Elf64Library* FindPath(const std::string& path) const;
+    // Adds the libraries reachable from 'root' that are not in 'visited' yet to 'cost'.
+    void AddClosure(const Elf64Library* root, std::unordered_set<const Elf64Library*>* visited,
+                    Elf64LoadCost* cost) const;
+
+    std::vector<std::string> default_lib_paths_;
+    std::string root_;
+    // Libraries by path.
+    std::unordered_map<std::string, Elf64Library> libs_;
+};
+
+}  // namespace elf64
+}  // namespace android
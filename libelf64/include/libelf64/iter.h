@@ -18,7 +18,9 @@
 
 #include <libelf64/parse.h>
 
+#include <filesystem>
 #include <functional>
+#include <string>
 
 namespace android {
 namespace elf64 {
@@ -31,5 +33,29 @@ using Elf64Callback = std::function<void(const Elf64Binary&)>;
  */
 int ForEachElf64FromDir(const std::string& path, const Elf64Callback& callback);
 
+/**
+ * Same as above, with a callback that can be inlined, e.g. a lambda.
+ */
+template <typename F>
+int ForEachElf64FromDir(const std::string& path, F&& callback) {
+    int nr_parsed = 0;
+
+    for (const std::filesystem::directory_entry& dir_entry :
+         std::filesystem::recursive_directory_iterator(path)) {
+        if (dir_entry.is_symlink() || !dir_entry.is_regular_file()) continue;
+
+        std::string name = dir_entry.path();
+        Elf64Binary elf64Binary;
+        if (!Elf64Parser::ParseElfFile(name, elf64Binary)) {
+            continue;
+        }
+        nr_parsed++;
+
+        callback(elf64Binary);
+    }
+
+    return nr_parsed;
+}
+
 }  // namespace elf64
 }  // namespace android
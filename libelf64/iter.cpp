@@ -16,32 +16,11 @@
 #include <libelf64/iter.h>
 #include <libelf64/parse.h>
 
-#include <filesystem>
-
 namespace android {
 namespace elf64 {
 
 int ForEachElf64FromDir(const std::string& path, const Elf64Callback& callback) {
-    int nr_parsed = 0;
-
-    for (const std::filesystem::directory_entry& dir_entry :
-        std::filesystem::recursive_directory_iterator(path)) {
-
-        if (dir_entry.is_symlink() || !dir_entry.is_regular_file())
-            continue;
-
-        std::string name = dir_entry.path();
-        android::elf64::Elf64Binary elf64Binary;
-        if (Elf64Parser::ParseElfFile(name, elf64Binary)) {
-            nr_parsed++;
-        } else {
-            continue;
-        }
-
-        callback(elf64Binary);
-    }
-
-    return nr_parsed;
+    return ForEachElf64FromDir<const Elf64Callback&>(path, callback);
 }
 
 }  // namespace elf64
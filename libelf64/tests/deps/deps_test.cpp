@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <string.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <libelf64/deps.h>
+#include <libelf64/elf64.h>
+#include <libelf64/elf64_writer.h>
+
+using namespace android::elf64;
+
+// Writes a minimal ELF64 shared object with two PT_LOAD segments of 'file_size' and
+// 'mem_size' bytes in total, and a .dynamic section with the given entries.
+static void WriteLibrary(const std::string& file, const std::vector<std::string>& needed,
+                         uint64_t file_size, uint64_t mem_size, const std::string& runpath = "",
+                         const std::string& rpath = "") {
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path());
+
+    Elf64Binary elf64Binary = {};
+    Elf64_Ehdr& ehdr = elf64Binary.ehdr;
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_DYN;
+    ehdr.e_machine = EM_AARCH64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+
+    auto add_phdr = [&elf64Binary](Elf64_Word type, Elf64_Xword filesz, Elf64_Xword memsz) {
+        Elf64_Phdr phdr = {};
+        phdr.p_type = type;
+        phdr.p_filesz = filesz;
+        phdr.p_memsz = memsz;
+        elf64Binary.phdrs.push_back(phdr);
+    };
+    add_phdr(PT_LOAD, file_size / 2, file_size / 2);
+    add_phdr(PT_LOAD, file_size - file_size / 2, mem_size - file_size / 2);
+    // Not counted in the sizes of the library.
+    add_phdr(PT_DYNAMIC, 0x1000, 0x1000);
+    ehdr.e_phnum = elf64Binary.phdrs.size();
+
+    std::vector<char> dynstr(1, '\0');
+    auto add_str = [&dynstr](const std::string& str) {
+        Elf64_Xword offset = dynstr.size();
+        dynstr.insert(dynstr.end(), str.begin(), str.end());
+        dynstr.push_back('\0');
+        return offset;
+    };
+    std::vector<Elf64_Dyn> dyns;
+    for (const std::string& soname : needed) {
+        dyns.push_back({DT_NEEDED, {add_str(soname)}});
+    }
+    if (!runpath.empty()) {
+        dyns.push_back({DT_RUNPATH, {add_str(runpath)}});
+    }
+    if (!rpath.empty()) {
+        dyns.push_back({DT_RPATH, {add_str(rpath)}});
+    }
+    dyns.push_back({DT_NULL, {0}});
+    std::vector<char> dynamic_data(dyns.size() * sizeof(Elf64_Dyn));
+    memcpy(dynamic_data.data(), dyns.data(), dynamic_data.size());
+
+    const char shstrtab[] = "\0.dynstr\0.dynamic\0.shstrtab";
+    std::vector<char> shstrtab_data(shstrtab, shstrtab + sizeof(shstrtab));
+
+    // The null section, then .dynstr, .dynamic and .shstrtab, laid out after the program
+    // headers, followed by the section headers.
+    struct {
+        const char* name;
+        uint32_t type;
+        std::vector<char> data;
+    } sections[] = {
+            {"", SHT_NULL, {}},
+            {".dynstr", SHT_STRTAB, dynstr},
+            {".dynamic", SHT_DYNAMIC, dynamic_data},
+            {".shstrtab", SHT_STRTAB, shstrtab_data},
+    };
+    Elf64_Off offset = ehdr.e_phoff + ehdr.e_phnum * sizeof(Elf64_Phdr);
+    for (size_t i = 0; i < std::size(sections); i++) {
+        Elf64_Shdr shdr = {};
+        shdr.sh_name = std::string_view(shstrtab, sizeof(shstrtab)).find(sections[i].name);
+        shdr.sh_type = sections[i].type;
+        shdr.sh_offset = offset;
+        shdr.sh_size = sections[i].data.size();
+        if (sections[i].type == SHT_DYNAMIC) {
+            shdr.sh_link = 1;
+            shdr.sh_entsize = sizeof(Elf64_Dyn);
+        }
+        offset += shdr.sh_size;
+        elf64Binary.shdrs.push_back(shdr);
+        elf64Binary.sections.push_back(
+                {sections[i].data, shdr.sh_size, sections[i].name, static_cast<uint16_t>(i)});
+    }
+    ehdr.e_shoff = offset;
+    ehdr.e_shnum = elf64Binary.shdrs.size();
+    ehdr.e_shstrndx = 3;
+
+    Elf64Writer::WriteElf64File(elf64Binary, file);
+}
+
+class Elf64DepGraphTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        root_ = tmp_dir_.path;
+        Write("/apex/com.android.runtime/lib64/bionic/libc.so", {}, 0x1000, 0x2000);
+        // A versioned mount point of the same APEX, and a link to its libc.so like on device.
+        Write("/apex/com.android.runtime@1/lib64/bionic/libc.so", {}, 0x1000, 0x2000);
+        std::filesystem::create_directories(root_ + "/system/lib64");
+        std::filesystem::create_symlink("../../apex/com.android.runtime/lib64/bionic/libc.so",
+                                        root_ + "/system/lib64/libc.so");
+
+        Write("/system/lib64/libbase.so", {"libc.so"}, 0x3000, 0x3000);
+        Write("/system/lib64/libutils.so", {"libbase.so", "libc.so"}, 0x4000, 0x5000);
+        Write("/system/lib64/libfoo.so", {"libutils.so", "libbar.so", "libmissing.so"}, 0x6000,
+              0x6000, "$ORIGIN/foo");
+        Write("/system/lib64/foo/libbar.so", {"libc.so"}, 0x7000, 0x8000);
+        Write("/system/lib64/libbar.so", {}, 0x9000, 0x9000);
+
+        Write("/vendor/lib64/libutils.so", {"libc.so"}, 0xa000, 0xa000);
+        Write("/vendor/lib64/libvnd.so", {"libutils.so"}, 0xb000, 0xb000);
+        Write("/vendor/lib64/librpath.so", {"libbar.so"}, 0xc000, 0xc000, "",
+              "/vendor/lib64/none:$ORIGIN/rpath");
+        Write("/vendor/lib64/rpath/libbar.so", {}, 0xd000, 0xd000);
+        // DT_RPATH is ignored when there is a DT_RUNPATH.
+        Write("/vendor/lib64/librunpath.so", {"libbar.so"}, 0xe000, 0xe000, "/system/lib64/foo",
+              "$ORIGIN/rpath");
+
+        std::filesystem::create_directories(root_ + "/system/etc");
+        ASSERT_TRUE(android::base::WriteStringToFile("not an elf", root_ + "/system/etc/hosts"));
+        ASSERT_EQ(graph_.Scan({"/system", "/vendor", "/apex"}, 2), 11);
+    }
+
+    void Write(const std::string& path, const std::vector<std::string>& needed,
+               uint64_t file_size, uint64_t mem_size, const std::string& runpath = "",
+               const std::string& rpath = "") {
+        WriteLibrary(root_ + path, needed, file_size, mem_size, runpath, rpath);
+    }
+
+    const Elf64Library& Get(const std::string& path) { return graph_.libraries().at(path); }
+
+    std::string Resolve(const std::string& soname, const std::string& from) {
+        const Elf64Library* lib = graph_.Resolve(soname, Get(from));
+        return lib ? lib->path : "";
+    }
+
+    TemporaryDir tmp_dir_;
+    std::string root_;
+    Elf64DepGraph graph_{{"/system/lib64"}, tmp_dir_.path};
+};
+
+TEST_F(Elf64DepGraphTest, ScanTest) {
+    EXPECT_EQ(graph_.libraries().count("/system/lib64/libc.so"), 0);
+    EXPECT_EQ(graph_.libraries().count("/apex/com.android.runtime@1/lib64/bionic/libc.so"), 0);
+
+    const Elf64Library& foo = Get("/system/lib64/libfoo.so");
+    EXPECT_EQ(foo.needed, std::vector<std::string>({"libutils.so", "libbar.so", "libmissing.so"}));
+    EXPECT_EQ(foo.runpath, std::vector<std::string>({"/system/lib64/foo"}));
+    EXPECT_EQ(foo.file_size, 0x6000);
+    EXPECT_EQ(foo.mem_size, 0x6000);
+
+    const Elf64Library& utils = Get("/system/lib64/libutils.so");
+    EXPECT_EQ(utils.file_size, 0x4000);
+    EXPECT_EQ(utils.mem_size, 0x5000);
+
+    EXPECT_EQ(Get("/vendor/lib64/librpath.so").runpath,
+              std::vector<std::string>({"/vendor/lib64/none", "/vendor/lib64/rpath"}));
+    EXPECT_EQ(Get("/vendor/lib64/librunpath.so").runpath,
+              std::vector<std::string>({"/system/lib64/foo"}));
+}
+
+TEST_F(Elf64DepGraphTest, FindTest) {
+    // Links are looked up by their target.
+    const Elf64Library* libc = graph_.Find("libc.so");
+    ASSERT_NE(libc, nullptr);
+    EXPECT_EQ(libc->path, "/apex/com.android.runtime/lib64/bionic/libc.so");
+    EXPECT_EQ(graph_.Find("/system/lib64/libc.so"), libc);
+
+    ASSERT_NE(graph_.Find("libutils.so"), nullptr);
+    EXPECT_EQ(graph_.Find("libutils.so")->path, "/system/lib64/libutils.so");
+    EXPECT_EQ(graph_.Find("libvnd.so"), nullptr);
+    EXPECT_EQ(graph_.Find("/system/lib64/libmissing.so"), nullptr);
+}
+
+TEST_F(Elf64DepGraphTest, ResolveTest) {
+    // The DT_RUNPATH first, then the directory of the partition, then the default paths.
+    EXPECT_EQ(Resolve("libbar.so", "/system/lib64/libfoo.so"), "/system/lib64/foo/libbar.so");
+    EXPECT_EQ(Resolve("libutils.so", "/system/lib64/libfoo.so"), "/system/lib64/libutils.so");
+    EXPECT_EQ(Resolve("libutils.so", "/vendor/lib64/libvnd.so"), "/vendor/lib64/libutils.so");
+    EXPECT_EQ(Resolve("libc.so", "/vendor/lib64/libutils.so"),
+              "/apex/com.android.runtime/lib64/bionic/libc.so");
+    EXPECT_EQ(Resolve("libbar.so", "/vendor/lib64/librpath.so"), "/vendor/lib64/rpath/libbar.so");
+    EXPECT_EQ(Resolve("libbar.so", "/vendor/lib64/librunpath.so"), "/system/lib64/foo/libbar.so");
+    EXPECT_EQ(Resolve("/system/lib64/libbar.so", "/vendor/lib64/librunpath.so"),
+              "/system/lib64/libbar.so");
+    EXPECT_EQ(Resolve("libmissing.so", "/system/lib64/libfoo.so"), "");
+}
+
+TEST_F(Elf64DepGraphTest, LoadClosureTest) {
+    Elf64LoadCost cost;
+    ASSERT_TRUE(graph_.LoadClosure("libfoo.so", &cost));
+    EXPECT_EQ(cost.paths, std::vector<std::string>({
+                                  "/system/lib64/libfoo.so",
+                                  "/system/lib64/libutils.so",
+                                  "/system/lib64/foo/libbar.so",
+                                  "/system/lib64/libbase.so",
+                                  "/apex/com.android.runtime/lib64/bionic/libc.so",
+                          }));
+    EXPECT_EQ(cost.file_size, 0x6000 + 0x4000 + 0x7000 + 0x3000 + 0x1000);
+    EXPECT_EQ(cost.mem_size, 0x6000 + 0x5000 + 0x8000 + 0x3000 + 0x2000);
+    EXPECT_EQ(cost.missing, std::vector<std::string>({"libmissing.so"}));
+
+    ASSERT_TRUE(graph_.LoadClosure("/vendor/lib64/libvnd.so", &cost));
+    EXPECT_EQ(cost.paths, std::vector<std::string>({
+                                  "/vendor/lib64/libvnd.so",
+                                  "/vendor/lib64/libutils.so",
+                                  "/apex/com.android.runtime/lib64/bionic/libc.so",
+                          }));
+    EXPECT_TRUE(cost.missing.empty());
+
+    EXPECT_FALSE(graph_.LoadClosure("libnone.so", &cost));
+    EXPECT_TRUE(cost.paths.empty());
+}
+
+TEST_F(Elf64DepGraphTest, IncrementalLoadCostTest) {
+    Elf64LoadCost cost;
+    ASSERT_TRUE(graph_.IncrementalLoadCost("libfoo.so", {"libutils.so"}, &cost));
+    EXPECT_EQ(cost.paths, std::vector<std::string>({
+                                  "/system/lib64/libfoo.so",
+                                  "/system/lib64/foo/libbar.so",
+                          }));
+    EXPECT_EQ(cost.file_size, 0x6000 + 0x7000);
+    EXPECT_EQ(cost.mem_size, 0x6000 + 0x8000);
+    EXPECT_EQ(cost.missing, std::vector<std::string>({"libmissing.so"}));
+
+    // Nothing is added if the library is already loaded, and missing libraries are ignored.
+    ASSERT_TRUE(graph_.IncrementalLoadCost("libbase.so", {"libutils.so", "libnone.so"}, &cost));
+    EXPECT_TRUE(cost.paths.empty());
+    EXPECT_EQ(cost.file_size, 0);
+    EXPECT_EQ(cost.mem_size, 0);
+}
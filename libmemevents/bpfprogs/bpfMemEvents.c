@@ -108,5 +108,95 @@ DEFINE_BPF_PROG("tracepoint/vmscan/mm_vmscan_kswapd_sleep/lmkd", AID_ROOT, AID_S
     return 0;
 }
 
+/*
+ * Start time of the compaction run by each task, so that the end event carries its
+ * duration. A task compacts one zone at a time.
+ */
+DEFINE_BPF_MAP(lmkd_compaction_start_ns, HASH, uint32_t, uint64_t, 1024)
+
+DEFINE_BPF_PROG("tracepoint/compaction/mm_compaction_begin/lmkd", AID_ROOT, AID_SYSTEM,
+                tp_lmkd_compaction_begin)
+(struct compaction_begin_args* args) {
+    uint32_t pid = bpf_get_current_pid_tgid();
+    uint64_t timestamp_ns = bpf_ktime_get_ns();
+    bpf_lmkd_compaction_start_ns_update_elem(&pid, &timestamp_ns, BPF_ANY);
+
+    struct mem_event_t* data = bpf_lmkd_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_COMPACTION_BEGIN;
+    data->event_data.compaction_begin.pid = pid;
+    data->event_data.compaction_begin.sync = args->sync;
+
+    bpf_lmkd_rb_submit(data);
+
+    return 0;
+}
+
+DEFINE_BPF_PROG("tracepoint/compaction/mm_compaction_end/lmkd", AID_ROOT, AID_SYSTEM,
+                tp_lmkd_compaction_end)
+(struct compaction_end_args* args) {
+    uint32_t pid = bpf_get_current_pid_tgid();
+    uint64_t duration_us = 0;
+    uint64_t* start_ns = bpf_lmkd_compaction_start_ns_lookup_elem(&pid);
+    if (start_ns) {
+        duration_us = (bpf_ktime_get_ns() - *start_ns) / 1000;  // Convert to microseconds
+        bpf_lmkd_compaction_start_ns_delete_elem(&pid);
+    }
+
+    struct mem_event_t* data = bpf_lmkd_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_COMPACTION_END;
+    data->event_data.compaction_end.pid = pid;
+    data->event_data.compaction_end.sync = args->sync;
+    data->event_data.compaction_end.result = args->status;
+    data->event_data.compaction_end.duration_us = duration_us;
+
+    bpf_lmkd_rb_submit(data);
+
+    return 0;
+}
+
+DEFINE_BPF_PROG("tracepoint/kmem/mm_page_alloc_extfrag/lmkd", AID_ROOT, AID_SYSTEM,
+                tp_lmkd_extfrag)
+(struct page_alloc_extfrag_args* args) {
+    struct mem_event_t* data = bpf_lmkd_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_EXTFRAG;
+    data->event_data.extfrag.alloc_order = args->alloc_order;
+    data->event_data.extfrag.fallback_order = args->fallback_order;
+    data->event_data.extfrag.alloc_migratetype = args->alloc_migratetype;
+    data->event_data.extfrag.fallback_migratetype = args->fallback_migratetype;
+    data->event_data.extfrag.change_ownership = args->change_ownership;
+
+    bpf_lmkd_rb_submit(data);
+
+    return 0;
+}
+
+/*
+ * mm_page_alloc fires for every allocation, only failed high-order allocations are
+ * reported, before reserving any space in the ring buffer.
+ */
+DEFINE_BPF_PROG("tracepoint/kmem/mm_page_alloc/lmkd", AID_ROOT, AID_SYSTEM, tp_lmkd_page_alloc)
+(struct page_alloc_args* args) {
+    if (args->pfn != MEM_EVENT_PAGE_ALLOC_FAILED_PFN || args->order == 0) return 0;
+
+    struct mem_event_t* data = bpf_lmkd_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_ALLOC_FAILURE;
+    data->event_data.alloc_failure.pid = bpf_get_current_pid_tgid();
+    data->event_data.alloc_failure.order = args->order;
+    data->event_data.alloc_failure.migratetype = args->migratetype;
+    data->event_data.alloc_failure.gfp_flags = args->gfp_flags;
+
+    bpf_lmkd_rb_submit(data);
+
+    return 0;
+}
+
 // bpf_probe_read_str is GPL only symbol
 LICENSE("GPL");
@@ -138,5 +138,84 @@ DEFINE_BPF_PROG_KVER("skfilter/kswapd_sleep", AID_ROOT, AID_ROOT, tp_memevents_t
     return 0;
 }
 
+DEFINE_BPF_PROG_KVER("skfilter/compaction_begin", AID_ROOT, AID_ROOT,
+                     tp_memevents_test_compaction_begin, KVER(5, 8, 0))
+(void* __unused ctx) {
+    struct mem_event_t* data = bpf_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_COMPACTION_BEGIN;
+    data->event_data.compaction_begin.pid =
+            mocked_compaction_begin_event.event_data.compaction_begin.pid;
+    data->event_data.compaction_begin.sync =
+            mocked_compaction_begin_event.event_data.compaction_begin.sync;
+
+    bpf_rb_submit(data);
+
+    return 0;
+}
+
+DEFINE_BPF_PROG_KVER("skfilter/compaction_end", AID_ROOT, AID_ROOT,
+                     tp_memevents_test_compaction_end, KVER(5, 8, 0))
+(void* __unused ctx) {
+    struct mem_event_t* data = bpf_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_COMPACTION_END;
+    data->event_data.compaction_end.pid = mocked_compaction_end_event.event_data.compaction_end.pid;
+    data->event_data.compaction_end.sync =
+            mocked_compaction_end_event.event_data.compaction_end.sync;
+    data->event_data.compaction_end.result =
+            mocked_compaction_end_event.event_data.compaction_end.result;
+    data->event_data.compaction_end.duration_us =
+            mocked_compaction_end_event.event_data.compaction_end.duration_us;
+
+    bpf_rb_submit(data);
+
+    return 0;
+}
+
+DEFINE_BPF_PROG_KVER("skfilter/extfrag", AID_ROOT, AID_ROOT, tp_memevents_test_extfrag,
+                     KVER(5, 8, 0))
+(void* __unused ctx) {
+    struct mem_event_t* data = bpf_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_EXTFRAG;
+    data->event_data.extfrag.alloc_order = mocked_extfrag_event.event_data.extfrag.alloc_order;
+    data->event_data.extfrag.fallback_order =
+            mocked_extfrag_event.event_data.extfrag.fallback_order;
+    data->event_data.extfrag.alloc_migratetype =
+            mocked_extfrag_event.event_data.extfrag.alloc_migratetype;
+    data->event_data.extfrag.fallback_migratetype =
+            mocked_extfrag_event.event_data.extfrag.fallback_migratetype;
+    data->event_data.extfrag.change_ownership =
+            mocked_extfrag_event.event_data.extfrag.change_ownership;
+
+    bpf_rb_submit(data);
+
+    return 0;
+}
+
+DEFINE_BPF_PROG_KVER("skfilter/alloc_failure", AID_ROOT, AID_ROOT, tp_memevents_test_alloc_failure,
+                     KVER(5, 8, 0))
+(void* __unused ctx) {
+    struct mem_event_t* data = bpf_rb_reserve();
+    if (data == NULL) return 1;
+
+    data->type = MEM_EVENT_ALLOC_FAILURE;
+    data->event_data.alloc_failure.pid = mocked_alloc_failure_event.event_data.alloc_failure.pid;
+    data->event_data.alloc_failure.order =
+            mocked_alloc_failure_event.event_data.alloc_failure.order;
+    data->event_data.alloc_failure.migratetype =
+            mocked_alloc_failure_event.event_data.alloc_failure.migratetype;
+    data->event_data.alloc_failure.gfp_flags =
+            mocked_alloc_failure_event.event_data.alloc_failure.gfp_flags;
+
+    bpf_rb_submit(data);
+
+    return 0;
+}
+
 // bpf_probe_read_str is GPL only symbol
 LICENSE("GPL");
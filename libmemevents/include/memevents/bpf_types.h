@@ -30,9 +30,13 @@ typedef unsigned int mem_event_type_t;
 #define MEM_EVENT_DIRECT_RECLAIM_END 2
 #define MEM_EVENT_KSWAPD_WAKE 3
 #define MEM_EVENT_KSWAPD_SLEEP 4
+#define MEM_EVENT_COMPACTION_BEGIN 5
+#define MEM_EVENT_COMPACTION_END 6
+#define MEM_EVENT_EXTFRAG 7
+#define MEM_EVENT_ALLOC_FAILURE 8
 
 // This always comes after the last valid event type
-#define NR_MEM_EVENTS 5
+#define NR_MEM_EVENTS 9
 
 /* BPF-Rb Paths */
 #define MEM_EVENTS_AMS_RB "/sys/fs/bpf/memevents/map_bpfMemEvents_ams_rb"
@@ -51,6 +55,14 @@ typedef unsigned int mem_event_type_t;
     "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_vmscan_mm_vmscan_kswapd_wake_lmkd"
 #define MEM_EVENTS_LMKD_VMSCAN_KSWAPD_SLEEP_TP \
     "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_vmscan_mm_vmscan_kswapd_sleep_lmkd"
+#define MEM_EVENTS_LMKD_COMPACTION_BEGIN_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_compaction_mm_compaction_begin_lmkd"
+#define MEM_EVENTS_LMKD_COMPACTION_END_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_compaction_mm_compaction_end_lmkd"
+#define MEM_EVENTS_LMKD_KMEM_EXTFRAG_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_kmem_mm_page_alloc_extfrag_lmkd"
+#define MEM_EVENTS_LMKD_KMEM_PAGE_ALLOC_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEvents_tracepoint_kmem_mm_page_alloc_lmkd"
 #define MEM_EVENTS_TEST_OOM_MARK_VICTIM_TP \
     "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_tracepoint_oom_mark_victim"
 
@@ -81,6 +93,39 @@ struct mem_event_t {
         struct KswapdSleep {
             uint32_t node_id;
         } kswapd_sleep;
+
+        /* Compaction of a zone, run by kcompactd or by an allocating task (direct). */
+        struct CompactionBegin {
+            uint32_t pid;
+            uint32_t sync;
+        } compaction_begin;
+
+        struct CompactionEnd {
+            uint32_t pid;
+            uint32_t sync;
+            /* enum compact_result of the kernel, e.g. COMPACT_SUCCESS */
+            int32_t result;
+            /* 0 if the begin of the compaction was missed */
+            uint64_t duration_us;
+        } compaction_end;
+
+        /* An allocation fell back to the free list of another migratetype. */
+        struct Extfrag {
+            int32_t alloc_order;
+            int32_t fallback_order;
+            int32_t alloc_migratetype;
+            int32_t fallback_migratetype;
+            /* The allocation stole the whole pageblock. */
+            uint32_t change_ownership;
+        } extfrag;
+
+        /* Failed allocation of order > 0, after reclaim and compaction. */
+        struct AllocFailure {
+            uint32_t pid;
+            uint32_t order;
+            int32_t migratetype;
+            uint64_t gfp_flags;
+        } alloc_failure;
     } event_data;
 };
 
@@ -122,4 +167,48 @@ struct kswapd_sleep_args {
     uint32_t nid;
 };
 
+struct compaction_begin_args {
+    uint64_t __ignore;
+    /* Actual fields start at offset 8 */
+    uint64_t zone_start;
+    uint64_t migrate_pfn;
+    uint64_t free_pfn;
+    uint64_t zone_end;
+    uint8_t sync;
+};
+
+struct compaction_end_args {
+    uint64_t __ignore;
+    /* Actual fields start at offset 8 */
+    uint64_t zone_start;
+    uint64_t migrate_pfn;
+    uint64_t free_pfn;
+    uint64_t zone_end;
+    uint8_t sync;
+    int32_t status;
+};
+
+struct page_alloc_extfrag_args {
+    uint64_t __ignore;
+    /* Actual fields start at offset 8 */
+    uint64_t pfn;
+    int32_t alloc_order;
+    int32_t fallback_order;
+    int32_t alloc_migratetype;
+    int32_t fallback_migratetype;
+    int32_t change_ownership;
+};
+
+struct page_alloc_args {
+    uint64_t __ignore;
+    /* Actual fields start at offset 8 */
+    uint64_t pfn;
+    uint32_t order;
+    uint64_t gfp_flags;
+    int32_t migratetype;
+};
+
+/* pfn of mm_page_alloc when the allocation failed */
+#define MEM_EVENT_PAGE_ALLOC_FAILED_PFN ((uint64_t)-1)
+
 #endif /* MEM_EVENTS_BPF_TYES_H_ */
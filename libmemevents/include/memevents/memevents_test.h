@@ -31,6 +31,13 @@
     "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_kswapd_wake"
 #define MEM_EVENTS_TEST_KSWAPD_SLEEP_TP \
     "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_kswapd_sleep"
+#define MEM_EVENTS_TEST_COMPACTION_BEGIN_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_compaction_begin"
+#define MEM_EVENTS_TEST_COMPACTION_END_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_compaction_end"
+#define MEM_EVENTS_TEST_EXTFRAG_TP "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_extfrag"
+#define MEM_EVENTS_TEST_ALLOC_FAILURE_TP \
+    "/sys/fs/bpf/memevents/prog_bpfMemEventsTest_skfilter_alloc_failure"
 
 // clang-format off
 const struct mem_event_t mocked_oom_event = {
@@ -61,6 +68,41 @@ const struct mem_event_t mocked_kswapd_sleep_event = {
      .event_data.kswapd_sleep = {
         .node_id = 3,
 }};
+
+const struct mem_event_t mocked_compaction_begin_event = {
+     .type = MEM_EVENT_COMPACTION_BEGIN,
+     .event_data.compaction_begin = {
+        .pid = 1234,
+        .sync = 1,
+}};
+
+const struct mem_event_t mocked_compaction_end_event = {
+     .type = MEM_EVENT_COMPACTION_END,
+     .event_data.compaction_end = {
+        .pid = 1234,
+        .sync = 1,
+        .result = 4,
+        .duration_us = 5678,
+}};
+
+const struct mem_event_t mocked_extfrag_event = {
+     .type = MEM_EVENT_EXTFRAG,
+     .event_data.extfrag = {
+        .alloc_order = 0,
+        .fallback_order = 9,
+        .alloc_migratetype = 0,
+        .fallback_migratetype = 1,
+        .change_ownership = 1,
+}};
+
+const struct mem_event_t mocked_alloc_failure_event = {
+     .type = MEM_EVENT_ALLOC_FAILURE,
+     .event_data.alloc_failure = {
+        .pid = 4321,
+        .order = 3,
+        .migratetype = 1,
+        .gfp_flags = 0x400cc0,
+}};
 // clang-format on
 
 #endif /* MEM_EVENTS_TEST_H_ */
\ No newline at end of file
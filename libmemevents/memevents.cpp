@@ -66,6 +66,15 @@ class MemBpfRingbuf : public BpfRingbufBase {
      * to the callback.
      */
     base::Result<int> ConsumeAll(const EventCallback& callback) {
+        return ConsumeAll<const EventCallback&>(callback);
+    }
+
+    /*
+     * Same as above, with the callback inlined into the adapter that the
+     * base ring buffer calls for each message.
+     */
+    template <typename F>
+    base::Result<int> ConsumeAll(F&& callback) {
         return BpfRingbufBase::ConsumeAll([&](const void* mem_event) {
             callback(*reinterpret_cast<const mem_event_t*>(mem_event));
         });
@@ -122,6 +131,30 @@ static const std::vector<std::vector<struct MemBpfAttachment>> attachments = {
             .tpEvent = "mm_vmscan_kswapd_sleep",
             .event_type = MEM_EVENT_KSWAPD_SLEEP
         },
+        {
+            .prog = MEM_EVENTS_LMKD_COMPACTION_BEGIN_TP,
+            .tpGroup = "compaction",
+            .tpEvent = "mm_compaction_begin",
+            .event_type = MEM_EVENT_COMPACTION_BEGIN
+        },
+        {
+            .prog = MEM_EVENTS_LMKD_COMPACTION_END_TP,
+            .tpGroup = "compaction",
+            .tpEvent = "mm_compaction_end",
+            .event_type = MEM_EVENT_COMPACTION_END
+        },
+        {
+            .prog = MEM_EVENTS_LMKD_KMEM_EXTFRAG_TP,
+            .tpGroup = "kmem",
+            .tpEvent = "mm_page_alloc_extfrag",
+            .event_type = MEM_EVENT_EXTFRAG
+        },
+        {
+            .prog = MEM_EVENTS_LMKD_KMEM_PAGE_ALLOC_TP,
+            .tpGroup = "kmem",
+            .tpEvent = "mm_page_alloc",
+            .event_type = MEM_EVENT_ALLOC_FAILURE
+        },
     },
     // MemEventsTest
     {
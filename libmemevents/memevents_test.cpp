@@ -26,6 +26,7 @@
 #include <gtest/gtest.h>
 #include <poll.h>
 #include <signal.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/sysinfo.h>
@@ -51,7 +52,9 @@ static const std::string bpfRbsPaths[MemEventClient::NR_CLIENTS] = {
 static const std::string testBpfSkfilterProgPaths[NR_MEM_EVENTS] = {
         MEM_EVENTS_TEST_OOM_KILL_TP, MEM_EVENTS_TEST_DIRECT_RECLAIM_START_TP,
         MEM_EVENTS_TEST_DIRECT_RECLAIM_END_TP, MEM_EVENTS_TEST_KSWAPD_WAKE_TP,
-        MEM_EVENTS_TEST_KSWAPD_SLEEP_TP};
+        MEM_EVENTS_TEST_KSWAPD_SLEEP_TP, MEM_EVENTS_TEST_COMPACTION_BEGIN_TP,
+        MEM_EVENTS_TEST_COMPACTION_END_TP, MEM_EVENTS_TEST_EXTFRAG_TP,
+        MEM_EVENTS_TEST_ALLOC_FAILURE_TP};
 static const std::filesystem::path sysrq_trigger_path = "proc/sysrq-trigger";
 
 static void initializeTestListener(std::unique_ptr<MemEventListener>& memevent_listener,
@@ -186,6 +189,14 @@ TEST_F(MemEventsBpfSetupTest, loaded_lmkd_progs) {
             << "Failed to find lmkd kswapd_wake bpf-program";
     ASSERT_TRUE(std::filesystem::exists(MEM_EVENTS_LMKD_VMSCAN_KSWAPD_SLEEP_TP))
             << "Failed to find lmkd kswapd_sleep bpf-program";
+    ASSERT_TRUE(std::filesystem::exists(MEM_EVENTS_LMKD_COMPACTION_BEGIN_TP))
+            << "Failed to find lmkd compaction_begin bpf-program";
+    ASSERT_TRUE(std::filesystem::exists(MEM_EVENTS_LMKD_COMPACTION_END_TP))
+            << "Failed to find lmkd compaction_end bpf-program";
+    ASSERT_TRUE(std::filesystem::exists(MEM_EVENTS_LMKD_KMEM_EXTFRAG_TP))
+            << "Failed to find lmkd mm_page_alloc_extfrag bpf-program";
+    ASSERT_TRUE(std::filesystem::exists(MEM_EVENTS_LMKD_KMEM_PAGE_ALLOC_TP))
+            << "Failed to find lmkd mm_page_alloc bpf-program";
 }
 
 /*
@@ -393,6 +404,25 @@ class MemEventsListenerBpf : public ::testing::Test {
                 android::bpf::runProgram(mProgram, &kswapd_sleep_fake_args,
                                          sizeof(kswapd_sleep_fake_args));
                 break;
+            case MEM_EVENT_COMPACTION_BEGIN:
+                struct compaction_begin_args compaction_begin_fake_args;
+                android::bpf::runProgram(mProgram, &compaction_begin_fake_args,
+                                         sizeof(compaction_begin_fake_args));
+                break;
+            case MEM_EVENT_COMPACTION_END:
+                struct compaction_end_args compaction_end_fake_args;
+                android::bpf::runProgram(mProgram, &compaction_end_fake_args,
+                                         sizeof(compaction_end_fake_args));
+                break;
+            case MEM_EVENT_EXTFRAG:
+                struct page_alloc_extfrag_args extfrag_fake_args;
+                android::bpf::runProgram(mProgram, &extfrag_fake_args, sizeof(extfrag_fake_args));
+                break;
+            case MEM_EVENT_ALLOC_FAILURE:
+                struct page_alloc_args page_alloc_fake_args;
+                android::bpf::runProgram(mProgram, &page_alloc_fake_args,
+                                         sizeof(page_alloc_fake_args));
+                break;
             default:
                 FAIL() << "Invalid event type provided";
         }
@@ -495,6 +525,59 @@ class MemEventsListenerBpf : public ::testing::Test {
                           mocked_kswapd_sleep_event.event_data.kswapd_sleep.node_id)
                         << "MEM_EVENT_KSWAPD_SLEEP: Didn't receive expected node id";
                 break;
+            case MEM_EVENT_COMPACTION_BEGIN:
+                ASSERT_EQ(mem_event.event_data.compaction_begin.pid,
+                          mocked_compaction_begin_event.event_data.compaction_begin.pid)
+                        << "MEM_EVENT_COMPACTION_BEGIN: Didn't receive expected pid";
+                ASSERT_EQ(mem_event.event_data.compaction_begin.sync,
+                          mocked_compaction_begin_event.event_data.compaction_begin.sync)
+                        << "MEM_EVENT_COMPACTION_BEGIN: Didn't receive expected sync mode";
+                break;
+            case MEM_EVENT_COMPACTION_END:
+                ASSERT_EQ(mem_event.event_data.compaction_end.pid,
+                          mocked_compaction_end_event.event_data.compaction_end.pid)
+                        << "MEM_EVENT_COMPACTION_END: Didn't receive expected pid";
+                ASSERT_EQ(mem_event.event_data.compaction_end.sync,
+                          mocked_compaction_end_event.event_data.compaction_end.sync)
+                        << "MEM_EVENT_COMPACTION_END: Didn't receive expected sync mode";
+                ASSERT_EQ(mem_event.event_data.compaction_end.result,
+                          mocked_compaction_end_event.event_data.compaction_end.result)
+                        << "MEM_EVENT_COMPACTION_END: Didn't receive expected result";
+                ASSERT_EQ(mem_event.event_data.compaction_end.duration_us,
+                          mocked_compaction_end_event.event_data.compaction_end.duration_us)
+                        << "MEM_EVENT_COMPACTION_END: Didn't receive expected duration";
+                break;
+            case MEM_EVENT_EXTFRAG:
+                ASSERT_EQ(mem_event.event_data.extfrag.alloc_order,
+                          mocked_extfrag_event.event_data.extfrag.alloc_order)
+                        << "MEM_EVENT_EXTFRAG: Didn't receive expected alloc order";
+                ASSERT_EQ(mem_event.event_data.extfrag.fallback_order,
+                          mocked_extfrag_event.event_data.extfrag.fallback_order)
+                        << "MEM_EVENT_EXTFRAG: Didn't receive expected fallback order";
+                ASSERT_EQ(mem_event.event_data.extfrag.alloc_migratetype,
+                          mocked_extfrag_event.event_data.extfrag.alloc_migratetype)
+                        << "MEM_EVENT_EXTFRAG: Didn't receive expected alloc migratetype";
+                ASSERT_EQ(mem_event.event_data.extfrag.fallback_migratetype,
+                          mocked_extfrag_event.event_data.extfrag.fallback_migratetype)
+                        << "MEM_EVENT_EXTFRAG: Didn't receive expected fallback migratetype";
+                ASSERT_EQ(mem_event.event_data.extfrag.change_ownership,
+                          mocked_extfrag_event.event_data.extfrag.change_ownership)
+                        << "MEM_EVENT_EXTFRAG: Didn't receive expected change of ownership";
+                break;
+            case MEM_EVENT_ALLOC_FAILURE:
+                ASSERT_EQ(mem_event.event_data.alloc_failure.pid,
+                          mocked_alloc_failure_event.event_data.alloc_failure.pid)
+                        << "MEM_EVENT_ALLOC_FAILURE: Didn't receive expected pid";
+                ASSERT_EQ(mem_event.event_data.alloc_failure.order,
+                          mocked_alloc_failure_event.event_data.alloc_failure.order)
+                        << "MEM_EVENT_ALLOC_FAILURE: Didn't receive expected order";
+                ASSERT_EQ(mem_event.event_data.alloc_failure.migratetype,
+                          mocked_alloc_failure_event.event_data.alloc_failure.migratetype)
+                        << "MEM_EVENT_ALLOC_FAILURE: Didn't receive expected migratetype";
+                ASSERT_EQ(mem_event.event_data.alloc_failure.gfp_flags,
+                          mocked_alloc_failure_event.event_data.alloc_failure.gfp_flags)
+                        << "MEM_EVENT_ALLOC_FAILURE: Didn't receive expected gfp flags";
+                break;
         }
     }
 };
@@ -576,6 +659,77 @@ TEST_F(MemEventsListenerBpf, listener_bpf_kswapd_sleep) {
     validateMockedEvent(mem_events[0]);
 }
 
+TEST_F(MemEventsListenerBpf, listener_bpf_compaction_begin) {
+    const mem_event_type_t event_type = MEM_EVENT_COMPACTION_BEGIN;
+
+    ASSERT_TRUE(memevent_listener->registerEvent(event_type));
+    testListenEvent(event_type);
+
+    std::vector<mem_event_t> mem_events;
+    ASSERT_TRUE(memevent_listener->getMemEvents(mem_events)) << "Failed fetching events";
+    ASSERT_FALSE(mem_events.empty()) << "Expected for mem_events to have at least 1 mocked event";
+    ASSERT_EQ(mem_events[0].type, event_type) << "Didn't receive a compaction begin event";
+    validateMockedEvent(mem_events[0]);
+}
+
+TEST_F(MemEventsListenerBpf, listener_bpf_compaction_end) {
+    const mem_event_type_t event_type = MEM_EVENT_COMPACTION_END;
+
+    ASSERT_TRUE(memevent_listener->registerEvent(event_type));
+    testListenEvent(event_type);
+
+    std::vector<mem_event_t> mem_events;
+    ASSERT_TRUE(memevent_listener->getMemEvents(mem_events)) << "Failed fetching events";
+    ASSERT_FALSE(mem_events.empty()) << "Expected for mem_events to have at least 1 mocked event";
+    ASSERT_EQ(mem_events[0].type, event_type) << "Didn't receive a compaction end event";
+    validateMockedEvent(mem_events[0]);
+}
+
+TEST_F(MemEventsListenerBpf, listener_bpf_extfrag) {
+    const mem_event_type_t event_type = MEM_EVENT_EXTFRAG;
+
+    ASSERT_TRUE(memevent_listener->registerEvent(event_type));
+    testListenEvent(event_type);
+
+    std::vector<mem_event_t> mem_events;
+    ASSERT_TRUE(memevent_listener->getMemEvents(mem_events)) << "Failed fetching events";
+    ASSERT_FALSE(mem_events.empty()) << "Expected for mem_events to have at least 1 mocked event";
+    ASSERT_EQ(mem_events[0].type, event_type) << "Didn't receive an extfrag event";
+    validateMockedEvent(mem_events[0]);
+}
+
+TEST_F(MemEventsListenerBpf, listener_bpf_alloc_failure) {
+    const mem_event_type_t event_type = MEM_EVENT_ALLOC_FAILURE;
+
+    ASSERT_TRUE(memevent_listener->registerEvent(event_type));
+    testListenEvent(event_type);
+
+    std::vector<mem_event_t> mem_events;
+    ASSERT_TRUE(memevent_listener->getMemEvents(mem_events)) << "Failed fetching events";
+    ASSERT_FALSE(mem_events.empty()) << "Expected for mem_events to have at least 1 mocked event";
+    ASSERT_EQ(mem_events[0].type, event_type) << "Didn't receive an allocation failure event";
+    validateMockedEvent(mem_events[0]);
+}
+
+/*
+ * Only the events of interest are returned when events of several types are in the
+ * ring buffer, e.g. compaction stalls of a client that doesn't care about extfrag.
+ */
+TEST_F(MemEventsListenerBpf, getMemEvents_filters_compaction_events) {
+    ASSERT_TRUE(memevent_listener->registerEvent(MEM_EVENT_COMPACTION_END));
+
+    setMockDataInRb(MEM_EVENT_EXTFRAG);
+    setMockDataInRb(MEM_EVENT_COMPACTION_BEGIN);
+    setMockDataInRb(MEM_EVENT_COMPACTION_END);
+    ASSERT_TRUE(memevent_listener->listen(5000));  // 5 second timeout
+
+    std::vector<mem_event_t> mem_events;
+    ASSERT_TRUE(memevent_listener->getMemEvents(mem_events)) << "Failed fetching events";
+    ASSERT_EQ(mem_events.size(), 1u) << "Expected only the compaction end event";
+    ASSERT_EQ(mem_events[0].type, MEM_EVENT_COMPACTION_END);
+    validateMockedEvent(mem_events[0]);
+}
+
 /*
  * `listen()` should timeout, and return false, when a memory event that
  * we are not registered for is triggered.
@@ -662,6 +816,30 @@ TEST_F(MemEventsListenerBpf, getRb_poll_and_create_event) {
     t.join();
 }
 
+/*
+ * The bpf-progs read the tracepoint arguments through these structs, their layout must
+ * match the format of the tracepoints in the kernel, see
+ * /sys/kernel/tracing/events/<group>/<event>/format.
+ */
+TEST(MemEventsTracepointArgs, layout_matches_kernel_format) {
+    EXPECT_EQ(offsetof(struct compaction_begin_args, zone_start), 8u);
+    EXPECT_EQ(offsetof(struct compaction_begin_args, sync), 40u);
+    EXPECT_EQ(offsetof(struct compaction_end_args, sync), 40u);
+    EXPECT_EQ(offsetof(struct compaction_end_args, status), 44u);
+
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, pfn), 8u);
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, alloc_order), 16u);
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, fallback_order), 20u);
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, alloc_migratetype), 24u);
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, fallback_migratetype), 28u);
+    EXPECT_EQ(offsetof(struct page_alloc_extfrag_args, change_ownership), 32u);
+
+    EXPECT_EQ(offsetof(struct page_alloc_args, pfn), 8u);
+    EXPECT_EQ(offsetof(struct page_alloc_args, order), 16u);
+    EXPECT_EQ(offsetof(struct page_alloc_args, gfp_flags), 24u);
+    EXPECT_EQ(offsetof(struct page_alloc_args, migratetype), 32u);
+}
+
 class MemoryPressureTest : public ::testing::Test {
   public:
     static void SetUpTestSuite() {
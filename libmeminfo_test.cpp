@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <linux/kernel-page-flags.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -23,12 +25,23 @@
 
 #include <filesystem>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <meminfo/androidprocheaps.h>
+#include <meminfo/asyncscan.h>
+#include <meminfo/damon.h>
+#include <meminfo/footprint.h>
+#include <meminfo/memtrend.h>
 #include <meminfo/pageacct.h>
+#include <meminfo/pageage.h>
+#include <meminfo/pagecache.h>
+#include <meminfo/pagecontent.h>
+#include <meminfo/pagesharing.h>
 #include <meminfo/procmeminfo.h>
+#include <meminfo/procstat.h>
 #include <meminfo/sysmeminfo.h>
+#include <meminfo/workstealing.h>
 #include <vintf/VintfObject.h>
 
 #include <android-base/file.h>
@@ -39,6 +52,8 @@
 
 using namespace std;
 using namespace android::meminfo;
+using android::dmabufinfo::DmaBuffer;
+using android::dmabufinfo::DrmClient;
 using android::vintf::KernelVersion;
 using android::vintf::RuntimeInfo;
 using android::vintf::VintfObject;
@@ -1339,6 +1354,1482 @@ TEST(SysMemInfo, TestReadDmaBufHeapPoolsSizeKb) {
     EXPECT_EQ(size, 416);
 }
 
+TEST(PageCacheInfo, PageCacheStatsFromFdTest) {
+    const size_t pagesz = getpagesize();
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(::android::base::WriteStringToFd(std::string(4 * pagesz - 1, 'x'), tf.fd));
+
+    // The pages were just written, so they must all be in the page cache.
+    PageCacheStats stats;
+    ASSERT_TRUE(PageCacheStatsFromFd(tf.fd, &stats, false));
+    EXPECT_FALSE(stats.from_cachestat);
+    EXPECT_EQ(stats.size, 4);
+    EXPECT_EQ(stats.cached, 4);
+    EXPECT_EQ(stats.dirty, 0);
+
+    ASSERT_TRUE(PageCacheStatsFromFd(tf.fd, &stats));
+    EXPECT_EQ(stats.size, 4);
+    EXPECT_EQ(stats.cached, 4);
+    if (stats.from_cachestat) {
+        EXPECT_LE(stats.dirty, stats.cached);
+    }
+}
+
+TEST(PageCacheInfo, GroupStatsTest) {
+    const size_t pagesz = getpagesize();
+    TemporaryFile tf1;
+    TemporaryFile tf2;
+    ASSERT_TRUE(tf1.fd != -1);
+    ASSERT_TRUE(tf2.fd != -1);
+    ASSERT_TRUE(::android::base::WriteStringToFd(std::string(2 * pagesz, 'x'), tf1.fd));
+    ASSERT_TRUE(::android::base::WriteStringToFd(std::string(3 * pagesz, 'x'), tf2.fd));
+
+    PageCacheInfo info;
+    ASSERT_TRUE(info.AddFile(tf1.path));
+    ASSERT_TRUE(info.AddFile(tf1.path));
+    ASSERT_TRUE(info.AddFile(tf2.path));
+    ASSERT_FALSE(info.AddFile("/does/not/exist"));
+    // Files are only tracked once, no matter how often they are added.
+    EXPECT_EQ(info.Files().size(), 2);
+    ASSERT_TRUE(info.Scan());
+
+    auto by_path = info.GroupStats();
+    ASSERT_EQ(by_path.size(), 2);
+    EXPECT_EQ(by_path[tf1.path].size, 2);
+    EXPECT_EQ(by_path[tf2.path].size, 3);
+
+    auto all = info.GroupStats([](const std::string&) { return "all"; });
+    ASSERT_EQ(all.size(), 1);
+    EXPECT_EQ(all["all"].size, 5);
+    EXPECT_EQ(all["all"].cached, 5);
+
+    info.Reset();
+    EXPECT_TRUE(info.Files().empty());
+    EXPECT_TRUE(info.GroupStats().empty());
+}
+
+TEST(PageCacheInfo, AddProcessTest) {
+    PageCacheInfo info;
+    ASSERT_TRUE(info.AddProcess(pid));
+    // At least the test binary itself is mapped.
+    EXPECT_FALSE(info.Files().empty());
+    ASSERT_TRUE(info.Scan());
+    for (const auto& [key, file] : info.Files()) {
+        EXPECT_TRUE(file.queried);
+        EXPECT_LE(file.stats.cached, file.stats.size) << file.path;
+    }
+}
+
+TEST(ProcMemInfo, ForEachNumaVmaFromFileTest) {
+    std::string numa_maps =
+            R"numa_maps(55d5f2a00000 default file=/system/bin/app_process64 mapped=3 N0=3 kernelpagesize_kB=4
+55d5f4c00000 default heap anon=120 dirty=120 active=100 N0=80 N1=40 kernelpagesize_kB=4
+7f2a00000000 bind:1 anon=512 dirty=512 swapcache=2 N1=512 kernelpagesize_kB=4
+7f2b00000000 default file=/dev/hugepages/buf huge dirty=2 N0=2 kernelpagesize_kB=2048
+7f2c00000000 default file=/system/lib64/libc.so mapped=60 mapmax=40 writeback=1 N0=50 N1=10 kernelpagesize_kB=4
+7ffd8a000000 default stack anon=30 dirty=30 N0=30 kernelpagesize_kB=4
+7ffd8b000000 default
+)numa_maps";
+
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(::android::base::WriteStringToFd(numa_maps, tf.fd));
+
+    std::vector<NumaVma> vmas;
+    ASSERT_TRUE(ForEachNumaVmaFromFile(tf.path, [&](NumaVma& vma) {
+        vmas.push_back(vma);
+        return true;
+    }));
+    ASSERT_EQ(vmas.size(), 7);
+
+    EXPECT_EQ(vmas[0].start, 0x55d5f2a00000);
+    EXPECT_EQ(vmas[0].end, 0);
+    EXPECT_EQ(vmas[0].policy, "default");
+    EXPECT_EQ(vmas[0].name, "/system/bin/app_process64");
+    EXPECT_EQ(vmas[0].usage.mapped, 3);
+    ASSERT_EQ(vmas[0].usage.nodes.size(), 1);
+    EXPECT_EQ(vmas[0].usage.nodes[0], 3);
+
+    EXPECT_EQ(vmas[1].name, "[heap]");
+    EXPECT_EQ(vmas[1].usage.anon, 120);
+    EXPECT_EQ(vmas[1].usage.dirty, 120);
+    EXPECT_EQ(vmas[1].usage.active, 100);
+    ASSERT_EQ(vmas[1].usage.nodes.size(), 2);
+    EXPECT_EQ(vmas[1].usage.nodes[0], 80);
+    EXPECT_EQ(vmas[1].usage.nodes[1], 40);
+
+    EXPECT_EQ(vmas[2].policy, "bind:1");
+    EXPECT_EQ(vmas[2].name, "");
+    EXPECT_EQ(vmas[2].usage.swapcache, 2);
+    ASSERT_EQ(vmas[2].usage.nodes.size(), 2);
+    EXPECT_EQ(vmas[2].usage.nodes[0], 0);
+    EXPECT_EQ(vmas[2].usage.nodes[1], 512);
+
+    EXPECT_TRUE(vmas[3].is_huge);
+    EXPECT_EQ(vmas[3].pagesize_kb, 2048);
+
+    EXPECT_EQ(vmas[4].mapmax, 40);
+    EXPECT_EQ(vmas[4].usage.writeback, 1);
+    EXPECT_FALSE(vmas[4].is_huge);
+
+    EXPECT_EQ(vmas[5].name, "[stack]");
+
+    EXPECT_EQ(vmas[6].start, 0x7ffd8b000000);
+    EXPECT_TRUE(vmas[6].usage.nodes.empty());
+    EXPECT_EQ(vmas[6].pagesize_kb, getpagesize() / 1024);
+
+    NumaUsage usage;
+    ASSERT_TRUE(NumaUsageKbFromFile(tf.path, &usage));
+    EXPECT_EQ(usage.anon, (120 + 512 + 30) * 4);
+    EXPECT_EQ(usage.dirty, (120 + 512 + 30) * 4 + 2 * 2048);
+    EXPECT_EQ(usage.mapped, (3 + 60) * 4);
+    ASSERT_EQ(usage.nodes.size(), 2);
+    EXPECT_EQ(usage.nodes[0], (3 + 80 + 50 + 30) * 4 + 2 * 2048);
+    EXPECT_EQ(usage.nodes[1], (40 + 512 + 10) * 4);
+}
+
+TEST(ProcMemInfo, ForEachNumaVmaFromFileMalformedTest) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(::android::base::WriteStringToFd("55d5f2a00000 default N0=\n", tf.fd));
+
+    NumaUsage usage;
+    EXPECT_FALSE(NumaUsageKbFromFile(tf.path, &usage));
+    EXPECT_FALSE(NumaUsageKbFromFile("/does/not/exist", &usage));
+}
+
+TEST(ProcMemInfo, ForEachNumaVmaTest) {
+    if (access("/proc/self/numa_maps", R_OK) != 0) {
+        GTEST_SKIP() << "Kernel has no numa_maps support";
+    }
+
+    ProcMemInfo proc_mem(pid);
+    size_t nr_vmas = 0;
+    ASSERT_TRUE(proc_mem.ForEachNumaVma([&](NumaVma& vma) {
+        EXPECT_GT(vma.end, vma.start);
+        nr_vmas++;
+        return true;
+    }));
+    EXPECT_GT(nr_vmas, 0);
+
+    NumaUsage usage;
+    ASSERT_TRUE(proc_mem.NumaUsageKb(&usage));
+    EXPECT_FALSE(usage.nodes.empty());
+}
+
+TEST(SysMemInfo, TestReadNodesMemInfo) {
+    std::string node0 = R"meminfo(Node 0 MemTotal:       16303108 kB
+Node 0 MemFree:         1043184 kB
+Node 0 MemUsed:        15259924 kB
+Node 0 Active(anon):    2178248 kB
+Node 0 Inactive(anon):   416404 kB
+Node 0 Active(file):    3458204 kB
+Node 0 Inactive(file):  5238148 kB
+Node 0 Shmem:            181328 kB
+Node 0 Slab:             978512 kB
+Node 0 HugePages_Total:     0
+)meminfo";
+    std::string node1 = R"meminfo(Node 1 MemTotal:        8388608 kB
+Node 1 MemFree:         4194304 kB
+Node 1 Active(anon):      12345 kB
+)meminfo";
+
+    TemporaryDir td;
+    std::string root(td.path);
+    ASSERT_TRUE(fs::create_directory(root + "/node0"));
+    ASSERT_TRUE(fs::create_directory(root + "/node1"));
+    ASSERT_TRUE(fs::create_directory(root + "/cpu0"));
+    ASSERT_TRUE(::android::base::WriteStringToFile(node0, root + "/node0/meminfo"));
+    ASSERT_TRUE(::android::base::WriteStringToFile(node1, root + "/node1/meminfo"));
+
+    std::map<int, SysMemInfo> nodes;
+    ASSERT_TRUE(ReadNodesMemInfo(&nodes, root));
+    ASSERT_EQ(nodes.size(), 2);
+
+    EXPECT_EQ(nodes[0].mem_total_kb(), 16303108);
+    EXPECT_EQ(nodes[0].mem_free_kb(), 1043184);
+    EXPECT_EQ(nodes[0].mem_active_anon_kb(), 2178248);
+    EXPECT_EQ(nodes[0].mem_inactive_file_kb(), 5238148);
+    EXPECT_EQ(nodes[0].mem_shmem_kb(), 181328);
+    EXPECT_EQ(nodes[0].mem_slab_kb(), 978512);
+    EXPECT_EQ(nodes[0].mem_cached_kb(), 0);
+
+    EXPECT_EQ(nodes[1].mem_total_kb(), 8388608);
+    EXPECT_EQ(nodes[1].mem_free_kb(), 4194304);
+    EXPECT_EQ(nodes[1].mem_active_anon_kb(), 12345);
+
+    SysMemInfo mi;
+    EXPECT_FALSE(mi.ReadNodeMemInfo(2, root));
+}
+
+TEST(PageAcct, ReadPageCensusFromFileTest) {
+    // One entry per PFN, in the same format as /proc/kpageflags and /proc/kpagecount.
+    std::vector<uint64_t> flags = {
+            1ULL << KPF_NOPAGE,
+            1ULL << KPF_BUDDY,
+            (1ULL << KPF_SLAB) | (1ULL << KPF_ANON),
+            1ULL << KPF_PGTABLE,
+            (1ULL << KPF_LRU) | (1ULL << KPF_ANON) | (1ULL << KPF_MMAP) | (1ULL << KPF_THP),
+            (1ULL << KPF_LRU) | (1ULL << KPF_ANON) | (1ULL << KPF_KSM) | (1ULL << KPF_DIRTY),
+            (1ULL << KPF_LRU) | (1ULL << KPF_SWAPBACKED) | (1ULL << KPF_MMAP),
+            (1ULL << KPF_LRU) | (1ULL << KPF_MMAP) | (1ULL << KPF_IDLE),
+            (1ULL << KPF_LRU) | (1ULL << KPF_UNEVICTABLE) | (1ULL << 33 /* KPF_MLOCKED */),
+            0,
+            1ULL << 32 /* KPF_RESERVED */,
+    };
+    std::vector<uint64_t> counts = {0, 0, 0, 0, 1, 3, 2, 1, 1, 0, 0};
+
+    TemporaryFile flags_file;
+    TemporaryFile counts_file;
+    ASSERT_TRUE(flags_file.fd != -1);
+    ASSERT_TRUE(counts_file.fd != -1);
+    ASSERT_TRUE(::android::base::WriteFully(flags_file.fd, flags.data(),
+                                            flags.size() * sizeof(uint64_t)));
+    ASSERT_TRUE(::android::base::WriteFully(counts_file.fd, counts.data(),
+                                            counts.size() * sizeof(uint64_t)));
+
+    PageCensus census;
+    ASSERT_TRUE(ReadPageCensus(&census, false, flags_file.path, counts_file.path));
+    EXPECT_EQ(census.total, flags.size());
+    EXPECT_EQ(census.nopage, 1);
+    EXPECT_EQ(census.buddy, 1);
+    EXPECT_EQ(census.slab, 1);
+    EXPECT_EQ(census.pgtable, 1);
+    EXPECT_EQ(census.anon, 3);
+    EXPECT_EQ(census.file, 2);
+    EXPECT_EQ(census.other, 2);
+    EXPECT_EQ(census.nopage + census.buddy + census.slab + census.pgtable + census.anon +
+                      census.file + census.other,
+              census.total);
+    EXPECT_EQ(census.thp, 1);
+    EXPECT_EQ(census.ksm, 1);
+    EXPECT_EQ(census.mlocked, 1);
+    EXPECT_EQ(census.unevictable, 1);
+    EXPECT_EQ(census.idle, 1);
+    EXPECT_EQ(census.mmap, 3);
+    EXPECT_EQ(census.dirty, 1);
+    EXPECT_EQ(census.shared, 0);
+
+    ASSERT_TRUE(ReadPageCensus(&census, true, flags_file.path, counts_file.path));
+    EXPECT_EQ(census.total, flags.size());
+    EXPECT_EQ(census.shared, 2);
+
+    EXPECT_FALSE(ReadPageCensus(&census, true, flags_file.path, "/does/not/exist"));
+}
+
+TEST(PageAcct, ReadPageCensusTest) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Reading /proc/kpageflags requires root";
+    }
+
+    PageCensus census;
+    ASSERT_TRUE(ReadPageCensus(&census, true));
+    EXPECT_GT(census.total, 0);
+    EXPECT_EQ(census.nopage + census.buddy + census.slab + census.pgtable + census.anon +
+                      census.file + census.other,
+              census.total);
+}
+
+TEST(PageAcct, ReadMemcgPageCensusFromFileTest) {
+    std::vector<uint64_t> flags = {
+            (1ULL << KPF_LRU) | (1ULL << KPF_ANON),
+            (1ULL << KPF_LRU) | (1ULL << KPF_ANON),
+            (1ULL << KPF_LRU),
+            1ULL << KPF_SLAB,
+            (1ULL << KPF_LRU),
+            1ULL << KPF_BUDDY,
+    };
+    std::vector<uint64_t> counts = {1, 2, 3, 0, 1, 0};
+    std::vector<uint64_t> memcgs = {100, 100, 200, 100, 200, 0};
+
+    TemporaryFile flags_file;
+    TemporaryFile counts_file;
+    TemporaryFile memcgs_file;
+    ASSERT_TRUE(::android::base::WriteFully(flags_file.fd, flags.data(),
+                                            flags.size() * sizeof(uint64_t)));
+    ASSERT_TRUE(::android::base::WriteFully(counts_file.fd, counts.data(),
+                                            counts.size() * sizeof(uint64_t)));
+    ASSERT_TRUE(::android::base::WriteFully(memcgs_file.fd, memcgs.data(),
+                                            memcgs.size() * sizeof(uint64_t)));
+
+    std::map<uint64_t, PageCensus> census;
+    ASSERT_TRUE(ReadMemcgPageCensus(&census, true, flags_file.path, counts_file.path,
+                                    memcgs_file.path));
+    ASSERT_EQ(census.size(), 3);
+
+    EXPECT_EQ(census[100].total, 3);
+    EXPECT_EQ(census[100].anon, 2);
+    EXPECT_EQ(census[100].slab, 1);
+    EXPECT_EQ(census[100].shared, 1);
+
+    EXPECT_EQ(census[200].total, 2);
+    EXPECT_EQ(census[200].file, 2);
+    EXPECT_EQ(census[200].shared, 1);
+
+    EXPECT_EQ(census[0].total, 1);
+    EXPECT_EQ(census[0].buddy, 1);
+
+    EXPECT_FALSE(ReadMemcgPageCensus(&census, false, flags_file.path, counts_file.path,
+                                     "/does/not/exist"));
+    EXPECT_TRUE(census.empty());
+}
+
+TEST(PageAcct, ReadMemcgPathsTest) {
+    TemporaryDir td;
+    std::string root(td.path);
+    ASSERT_TRUE(fs::create_directories(root + "/apps/uid_10001/pid_123"));
+    ASSERT_TRUE(fs::create_directories(root + "/system"));
+    ASSERT_TRUE(::android::base::WriteStringToFile("0\n", root + "/system/memory.current"));
+
+    std::unordered_map<uint64_t, std::string> paths;
+    ASSERT_TRUE(ReadMemcgPaths(&paths, root));
+    ASSERT_EQ(paths.size(), 5);
+
+    auto inode_of = [](const std::string& path) {
+        struct stat st;
+        EXPECT_EQ(stat(path.c_str(), &st), 0);
+        return st.st_ino;
+    };
+    EXPECT_EQ(paths[inode_of(root)], "/");
+    EXPECT_EQ(paths[inode_of(root + "/apps")], "/apps");
+    EXPECT_EQ(paths[inode_of(root + "/apps/uid_10001/pid_123")], "/apps/uid_10001/pid_123");
+    EXPECT_EQ(paths[inode_of(root + "/system")], "/system");
+
+    EXPECT_FALSE(ReadMemcgPaths(&paths, "/does/not/exist"));
+}
+
+TEST(ProcMemInfo, MemcgUsageTest) {
+    if (getuid() != 0 || access("/proc/kpagecgroup", R_OK) != 0) {
+        GTEST_SKIP() << "Reading /proc/kpagecgroup requires root and CONFIG_MEMCG";
+    }
+
+    ProcMemInfo proc_mem(pid);
+    const std::map<uint64_t, MemUsage>& memcg_usage = proc_mem.MemcgUsage();
+    ASSERT_FALSE(memcg_usage.empty());
+
+    // Reading the memcgs also reads the usage of the process.
+    const MemUsage& usage = proc_mem.Usage();
+    uint64_t memcg_rss = 0;
+    uint64_t memcg_uss = 0;
+    uint64_t memcg_pss = 0;
+    for (const auto& [ino, memcg] : memcg_usage) {
+        memcg_rss += memcg.rss;
+        memcg_uss += memcg.uss;
+        memcg_pss += memcg.pss;
+    }
+    EXPECT_EQ(memcg_rss, usage.rss);
+    EXPECT_EQ(memcg_uss, usage.uss);
+    // Both add up the Pss in fixed point, the process rounds down to kB per vma and the
+    // memcgs once each.
+    EXPECT_NEAR(memcg_pss, usage.pss, proc_mem.Maps().size() + memcg_usage.size());
+
+    // Reading the memcgs again after the usage doesn't change the result.
+    ProcMemInfo proc_mem2(pid);
+    EXPECT_GT(proc_mem2.Usage().rss, 0);
+    EXPECT_FALSE(proc_mem2.MemcgUsage().empty());
+    EXPECT_GT(proc_mem2.Usage().rss, 0);
+}
+
+TEST(PageIdleAger, AgeFromFileTest) {
+    // A regular file stands in for the bitmap: nothing clears the idle bits that the
+    // ager sets, except the test itself.
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    std::vector<uint64_t> bitmap(4, 0);
+    ASSERT_TRUE(::android::base::WriteFully(tf.fd, bitmap.data(), bitmap.size() * sizeof(uint64_t)));
+
+    PageIdleAger ager(tf.path);
+    ASSERT_FALSE(ager.Age());
+    ASSERT_TRUE(ager.Init());
+    EXPECT_EQ(ager.nr_pfns(), 256);
+    EXPECT_EQ(ager.generations(), 0);
+    EXPECT_EQ(ager.PageAge(0), 0);
+
+    // Init() marks all pages idle.
+    ASSERT_TRUE(::android::base::ReadFullyAtOffset(tf.fd, bitmap.data(),
+                                                   bitmap.size() * sizeof(uint64_t), 0));
+    for (uint64_t word : bitmap) {
+        EXPECT_EQ(word, ~0ULL);
+    }
+
+    ASSERT_TRUE(ager.Age());
+    ASSERT_TRUE(ager.Age());
+    EXPECT_EQ(ager.generations(), 2);
+    EXPECT_EQ(ager.PageAge(0), 2);
+    EXPECT_EQ(ager.PageAge(255), 2);
+
+    // Access pfns 64-127 and pfn 129.
+    uint64_t accessed[2] = {0, ~(1ULL << 1)};
+    ASSERT_EQ(pwrite64(tf.fd, accessed, sizeof(accessed), sizeof(uint64_t)), sizeof(accessed));
+    ASSERT_TRUE(ager.Age());
+    EXPECT_EQ(ager.PageAge(63), 3);
+    EXPECT_EQ(ager.PageAge(64), 0);
+    EXPECT_EQ(ager.PageAge(127), 0);
+    EXPECT_EQ(ager.PageAge(128), 3);
+    EXPECT_EQ(ager.PageAge(129), 0);
+    EXPECT_EQ(ager.PageAge(130), 3);
+
+    // Ages saturate.
+    for (int i = 0; i < 2 * PageIdleAger::kMaxAge; i++) {
+        ASSERT_TRUE(ager.Age());
+    }
+    EXPECT_EQ(ager.PageAge(0), PageIdleAger::kMaxAge);
+    EXPECT_EQ(ager.PageAge(64), PageIdleAger::kMaxAge);
+    EXPECT_EQ(ager.PageAge(1000), 0);
+}
+
+TEST(PageIdleAger, ProcessAgeHistogramTest) {
+    if (getuid() != 0 || !PageAcct::KernelHasPageIdle()) {
+        GTEST_SKIP() << "Idle page tracking requires root and CONFIG_IDLE_PAGE_TRACKING";
+    }
+
+    PageIdleAger ager;
+    ASSERT_TRUE(ager.Init());
+    ASSERT_TRUE(ager.Age());
+
+    std::vector<uint64_t> kb_by_age;
+    ASSERT_TRUE(ager.ProcessAgeHistogram(pid, &kb_by_age));
+    ASSERT_EQ(kb_by_age.size(), PageIdleAger::kMaxAge + 1);
+    uint64_t total_kb = 0;
+    for (uint64_t kb : kb_by_age) {
+        total_kb += kb;
+    }
+    EXPECT_GT(total_kb, 0);
+}
+
+TEST(ProcStat, ParseProcStatTest) {
+    std::string stat =
+            "1234 (a) b)) S 1 1234 1234 0 -1 4194560 5000 0 12 0 300 200 0 0 20 0 7 0 "
+            "98765 123456789 2048 18446744073709551615 1 1 0 0 0 0 0 4096 1073775864 0 0 0 17 "
+            "3 0 0 0 0 0\n";
+
+    ProcStat s;
+    ASSERT_TRUE(ParseProcStat(stat.c_str(), stat.size(), &s));
+    EXPECT_EQ(s.pid, 1234);
+    EXPECT_STREQ(s.comm, "a) b)");
+    EXPECT_EQ(s.state, 'S');
+    EXPECT_EQ(s.ppid, 1);
+    EXPECT_EQ(s.flags, 4194560);
+    EXPECT_EQ(s.minflt, 5000);
+    EXPECT_EQ(s.majflt, 12);
+    EXPECT_EQ(s.utime, 300);
+    EXPECT_EQ(s.stime, 200);
+    EXPECT_EQ(s.num_threads, 7);
+    EXPECT_EQ(s.starttime, 98765);
+    EXPECT_EQ(s.vsize, 123456789);
+    EXPECT_EQ(s.rss, 2048);
+}
+
+TEST(ProcStat, ParseProcStatMalformedTest) {
+    ProcStat s;
+    std::string no_comm = "1234 a S 1 1234";
+    EXPECT_FALSE(ParseProcStat(no_comm.c_str(), no_comm.size(), &s));
+    std::string truncated = "1234 (a) S 1 1234 1234 0 -1 4194560 5000";
+    EXPECT_FALSE(ParseProcStat(truncated.c_str(), truncated.size(), &s));
+    std::string not_a_number = "1234 (a) S x 1234";
+    EXPECT_FALSE(ParseProcStat(not_a_number.c_str(), not_a_number.size(), &s));
+}
+
+TEST(ProcStat, IsMmlessTaskTest) {
+    // kthreadd: PF_KTHREAD is set and there is no address space.
+    std::string kthread =
+            "2 (kthreadd) S 0 0 0 0 -1 2129984 0 0 0 0 0 3 0 0 20 0 1 0 1 0 0 "
+            "18446744073709551615 0 0 0 0 0 0 0 2147483647 0 0 0 0 0 1 0 0 0 0 0\n";
+    std::string zombie =
+            "4321 (sh) Z 1234 4321 4321 0 -1 4227084 80 0 0 0 0 0 0 0 20 0 1 0 5000 0 0 "
+            "18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 17 2 0 0 0 0 0\n";
+    std::string user =
+            "1234 (sh) S 1 1234 1234 0 -1 4194560 5000 0 12 0 300 200 0 0 20 0 1 0 "
+            "98765 123456789 2048 18446744073709551615 1 1 0 0 0 0 0 4096 1073775864 0 0 0 17 "
+            "3 0 0 0 0 0\n";
+
+    ProcStat s;
+    ASSERT_TRUE(ParseProcStat(kthread.c_str(), kthread.size(), &s));
+    EXPECT_TRUE(IsKernelThread(s));
+    EXPECT_TRUE(IsMmlessTask(s));
+    ASSERT_TRUE(ParseProcStat(zombie.c_str(), zombie.size(), &s));
+    EXPECT_FALSE(IsKernelThread(s));
+    EXPECT_TRUE(IsMmlessTask(s));
+    ASSERT_TRUE(ParseProcStat(user.c_str(), user.size(), &s));
+    EXPECT_FALSE(IsKernelThread(s));
+    EXPECT_FALSE(IsMmlessTask(s));
+
+    ASSERT_TRUE(ProcStatFromFile("/proc/self/stat", &s));
+    EXPECT_FALSE(IsMmlessTask(s));
+}
+
+TEST(ProcStat, ProcStatFromFileTest) {
+    ProcStat s;
+    ASSERT_TRUE(ProcStatFromFile("/proc/self/stat", &s));
+    EXPECT_EQ(s.pid, pid);
+    EXPECT_EQ(s.state, 'R');
+    EXPECT_GT(s.vsize, 0);
+    EXPECT_GT(s.rss, 0);
+}
+
+TEST(ProcStat, ProcStatReaderTest) {
+    ProcStatReader reader;
+    ASSERT_TRUE(reader.AddPid(pid));
+    EXPECT_EQ(reader.Stat(pid), nullptr);
+    ASSERT_TRUE(reader.Sample());
+    ASSERT_NE(reader.Stat(pid), nullptr);
+    EXPECT_EQ(reader.Stat(pid)->pid, pid);
+
+    ProcStatDelta delta;
+    EXPECT_FALSE(reader.Delta(pid, &delta));
+
+    // Fault in some new pages between the two samples.
+    const size_t size = 64 * getpagesize();
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(addr, 1, size);
+    ASSERT_TRUE(reader.Sample());
+    munmap(addr, size);
+
+    ASSERT_TRUE(reader.Delta(pid, &delta));
+    EXPECT_GE(delta.minflt, 64);
+    EXPECT_EQ(delta.vsize, size);
+
+    size_t nr_samples = 0;
+    reader.ForEachSample([&](const ProcStat& stat, const ProcStatDelta* d) {
+        EXPECT_EQ(stat.pid, pid);
+        EXPECT_NE(d, nullptr);
+        nr_samples++;
+    });
+    EXPECT_EQ(nr_samples, 1);
+}
+
+TEST(ProcStat, ProcStatReaderExitedTest) {
+    pid_t child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+
+    ProcStatReader reader;
+    ASSERT_TRUE(reader.AddPid(child));
+    ASSERT_TRUE(reader.AddPid(pid));
+    ASSERT_TRUE(reader.Sample());
+    EXPECT_EQ(reader.Pids().size(), 2);
+
+    kill(child, SIGKILL);
+    ASSERT_EQ(waitpid(child, nullptr, 0), child);
+
+    std::vector<pid_t> exited;
+    ASSERT_TRUE(reader.Sample(&exited));
+    ASSERT_EQ(exited.size(), 1);
+    EXPECT_EQ(exited[0], child);
+    EXPECT_EQ(reader.Pids(), std::vector<pid_t>{pid});
+    EXPECT_FALSE(reader.AddPid(child));
+}
+
+TEST(ProcMemInfo, ThpUsageKbFromFileTest) {
+    std::string smaps =
+            R"smaps(7f0000000000-7f0000800000 rw-p 00000000 00:00 0                          [anon:scudo:primary]
+Size:               8192 kB
+Rss:                6144 kB
+Pss:                6144 kB
+AnonHugePages:      4096 kB
+ShmemPmdMapped:        0 kB
+FilePmdMapped:         0 kB
+THPeligible:           1
+VmFlags: rd wr mr mw me ac
+7f0000800000-7f0000a00000 r-xp 00000000 fc:00 1234                       /system/lib64/libfoo.so
+Size:               2048 kB
+Rss:                2048 kB
+Pss:                1024 kB
+AnonHugePages:         0 kB
+ShmemPmdMapped:        0 kB
+FilePmdMapped:      2048 kB
+THPeligible:           1
+VmFlags: rd ex mr mw me
+7f0000a00000-7f0000a10000 rw-p 00000000 00:00 0
+Size:                 64 kB
+Rss:                  32 kB
+Pss:                  32 kB
+AnonHugePages:         0 kB
+ShmemPmdMapped:        0 kB
+FilePmdMapped:         0 kB
+THPeligible:           0
+VmFlags: rd wr mr mw me ac)smaps";
+
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(::android::base::WriteStringToFd(smaps, tf.fd));
+
+    std::vector<ThpUsage> vmas;
+    ThpUsage usage;
+    ASSERT_TRUE(ThpUsageKbFromFile(tf.path, &usage, [&](const Vma& vma, const ThpUsage& u) {
+        EXPECT_EQ(vma.usage.thp_eligible, u.eligible);
+        vmas.emplace_back(u);
+    }));
+    ASSERT_EQ(vmas.size(), 3);
+    EXPECT_EQ(vmas[0].thp, 4096);
+    EXPECT_EQ(vmas[0].eligible, 8192);
+    EXPECT_EQ(vmas[0].eligible_unbacked, 2048);
+    EXPECT_EQ(vmas[1].thp, 2048);
+    EXPECT_EQ(vmas[1].eligible_unbacked, 0);
+    EXPECT_EQ(vmas[2].eligible, 0);
+    EXPECT_EQ(vmas[2].eligible_unbacked, 0);
+
+    EXPECT_EQ(usage.vss, 10304);
+    EXPECT_EQ(usage.rss, 8224);
+    EXPECT_EQ(usage.thp, 6144);
+    EXPECT_EQ(usage.eligible, 10240);
+    EXPECT_EQ(usage.eligible_unbacked, 2048);
+    EXPECT_EQ(usage.bloat, 0);
+}
+
+TEST(ProcMemInfo, ThpUsageKbTest) {
+    ProcMemInfo proc_mem(pid);
+    ThpUsage usage;
+    ThpUsage sum;
+    ASSERT_TRUE(proc_mem.ThpUsageKb(&usage, [&](const Vma&, const ThpUsage& u) {
+        sum.vss += u.vss;
+        sum.thp += u.thp;
+    }));
+    EXPECT_GT(usage.vss, 0);
+    EXPECT_EQ(usage.vss, sum.vss);
+    EXPECT_EQ(usage.thp, sum.thp);
+}
+
+TEST(ProcMemInfo, ThpUsageKbBloatTest) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Reading page frame numbers requires root";
+    }
+
+    // Fault in a huge page, then unmap half of it.
+    const size_t hpage_size = 2 * 1024 * 1024;
+    char* addr = static_cast<char*>(mmap(nullptr, 2 * hpage_size, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    ASSERT_NE(addr, MAP_FAILED);
+    char* hpage = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(addr) + hpage_size - 1) & ~(hpage_size - 1));
+    madvise(hpage, hpage_size, MADV_HUGEPAGE);
+    memset(hpage, 1, hpage_size);
+
+    ProcMemInfo proc_mem(pid);
+    ThpUsage usage;
+    ASSERT_TRUE(proc_mem.ThpUsageKb(&usage));
+    if (usage.thp < hpage_size / 1024) {
+        munmap(addr, 2 * hpage_size);
+        GTEST_SKIP() << "No transparent huge page was allocated";
+    }
+
+    ASSERT_EQ(munmap(hpage + hpage_size / 2, hpage_size / 2), 0);
+    ASSERT_TRUE(proc_mem.ThpUsageKb(&usage, nullptr, true));
+    // The kernel may split the huge page in the meantime.
+    EXPECT_TRUE(usage.bloat == 0 || usage.bloat >= hpage_size / 2 / 1024);
+    munmap(addr, 2 * hpage_size);
+}
+
+TEST(ProcMemInfo, ForEachMatchingVmaTest) {
+    const size_t size = 16 * getpagesize();
+    android::base::unique_fd fd(memfd_create("matching_vma_test", MFD_CLOEXEC));
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, size), 0);
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(addr, 1, size / 2);
+
+    ProcMemInfo proc_mem(pid);
+    size_t nr_vmas = 0;
+    std::vector<Vma> matches;
+    auto predicate = [&](const Vma& vma) {
+        // Only the maps level fields are known to the predicate.
+        EXPECT_EQ(vma.usage.rss, 0);
+        nr_vmas++;
+        return vma.name.find("matching_vma_test") != std::string::npos;
+    };
+    ASSERT_TRUE(proc_mem.ForEachMatchingVma(predicate, [&](Vma& vma) {
+        matches.emplace_back(vma);
+        return true;
+    }));
+    munmap(addr, size);
+
+    EXPECT_GT(nr_vmas, 1);
+    ASSERT_EQ(matches.size(), 1);
+    EXPECT_EQ(matches[0].start, reinterpret_cast<uint64_t>(addr));
+    EXPECT_EQ(matches[0].end, reinterpret_cast<uint64_t>(addr) + size);
+    EXPECT_EQ(matches[0].flags, PROT_READ | PROT_WRITE);
+    EXPECT_TRUE(matches[0].is_shared);
+    EXPECT_NE(matches[0].inode, 0);
+    EXPECT_EQ(matches[0].usage.vss, size / 1024);
+    EXPECT_EQ(matches[0].usage.rss, size / 2 / 1024);
+}
+
+TEST(ProcMemInfo, ForEachMatchingVmaNoMatchTest) {
+    ProcMemInfo proc_mem(pid);
+    bool called = false;
+    ASSERT_TRUE(proc_mem.ForEachMatchingVma([](const Vma&) { return false; },
+                                            [&](Vma&) {
+                                                called = true;
+                                                return true;
+                                            }));
+    EXPECT_FALSE(called);
+}
+
+TEST(ProcMemInfo, PssOfWidelySharedPagesTest) {
+    // Pages mapped by more than 4 processes are less than 1 kB each in the Pss.
+    const size_t size = 32 * getpagesize();
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    madvise(addr, size, MADV_NOHUGEPAGE);
+    memset(addr, 1, size);
+
+    // The children share the pages of 'addr' with this process until they write to them.
+    constexpr int kNrChildren = 5;
+    int ready[2];
+    ASSERT_EQ(pipe(ready), 0);
+    std::vector<pid_t> children;
+    for (int i = 0; i < kNrChildren; i++) {
+        pid_t child = fork();
+        ASSERT_NE(child, -1);
+        if (child == 0) {
+            char c = 0;
+            TEMP_FAILURE_RETRY(write(ready[1], &c, 1));
+            pause();
+            _exit(0);
+        }
+        children.push_back(child);
+    }
+    for (int i = 0; i < kNrChildren; i++) {
+        char c;
+        ASSERT_EQ(TEMP_FAILURE_RETRY(read(ready[0], &c, 1)), 1);
+    }
+    close(ready[0]);
+    close(ready[1]);
+
+    auto find_vma = [addr](const std::vector<Vma>& vmas) -> Vma {
+        for (const Vma& vma : vmas) {
+            if (vma.start == reinterpret_cast<uint64_t>(addr)) return vma;
+        }
+        return {};
+    };
+    ProcMemInfo pagemap_mem(pid);
+    Vma pagemap_vma = find_vma(pagemap_mem.Maps());
+    ProcMemInfo smaps_mem(pid);
+    Vma smaps_vma = find_vma(smaps_mem.Smaps());
+
+    for (pid_t child : children) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+    }
+    munmap(addr, size);
+
+    ASSERT_EQ(pagemap_vma.usage.rss, size / 1024);
+    ASSERT_EQ(smaps_vma.usage.rss, size / 1024);
+    EXPECT_EQ(pagemap_vma.usage.uss, 0);
+    EXPECT_GT(smaps_vma.usage.pss, 0);
+    EXPECT_EQ(pagemap_vma.usage.pss, smaps_vma.usage.pss);
+}
+
+// Runs each task on its own thread, which is joined by the destructor.
+class ThreadExecutor {
+  public:
+    ~ThreadExecutor() {
+        for (auto& thread : threads_) thread.join();
+    }
+    Executor executor() {
+        return [this](std::function<void()> task) { threads_.emplace_back(std::move(task)); };
+    }
+
+  private:
+    std::vector<std::thread> threads_;
+};
+
+TEST(AsyncScan, ReadProcessesUsageAsyncTest) {
+    ThreadExecutor threads;
+    ScanRequest<std::vector<ProcessUsage>> request;
+    std::vector<std::pair<size_t, size_t>> progress;
+    bool completed = false;
+    request.on_progress = [&](size_t done, size_t total) { progress.emplace_back(done, total); };
+    request.on_complete = [&](const ScanResult<std::vector<ProcessUsage>>& result) {
+        EXPECT_EQ(result.status, ScanStatus::SUCCESS);
+        completed = true;
+    };
+
+    // The second pid doesn't exist and is skipped.
+    auto future = ReadProcessesUsageAsync({pid, INT32_MAX}, threads.executor(), request);
+    ScanResult<std::vector<ProcessUsage>> result = future.get();
+    EXPECT_TRUE(completed);
+    ASSERT_EQ(result.status, ScanStatus::SUCCESS);
+    ASSERT_EQ(result.value.size(), 1);
+    EXPECT_EQ(result.value[0].pid, pid);
+    EXPECT_GT(result.value[0].usage.vss, 0);
+    EXPECT_GT(result.value[0].usage.rss, 0);
+    EXPECT_GE(result.value[0].usage.rss, result.value[0].usage.pss);
+    std::vector<std::pair<size_t, size_t>> expected_progress = {{1, 2}, {2, 2}};
+    EXPECT_EQ(progress, expected_progress);
+}
+
+TEST(AsyncScan, CancelQueuedScanTest) {
+    std::function<void()> queued;
+    Executor executor = [&](std::function<void()> task) { queued = std::move(task); };
+
+    ScanRequest<std::vector<ProcessUsage>> request;
+    bool completed = false;
+    request.on_complete = [&](const ScanResult<std::vector<ProcessUsage>>& result) {
+        EXPECT_EQ(result.status, ScanStatus::CANCELLED);
+        completed = true;
+    };
+    auto future = ReadProcessesUsageAsync({pid}, executor, request);
+    ASSERT_TRUE(queued);
+    request.token->Cancel();
+    queued();
+
+    ScanResult<std::vector<ProcessUsage>> result = future.get();
+    EXPECT_TRUE(completed);
+    EXPECT_EQ(result.status, ScanStatus::CANCELLED);
+    EXPECT_TRUE(result.value.empty());
+}
+
+TEST(AsyncScan, CancelRunningScanTest) {
+    ScanRequest<std::vector<ProcessUsage>> request;
+    request.on_progress = [&](size_t, size_t) { request.token->Cancel(); };
+
+    // Runs on the calling thread without an executor.
+    auto future = ReadProcessesUsageAsync({pid, pid, pid}, nullptr, request);
+    ScanResult<std::vector<ProcessUsage>> result = future.get();
+    EXPECT_EQ(result.status, ScanStatus::CANCELLED);
+    EXPECT_EQ(result.value.size(), 1);
+}
+
+TEST(AsyncScan, ReadProcfsDmaBufsAsyncTest) {
+    TemporaryDir procfs;
+    std::string procdir = ::android::base::StringPrintf("%s/1234", procfs.path);
+    ASSERT_TRUE(std::filesystem::create_directories(procdir + "/fdinfo"));
+    ASSERT_TRUE(std::filesystem::create_directories(std::string(procfs.path) + "/self"));
+    std::string fdinfo =
+            "pos:\t0\nflags:\t02\nmnt_id:\t9\nino:\t5678\nsize:\t8192\ncount:\t1\n"
+            "exp_name:\tsystem\nname:\tbuf\n";
+    ASSERT_TRUE(::android::base::WriteStringToFile(fdinfo, procdir + "/fdinfo/5"));
+    std::string maps = "7f0000000000-7f0000002000 rw-s 00000000 00:0a 5678    /dmabuf:buf\n";
+    ASSERT_TRUE(::android::base::WriteStringToFile(maps, procdir + "/maps"));
+
+    ThreadExecutor threads;
+    ScanRequest<std::vector<::android::dmabufinfo::DmaBuffer>> request;
+    size_t nr_progress = 0;
+    request.on_progress = [&](size_t done, size_t total) {
+        EXPECT_EQ(done, 1);
+        EXPECT_EQ(total, 1);
+        nr_progress++;
+    };
+    auto result = ReadProcfsDmaBufsAsync(threads.executor(), request, procfs.path).get();
+    ASSERT_EQ(result.status, ScanStatus::SUCCESS);
+    EXPECT_EQ(nr_progress, 1);
+    ASSERT_EQ(result.value.size(), 1);
+    EXPECT_EQ(result.value[0].inode(), 5678);
+    EXPECT_EQ(result.value[0].size(), 8192);
+    EXPECT_EQ(result.value[0].name(), "buf");
+    EXPECT_EQ(result.value[0].fdrefs().at(1234), 1);
+    EXPECT_EQ(result.value[0].maprefs().at(1234), 1);
+}
+
+TEST(PageSharingIndex, BuildTest) {
+    // pid 100 is the zygote, 101 and 102 are apps.
+    PageSharingIndex sharing;
+    Vma boot_art(0x1000, 0x10000, 0, PROT_READ, "/system/framework/boot.art", 0, false);
+    Vma heap(0x20000, 0x30000, 0, PROT_READ | PROT_WRITE, "[anon:dalvik-main space]", 0, false);
+    // Pages 10-14 are also mapped by processes that are not in the index.
+    ASSERT_TRUE(sharing.AddVmaPages(100, boot_art, {10, 11, 12, 13, 14, 15, 16, 17, 18, 19},
+                                    {40, 40, 40, 40, 40, 1, 1, 1, 1, 1}));
+    ASSERT_TRUE(sharing.AddVmaPages(101, boot_art, {10, 11, 12, 13, 14}, {40, 40, 40, 40, 40}));
+    ASSERT_TRUE(sharing.AddVmaPages(101, heap, {100, 101}, {2, 1}));
+    ASSERT_TRUE(sharing.AddVmaPages(102, boot_art, {10, 11}, {40, 40}));
+    // Page 200 is mapped twice by the same process.
+    ASSERT_TRUE(sharing.AddVmaPages(102, heap, {100, 200, 200}, {2, 2, 2}));
+    EXPECT_FALSE(sharing.AddVmaPages(102, heap, {300}, {}));
+    sharing.Build();
+    EXPECT_FALSE(sharing.AddVmaPages(103, heap, {300}, {1}));
+
+    EXPECT_EQ(sharing.Processes(), std::vector<pid_t>({100, 101, 102}));
+    // Runs 10-11, 12-14, 15-19, 100, 101 and 200, each mapped by a different set.
+    EXPECT_EQ(sharing.NrRuns(), 6);
+    EXPECT_EQ(sharing.NrSharerSets(), 6);
+    EXPECT_EQ(sharing.Sharers(11), std::vector<pid_t>({100, 101, 102}));
+    EXPECT_EQ(sharing.Sharers(13), std::vector<pid_t>({100, 101}));
+    EXPECT_EQ(sharing.Sharers(100), std::vector<pid_t>({101, 102}));
+    EXPECT_TRUE(sharing.Sharers(50).empty());
+
+    const uint64_t pagesz = getpagesize();
+    std::vector<uint64_t> matrix;
+    sharing.SharedBytesMatrix(&matrix);
+    std::vector<uint64_t> expected_matrix = {10, 5, 2, 5, 7, 3, 2, 3, 4};
+    for (uint64_t& bytes : expected_matrix) {
+        bytes *= pagesz;
+    }
+    EXPECT_EQ(matrix, expected_matrix);
+
+    std::vector<ZygoteSharing> stats;
+    sharing.ZygoteSharingStats({100}, &stats);
+    ASSERT_EQ(stats.size(), 3);
+    EXPECT_EQ(stats[0].private_bytes, 5 * pagesz);
+    EXPECT_EQ(stats[0].zygote_shared_bytes, 0);
+    EXPECT_EQ(stats[0].other_shared_bytes, 5 * pagesz);
+    EXPECT_EQ(stats[1].private_bytes, 1 * pagesz);
+    EXPECT_EQ(stats[1].zygote_shared_bytes, 5 * pagesz);
+    EXPECT_EQ(stats[1].other_shared_bytes, 1 * pagesz);
+    EXPECT_EQ(stats[2].private_bytes, 1 * pagesz);
+    EXPECT_EQ(stats[2].zygote_shared_bytes, 2 * pagesz);
+    EXPECT_EQ(stats[2].other_shared_bytes, 1 * pagesz);
+
+    std::vector<VmaSharingHistogram> histograms;
+    ASSERT_TRUE(sharing.VmaSharingHistograms(101, &histograms));
+    ASSERT_EQ(histograms.size(), 2);
+    EXPECT_EQ(histograms[0].name, "/system/framework/boot.art");
+    // Mapped 40 times in all, by 2 or 3 processes of the index.
+    EXPECT_EQ(histograms[0].pages[5], 5);
+    EXPECT_EQ(histograms[0].indexed_pages[0], 0);
+    EXPECT_EQ(histograms[0].indexed_pages[1], 5);
+    EXPECT_EQ(histograms[1].start, 0x20000);
+    EXPECT_EQ(histograms[1].pages[0], 1);
+    EXPECT_EQ(histograms[1].pages[1], 1);
+    EXPECT_EQ(histograms[1].indexed_pages[0], 1);
+    EXPECT_EQ(histograms[1].indexed_pages[1], 1);
+
+    // The double mapping of page 200 counts in the mapcount, not in the processes.
+    ASSERT_TRUE(sharing.VmaSharingHistograms(102, &histograms));
+    ASSERT_EQ(histograms.size(), 2);
+    EXPECT_EQ(histograms[1].pages[0], 0);
+    EXPECT_EQ(histograms[1].pages[1], 3);
+    EXPECT_EQ(histograms[1].indexed_pages[0], 2);
+    EXPECT_EQ(histograms[1].indexed_pages[1], 1);
+    EXPECT_FALSE(sharing.VmaSharingHistograms(103, &histograms));
+}
+
+TEST(PageSharingIndex, AddProcessTest) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Page frame numbers are only reported to root";
+    }
+
+    PageSharingIndex sharing;
+    ASSERT_TRUE(sharing.AddProcess(pid));
+    sharing.Build();
+    ASSERT_EQ(sharing.Processes(), std::vector<pid_t>({pid}));
+    EXPECT_GT(sharing.NrRuns(), 0);
+
+    std::vector<uint64_t> matrix;
+    sharing.SharedBytesMatrix(&matrix);
+    ASSERT_EQ(matrix.size(), 1);
+    EXPECT_GT(matrix[0], 0);
+
+    // Pages of a single process are all private to the index, though shared libraries are
+    // also mapped by other processes.
+    std::vector<VmaSharingHistogram> histograms;
+    ASSERT_TRUE(sharing.VmaSharingHistograms(pid, &histograms));
+    uint64_t nr_pages = 0;
+    uint64_t nr_shared_pages = 0;
+    for (const VmaSharingHistogram& histogram : histograms) {
+        uint64_t nr_vma_pages = 0;
+        for (size_t i = 1; i < VmaSharingHistogram::kNrBuckets; i++) {
+            EXPECT_EQ(histogram.indexed_pages[i], 0);
+            nr_vma_pages += histogram.pages[i];
+        }
+        nr_shared_pages += nr_vma_pages;
+        nr_vma_pages += histogram.pages[0];
+        EXPECT_EQ(nr_vma_pages, histogram.indexed_pages[0]);
+        nr_pages += nr_vma_pages;
+    }
+    EXPECT_LE(nr_pages * getpagesize(), matrix[0]);
+    EXPECT_GT(nr_shared_pages, 0);
+}
+
+TEST(PageContentSampler, AddVmasTest) {
+    const size_t pagesz = getpagesize();
+    const size_t nr_pages = 16;
+    auto addr = static_cast<uint8_t*>(
+            mmap(nullptr, nr_pages * pagesz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0));
+    ASSERT_NE(addr, MAP_FAILED);
+    // 4 zero pages, 4 pages filled with the same byte, 4 copies of a page and 4 unique pages.
+    memset(addr, 0, 4 * pagesz);
+    memset(addr + 4 * pagesz, 0x5a, 4 * pagesz);
+    for (size_t i = 8; i < nr_pages; i++) {
+        for (size_t j = 0; j < pagesz; j++) {
+            addr[i * pagesz + j] = j * 7 + (i < 12 ? 0 : i);
+        }
+    }
+    Vma vma(reinterpret_cast<uint64_t>(addr), reinterpret_cast<uint64_t>(addr) + nr_pages * pagesz,
+            0, PROT_READ | PROT_WRITE, "[anon:test]", 0, false);
+
+    PageContentSampler sampler(1024);
+    ASSERT_TRUE(sampler.AddVmas(pid, {vma}));
+    std::map<pid_t, PageContentStats> proc_stats;
+    sampler.ProcessStats(&proc_stats);
+    ASSERT_EQ(proc_stats.size(), 1);
+    const PageContentStats& stats = proc_stats[pid];
+    EXPECT_EQ(stats.resident_pages, nr_pages);
+    EXPECT_EQ(stats.sampled_pages, nr_pages);
+    EXPECT_EQ(stats.zero_pages, 4);
+    EXPECT_EQ(stats.same_filled_pages, 8);
+    // Each group of 4 copies could be merged into a single page.
+    EXPECT_DOUBLE_EQ(stats.duplicate_pages, 9);
+    EXPECT_DOUBLE_EQ(stats.self_duplicate_pages, 9);
+    EXPECT_EQ(stats.ksm_savings_bytes, 9 * pagesz);
+    EXPECT_EQ(stats.zram_same_bytes, 8 * pagesz);
+
+    std::map<std::string, PageContentStats> name_stats;
+    sampler.VmaNameStats(&name_stats);
+    ASSERT_EQ(name_stats.size(), 1);
+    EXPECT_EQ(name_stats["[anon:test]"].sampled_pages, nr_pages);
+
+    // With a budget of 4 pages, every 4th page is read and the savings are scaled up.
+    PageContentSampler budget_sampler(4);
+    ASSERT_TRUE(budget_sampler.AddVmas(pid, {vma}));
+    budget_sampler.ProcessStats(&proc_stats);
+    EXPECT_EQ(proc_stats[pid].resident_pages, nr_pages);
+    EXPECT_EQ(proc_stats[pid].sampled_pages, 4);
+    EXPECT_EQ(proc_stats[pid].zero_pages, 1);
+    EXPECT_EQ(proc_stats[pid].zram_same_bytes, 8 * pagesz);
+
+    munmap(addr, nr_pages * pagesz);
+}
+
+TEST(PageContentSampler, CompressTest) {
+    const size_t pagesz = getpagesize();
+    const size_t nr_pages = 16;
+    auto addr = static_cast<uint8_t*>(
+            mmap(nullptr, nr_pages * pagesz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0));
+    ASSERT_NE(addr, MAP_FAILED);
+    // 4 zero pages, 4 pages of text and 8 pages of random bytes.
+    memset(addr, 0, 4 * pagesz);
+    for (size_t j = 0; j < 4 * pagesz; j++) {
+        addr[4 * pagesz + j] = "compressible "[j % 13];
+    }
+    uint64_t x = 88172645463325252ULL;
+    for (size_t j = 8 * pagesz; j < nr_pages * pagesz; j++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        addr[j] = x;
+    }
+    Vma vma(reinterpret_cast<uint64_t>(addr), reinterpret_cast<uint64_t>(addr) + nr_pages * pagesz,
+            0, PROT_READ | PROT_WRITE, "[anon:test]", 0, false);
+
+    PageContentSampler sampler(1024, true);
+    ASSERT_TRUE(sampler.AddVmas(pid, {vma}));
+    std::map<pid_t, PageContentStats> proc_stats;
+    sampler.ProcessStats(&proc_stats);
+    const PageContentStats& stats = proc_stats[pid];
+    // Zero pages take no space and random pages are stored whole.
+    EXPECT_GT(stats.compressed_bytes, 8 * pagesz);
+    EXPECT_LT(stats.compressed_bytes, 9 * pagesz);
+    EXPECT_DOUBLE_EQ(stats.compression_ratio,
+                     stats.compressed_bytes / static_cast<double>(nr_pages * pagesz));
+    EXPECT_EQ(stats.zram_bytes, stats.compressed_bytes);
+    // All resident pages were sampled.
+    EXPECT_EQ(stats.compression_ratio_error, 0);
+
+    // Sampling every other page leaves some uncertainty.
+    PageContentSampler budget_sampler(8, true);
+    ASSERT_TRUE(budget_sampler.AddVmas(pid, {vma}));
+    budget_sampler.ProcessStats(&proc_stats);
+    EXPECT_EQ(proc_stats[pid].sampled_pages, 8);
+    EXPECT_GT(proc_stats[pid].compression_ratio_error, 0);
+    EXPECT_GT(proc_stats[pid].zram_bytes, 2 * proc_stats[pid].compressed_bytes - pagesz);
+
+    // Pages are only compressed if asked for.
+    PageContentSampler plain_sampler(1024);
+    ASSERT_TRUE(plain_sampler.AddVmas(pid, {vma}));
+    plain_sampler.ProcessStats(&proc_stats);
+    EXPECT_EQ(proc_stats[pid].compressed_bytes, 0);
+    EXPECT_EQ(proc_stats[pid].compression_ratio, 0);
+
+    munmap(addr, nr_pages * pagesz);
+}
+
+TEST(PageContentSampler, UnreadablePagesTest) {
+    const size_t pagesz = getpagesize();
+    const size_t nr_pages = 16;
+    auto addr = static_cast<uint8_t*>(
+            mmap(nullptr, nr_pages * pagesz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0));
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(addr, 0x5a, nr_pages * pagesz);
+    // Every other page stays resident but can't be read, like a page unmapped between the
+    // pagemap read and the sampling: process_vm_readv() fails on it with EFAULT.
+    for (size_t i = 1; i < nr_pages; i += 2) {
+        ASSERT_EQ(mprotect(addr + i * pagesz, pagesz, PROT_NONE), 0);
+    }
+    Vma vma(reinterpret_cast<uint64_t>(addr), reinterpret_cast<uint64_t>(addr) + nr_pages * pagesz,
+            0, PROT_READ | PROT_WRITE, "[anon:test]", 0, false);
+
+    PageContentSampler sampler(1024);
+    ASSERT_TRUE(sampler.AddVmas(pid, {vma}));
+    std::map<pid_t, PageContentStats> proc_stats;
+    sampler.ProcessStats(&proc_stats);
+    const PageContentStats& stats = proc_stats[pid];
+    EXPECT_EQ(stats.resident_pages, nr_pages);
+    EXPECT_EQ(stats.sampled_pages, nr_pages / 2);
+    EXPECT_EQ(stats.same_filled_pages, nr_pages / 2);
+    // The savings are scaled from the pages that were read to all resident pages.
+    EXPECT_EQ(stats.zram_same_bytes, nr_pages * pagesz);
+    EXPECT_DOUBLE_EQ(stats.duplicate_pages, nr_pages / 2 - 1);
+    EXPECT_EQ(stats.ksm_savings_bytes, (nr_pages - 2) * pagesz);
+
+    munmap(addr, nr_pages * pagesz);
+}
+
+TEST(PageContentSampler, AddProcessTest) {
+    PageContentSampler sampler(256);
+    ASSERT_TRUE(sampler.AddProcess(pid));
+    std::map<pid_t, PageContentStats> proc_stats;
+    sampler.ProcessStats(&proc_stats);
+    ASSERT_EQ(proc_stats.size(), 1);
+    EXPECT_GT(proc_stats[pid].resident_pages, 0);
+    EXPECT_EQ(proc_stats[pid].sampled_pages, std::min<uint64_t>(proc_stats[pid].resident_pages, 256));
+}
+
+TEST(MemSeries, TrendTest) {
+    MemSeries series;
+    for (int t = 0; t < 50; t++) {
+        series.Add(t, 1000 + 10 * t, 1);
+    }
+    EXPECT_EQ(series.nr_samples(), 50);
+    EXPECT_NEAR(series.slope(), 10, 1e-6);
+    EXPECT_NEAR(series.Predict(60), 1600, 1e-3);
+    EXPECT_LT(series.stddev(), 1);
+    EXPECT_EQ(series.cusum_up(), 0);
+
+    series.Reset();
+    EXPECT_EQ(series.nr_samples(), 0);
+    EXPECT_EQ(series.slope(), 0);
+}
+
+TEST(MemAnomalyDetector, AlertTest) {
+    std::vector<MemAlert> alerts;
+    MemAnomalyDetector detector({}, [&](const MemAlert& alert) { alerts.push_back(alert); });
+    MemUsage usage;
+    uint64_t time_ms = 0;
+    auto add = [&](uint64_t kb) {
+        usage.pss = usage.rss = kb;
+        detector.AddSample(1, time_ms, usage);
+        time_ms += 1000;
+    };
+
+    // A flat series with some noise.
+    for (int i = 0; i < 30; i++) {
+        add(100000 + (i % 2 ? 50 : -50));
+    }
+    EXPECT_TRUE(alerts.empty());
+
+    // A sudden increase is a change point.
+    for (int i = 0; i < 30; i++) {
+        add(120000 + (i % 2 ? 50 : -50));
+    }
+    ASSERT_EQ(alerts.size(), 2);
+    EXPECT_EQ(alerts[0].type, MemAlertType::CHANGE_POINT);
+    EXPECT_STREQ(alerts[0].metric, "pss");
+    EXPECT_EQ(alerts[0].time_ms, 30000);
+    EXPECT_EQ(alerts[0].value_kb, 119950);
+    EXPECT_STREQ(alerts[1].metric, "rss");
+
+    // A leak raises a single alert per metric.
+    alerts.clear();
+    for (int i = 0; i < 60; i++) {
+        add(120000 + 200 * i);
+    }
+    ASSERT_EQ(alerts.size(), 2);
+    EXPECT_EQ(alerts[0].type, MemAlertType::GROWTH);
+    EXPECT_GT(alerts[0].slope_kb_per_s, MemTrendThresholds().max_growth_kb_per_s);
+    EXPECT_EQ(alerts[1].type, MemAlertType::GROWTH);
+
+    const MemSeries* pss = detector.PssSeries(1);
+    ASSERT_NE(pss, nullptr);
+    EXPECT_NEAR(pss->slope(), 200, 5);
+    EXPECT_EQ(detector.PssSeries(2), nullptr);
+    detector.RemoveProcess(1);
+    EXPECT_EQ(detector.NrProcesses(), 0);
+}
+
+TEST(ProcessFootprint, InjectedSourcesTest) {
+    const uint64_t pagesz_kb = getpagesize() / 1024;
+    std::map<pid_t, std::vector<uint64_t>> offsets = {{1, {10, 11, 12}}, {2, {12, 13}}};
+    std::vector<pid_t> gpu_reads;
+    FootprintSources sources = {
+            .read_usage =
+                    [](pid_t pid, MemUsage* usage) {
+                        // Process 3 exited.
+                        if (pid == 3) return false;
+                        usage->pss = 1000 * pid;
+                        usage->swap_pss = 100 * pid;
+                        usage->uss = 500 * pid;
+                        return true;
+                    },
+            .read_swap_offsets =
+                    [&](pid_t pid, std::vector<uint64_t>* swap_offsets) {
+                        *swap_offsets = offsets[pid];
+                        return true;
+                    },
+            .read_dmabufs =
+                    [](pid_t pid, std::vector<DmaBuffer>* dmabufs,
+                       std::vector<DrmClient>* drm_clients) {
+                        // Both processes have a DRM client open with 4MB of private
+                        // memory.
+                        if (drm_clients->empty()) {
+                            DrmClient& client = drm_clients->emplace_back();
+                            client.client_id = 7;
+                            client.regions["vram"] = {.total = 6 << 20,
+                                                      .shared = 2 << 20,
+                                                      .resident = 6 << 20,
+                                                      .has_resident = true};
+                        }
+                        (*drm_clients)[0].pids.insert(pid);
+
+                        // Both processes share an 8MB buffer, process 1 has another 1MB.
+                        std::vector<std::pair<ino_t, uint64_t>> bufs = {{1, 8 << 20}};
+                        if (pid == 1) bufs.emplace_back(2, 1 << 20);
+                        for (auto [inode, size] : bufs) {
+                            auto it = std::find_if(dmabufs->begin(), dmabufs->end(),
+                                                   [&](const DmaBuffer& buf) {
+                                                       return buf.inode() == inode;
+                                                   });
+                            if (it == dmabufs->end()) {
+                                it = dmabufs->emplace(dmabufs->end(), inode, size, 1, "", "");
+                            }
+                            it->AddFdRef(pid);
+                        }
+                        return true;
+                    },
+            .read_gpu =
+                    [&](std::unordered_map<uint32_t, uint64_t>* gpu_kb) {
+                        gpu_reads.push_back(0);
+                        *gpu_kb = {{2, 300}};
+                        return true;
+                    },
+    };
+
+    std::vector<ProcessFootprint> footprints;
+    ASSERT_TRUE(ReadProcessFootprints({1, 2, 3}, true, &footprints, sources));
+    // The GPU memory of all processes is read once.
+    EXPECT_EQ(gpu_reads.size(), 1);
+    ASSERT_EQ(footprints.size(), 2);
+
+    const ProcessFootprint& first = footprints[0];
+    EXPECT_EQ(first.pid, 1);
+    EXPECT_EQ(first.usage.pss, 1000);
+    EXPECT_EQ(first.usage.uss, 500);
+    EXPECT_EQ(first.dmabuf_pss_kb, 5 * 1024);
+    EXPECT_EQ(first.gpu_kb, 0);
+    EXPECT_EQ(first.unique_swap_kb, 2 * pagesz_kb);
+    EXPECT_EQ(first.proportional_swap_kb, static_cast<uint64_t>(2.5 * pagesz_kb));
+    EXPECT_EQ(first.total_kb, 1000 + 100 + 5 * 1024);
+
+    const ProcessFootprint& second = footprints[1];
+    EXPECT_EQ(second.pid, 2);
+    EXPECT_EQ(second.dmabuf_pss_kb, 4 * 1024);
+    EXPECT_EQ(second.gpu_kb, 300);
+    EXPECT_EQ(second.unique_swap_kb, pagesz_kb);
+    EXPECT_EQ(second.total_kb, 2000 + 200 + 4 * 1024 + 300);
+
+    // Swap offsets are only read if asked for.
+    ASSERT_TRUE(ReadProcessFootprints({1, 2}, false, &footprints, sources));
+    EXPECT_EQ(footprints[0].unique_swap_kb, 0);
+    EXPECT_EQ(footprints[0].proportional_swap_kb, 0);
+
+    EXPECT_FALSE(ReadProcessFootprints({3}, true, &footprints, sources));
+    EXPECT_TRUE(footprints.empty());
+
+    // Without the other processes, the buffer and the swap slot shared with process 2 are
+    // charged to process 1 in full.
+    ASSERT_TRUE(ReadProcessFootprints({1}, true, &footprints, sources));
+    ASSERT_EQ(footprints.size(), 1);
+    EXPECT_EQ(footprints[0].dmabuf_pss_kb, 9 * 1024);
+    EXPECT_EQ(footprints[0].unique_swap_kb, 3 * pagesz_kb);
+    // With them, they are split as when all processes are read.
+    sources.list_pids = [](std::vector<pid_t>* pids) {
+        *pids = {1, 2};
+        return true;
+    };
+    ASSERT_TRUE(ReadProcessFootprints({1}, true, &footprints, sources));
+    ASSERT_EQ(footprints.size(), 1);
+    EXPECT_EQ(footprints[0].dmabuf_pss_kb, 5 * 1024);
+    EXPECT_EQ(footprints[0].unique_swap_kb, 2 * pagesz_kb);
+    EXPECT_EQ(footprints[0].proportional_swap_kb, static_cast<uint64_t>(2.5 * pagesz_kb));
+
+    // Without the BPF map, the GPU memory is read from the DRM clients.
+    sources.read_gpu = [](std::unordered_map<uint32_t, uint64_t>*) { return false; };
+    ASSERT_TRUE(ReadProcessFootprints({1, 2}, false, &footprints, sources));
+    EXPECT_EQ(footprints[0].gpu_kb, 2048);
+    EXPECT_EQ(footprints[1].gpu_kb, 2048);
+    EXPECT_EQ(footprints[1].total_kb, 2000 + 200 + 4 * 1024 + 2048);
+    ASSERT_TRUE(ReadProcessFootprints({2}, false, &footprints, sources));
+    EXPECT_EQ(footprints[0].gpu_kb, 2048);
+}
+
+TEST(ProcessFootprint, DefaultSourcesTest) {
+    std::vector<ProcessFootprint> footprints;
+    ASSERT_TRUE(ReadProcessFootprints({pid}, false, &footprints));
+    ASSERT_EQ(footprints.size(), 1);
+    EXPECT_GT(footprints[0].usage.pss, 0);
+    EXPECT_GE(footprints[0].total_kb, footprints[0].usage.pss);
+}
+
+static std::string ReadDamonFile(const std::string& path) {
+    std::string content;
+    EXPECT_TRUE(::android::base::ReadFileToString(path, &content)) << path;
+    return content;
+}
+
+TEST(DamonMonitor, SysfsTest) {
+    TemporaryDir admin;
+    std::string kdamonds = std::string(admin.path) + "/kdamonds";
+    // The directories that the kernel creates when the nr_* files are written.
+    for (int i = 0; i < 2; i++) {
+        std::string ctx = ::android::base::StringPrintf("%s/%d/contexts/0", kdamonds.c_str(), i);
+        for (const char* dir : {"/monitoring_attrs/intervals", "/monitoring_attrs/nr_regions",
+                                "/targets/0", "/schemes/0/access_pattern/sz",
+                                "/schemes/0/access_pattern/nr_accesses",
+                                "/schemes/0/access_pattern/age", "/schemes/0/tried_regions"}) {
+            ASSERT_TRUE(std::filesystem::create_directories(ctx + dir));
+        }
+    }
+    ASSERT_TRUE(::android::base::WriteStringToFile("0\n", kdamonds + "/nr_kdamonds"));
+
+    DamonAttrs attrs = {.sample_us = 10000, .aggr_us = 200000};
+    DamonMonitor monitor(admin.path, attrs);
+    ASSERT_TRUE(monitor.IsSupported());
+    ASSERT_TRUE(monitor.Start({100, 200}));
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/nr_kdamonds"), "2");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/0/state"), "on");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/0/contexts/0/operations"), "vaddr");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/0/contexts/0/targets/0/pid_target"), "100");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/1/contexts/0/targets/0/pid_target"), "200");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/1/contexts/0/monitoring_attrs/intervals/aggr_us"),
+              "200000");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/1/contexts/0/schemes/0/action"), "stat");
+
+    // DAMON can only be used by one monitor at a time.
+    DamonMonitor other(admin.path);
+    EXPECT_FALSE(other.Start({300}));
+
+    // The regions of pid 200 as the kernel lists them, in address order.
+    std::string tried_regions = kdamonds + "/1/contexts/0/schemes/0/tried_regions";
+    std::vector<DamonRegion> expected = {
+            {.start = 0x1000, .end = 0x5000, .nr_accesses = 20, .age = 3},
+            {.start = 0x5000, .end = 0x9000, .nr_accesses = 2, .age = 1},
+            {.start = 0x9000, .end = 0x20000, .nr_accesses = 0, .age = 100},
+    };
+    for (size_t i = 0; i < expected.size(); i++) {
+        std::string region = ::android::base::StringPrintf("%s/%zu", tried_regions.c_str(), i);
+        ASSERT_TRUE(std::filesystem::create_directories(region));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(expected[i].start),
+                                                       region + "/start"));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(expected[i].end),
+                                                       region + "/end"));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(expected[i].nr_accesses),
+                                                       region + "/nr_accesses"));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(expected[i].age),
+                                                       region + "/age"));
+    }
+
+    std::vector<DamonRegion> regions;
+    ASSERT_TRUE(monitor.ReadRegions(200, &regions));
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/1/state"), "update_schemes_tried_regions");
+    ASSERT_EQ(regions.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(regions[i].start, expected[i].start);
+        EXPECT_EQ(regions[i].end, expected[i].end);
+        EXPECT_EQ(regions[i].nr_accesses, expected[i].nr_accesses);
+        EXPECT_EQ(regions[i].age, expected[i].age);
+    }
+    EXPECT_FALSE(monitor.ReadRegions(300, &regions));
+
+    // 20 of 20 samples is hot, 2 is warm, and 100 idle aggregation intervals of 200ms is
+    // cold. The regions span the gaps between the vmas, and don't reach the last one.
+    std::vector<Vma> vmas = {
+            Vma(0x0000, 0x3000, 0, PROT_READ, "", 0, false),
+            Vma(0x4000, 0x6000, 0, PROT_READ, "", 0, false),
+            Vma(0x8000, 0x10000, 0, PROT_READ, "", 0, false),
+            Vma(0x30000, 0x40000, 0, PROT_READ, "", 0, false),
+    };
+    std::vector<VmaHeat> heat;
+    ASSERT_TRUE(monitor.ReadVmaHeat(200, vmas, &heat));
+    ASSERT_EQ(heat.size(), vmas.size());
+    EXPECT_EQ(heat[0].hot_bytes, 0x2000);
+    EXPECT_EQ(heat[0].warm_bytes + heat[0].cold_bytes, 0);
+    EXPECT_EQ(heat[1].hot_bytes, 0x1000);
+    EXPECT_EQ(heat[1].warm_bytes, 0x1000);
+    EXPECT_EQ(heat[2].warm_bytes, 0x1000);
+    EXPECT_EQ(heat[2].cold_bytes, 0x7000);
+    EXPECT_EQ(heat[3].hot_bytes + heat[3].warm_bytes + heat[3].cold_bytes, 0);
+
+    ASSERT_TRUE(monitor.Stop());
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/nr_kdamonds"), "0");
+    EXPECT_EQ(ReadDamonFile(kdamonds + "/0/state"), "off");
+    EXPECT_TRUE(monitor.pids().empty());
+}
+
+TEST(WorkStealingPool, SpawnTest) {
+    WorkStealingPool pool(4);
+    ASSERT_EQ(pool.nr_workers(), 4);
+
+    // Every task spawns more tasks, all of them have to run exactly once.
+    std::vector<std::atomic<int>> runs(100 * 10);
+    std::vector<WorkStealingPool::Task> tasks;
+    for (int i = 0; i < 100; i++) {
+        tasks.emplace_back([&pool, &runs, i]() {
+            for (int j = 1; j < 10; j++) {
+                pool.Spawn([&runs, i, j]() { runs[i * 10 + j]++; });
+            }
+            runs[i * 10]++;
+        });
+    }
+    pool.Run(std::move(tasks));
+    for (const auto& nr_runs : runs) {
+        EXPECT_EQ(nr_runs, 1);
+    }
+
+    // The pool can be run again.
+    std::atomic<int> nr_runs = 0;
+    pool.Run({[&]() { nr_runs++; }});
+    EXPECT_EQ(nr_runs, 1);
+}
+
+TEST(WorkStealingPool, ReadProcessesUsageTest) {
+    // The usage of a stopped child doesn't change while it is read twice.
+    int ready[2];
+    ASSERT_EQ(pipe(ready), 0);
+    pid_t child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0) {
+        char c = 0;
+        TEMP_FAILURE_RETRY(write(ready[1], &c, 1));
+        pause();
+        _exit(0);
+    }
+    char c;
+    ASSERT_EQ(TEMP_FAILURE_RETRY(read(ready[0], &c, 1)), 1);
+    close(ready[0]);
+    close(ready[1]);
+    ASSERT_EQ(kill(child, SIGSTOP), 0);
+    ASSERT_EQ(waitpid(child, nullptr, WUNTRACED), child);
+
+    ProcMemInfo proc(child);
+    const MemUsage& expected = proc.Usage();
+    // Splitting the child into parts of 16 pages spreads it over all workers.
+    WorkStealingPool pool(3);
+    std::vector<ProcessUsage> usages;
+    ASSERT_TRUE(ReadProcessesUsageParallel({child, -1, pid}, &pool, &usages, 16));
+
+    kill(child, SIGKILL);
+    ASSERT_EQ(waitpid(child, nullptr, 0), child);
+
+    // The pid that doesn't exist is skipped, the others are in order.
+    ASSERT_EQ(usages.size(), 2);
+    EXPECT_EQ(usages[0].pid, child);
+    EXPECT_EQ(usages[1].pid, pid);
+    EXPECT_EQ(usages[0].usage.vss, expected.vss);
+    EXPECT_EQ(usages[0].usage.rss, expected.rss);
+    EXPECT_EQ(usages[0].usage.swap, expected.swap);
+    EXPECT_GT(usages[0].usage.pss, 0);
+    EXPECT_GT(usages[1].usage.pss, 0);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     ::android::base::InitLogging(argv, android::base::StderrLogger);
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include <capture.h>
+#include <processrecord.h>
+#include <smapinfo.h>
+
+namespace android {
+namespace smapinfo {
+
+using ::android::base::StringPrintf;
+
+// The archive starts with this line, followed by one entry per file: a "<path> <size>\n"
+// header and the <size> bytes of the file. Paths are relative to the root of the system
+// the files were captured from.
+static constexpr char kCaptureMagic[] = "meminfo-capture 1\n";
+
+// Files read for every process, in the order they are written.
+static constexpr const char* kProcessFiles[] = {
+        "cmdline", "comm", "oom_score_adj", "stat", "status", "maps", "smaps",
+};
+
+namespace {
+
+class ArchiveWriter {
+    // Appends files to the archive. Entries may be added from several threads.
+  public:
+    explicit ArchiveWriter(FILE* fp) : fp_(fp), failed_(false) {}
+
+    void Add(const std::string& path, const std::string& content) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ |= fprintf(fp_, "%s %zu\n", path.c_str(), content.size()) < 0;
+        failed_ |= fwrite(content.data(), 1, content.size(), fp_) != content.size();
+    }
+
+    bool failed() const { return failed_; }
+
+  private:
+    FILE* fp_;
+    std::mutex mutex_;
+    bool failed_;
+};
+
+}  // namespace
+
+// Adds the file at /<path> to the archive. Returns false if it could not be read.
+static bool capture_file(ArchiveWriter* writer, const std::string& path) {
+    std::string content;
+    if (!::android::base::ReadFileToString("/" + path, &content)) {
+        return false;
+    }
+    writer->Add(path, content);
+    return true;
+}
+
+// Adds the fdinfo of the file descriptors of 'pid' that refer to a dmabuf.
+static void capture_dmabuf_fdinfo(ArchiveWriter* writer, pid_t pid) {
+    std::string fd_dir = StringPrintf("/proc/%d/fd", pid);
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(fd_dir.c_str()), closedir);
+    if (!dir) return;
+
+    struct dirent* dent;
+    int fd;
+    while ((dent = readdir(dir.get()))) {
+        if (!::android::base::ParseInt(dent->d_name, &fd)) continue;
+        std::string target;
+        if (!::android::base::Readlink(fd_dir + "/" + dent->d_name, &target) ||
+            !::android::base::StartsWith(target, "/dmabuf")) {
+            continue;
+        }
+        capture_file(writer, StringPrintf("proc/%d/fdinfo/%d", pid, fd));
+    }
+}
+
+static void capture_process(ArchiveWriter* writer, pid_t pid, bool mmless) {
+    // The files are only added once all of them are read, so that a process that exits
+    // while it is captured is left out rather than replayed without its maps.
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const char* file : kProcessFiles) {
+        std::string path = StringPrintf("proc/%d/%s", pid, file);
+        bool is_maps = !strcmp(file, "maps") || !strcmp(file, "smaps");
+        // Kernel threads and zombies have no maps, there is nothing to read but an empty
+        // file, which is written anyway so that the process is complete in the capture.
+        if (mmless && is_maps) {
+            files.emplace_back(path, "");
+            continue;
+        }
+        std::string content;
+        if (!::android::base::ReadFileToString("/" + path, &content)) {
+            if (is_maps || !strcmp(file, "cmdline")) {
+                // The process exited.
+                return;
+            }
+            continue;
+        }
+        if (is_maps && content.empty()) {
+            // The process became a zombie.
+            return;
+        }
+        files.emplace_back(std::move(path), std::move(content));
+    }
+
+    for (const auto& [path, content] : files) {
+        writer->Add(path, content);
+    }
+    if (!mmless) {
+        capture_dmabuf_fdinfo(writer, pid);
+    }
+}
+
+bool capture_procfs(const std::string& archive_path, unsigned int nr_threads, std::ostream& err) {
+    std::set<pid_t> pids;
+    std::set<pid_t> mmless_pids;
+    if (!get_all_pids(&pids, &mmless_pids)) {
+        err << "Failed to get all pids\n";
+        return false;
+    }
+
+    auto fp = std::unique_ptr<FILE, decltype(&fclose)>{fopen(archive_path.c_str(), "we"), fclose};
+    if (!fp) {
+        err << "Failed to create " << archive_path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    if (fputs(kCaptureMagic, fp.get()) < 0) {
+        err << "Failed to write " << archive_path << "\n";
+        return false;
+    }
+    ArchiveWriter writer(fp.get());
+
+    capture_file(&writer, "proc/meminfo");
+    for (uint32_t i = 0;; i++) {
+        // zram devices are numbered in sequence, see SysMemInfo::mem_zram_kb.
+        if (!capture_file(&writer, StringPrintf("sys/block/zram%u/mm_stat", i))) break;
+    }
+
+    std::vector<std::pair<pid_t, bool>> procs;
+    for (pid_t pid : pids) procs.emplace_back(pid, false);
+    for (pid_t pid : mmless_pids) procs.emplace_back(pid, true);
+
+    // Reading smaps dominates the capture and doesn't contend between processes, so
+    // processes are read in parallel.
+    if (nr_threads == 0) {
+        nr_threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    nr_threads = std::min<size_t>(nr_threads, procs.size());
+    std::atomic<size_t> next = 0;
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < procs.size()) {
+            capture_process(&writer, procs[i].first, procs[i].second);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < nr_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (writer.failed() || fflush(fp.get())) {
+        err << "Failed to write " << archive_path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool extract_capture(const std::string& archive_path, const std::string& root, std::ostream& err) {
+    std::string archive;
+    if (!::android::base::ReadFileToString(archive_path, &archive)) {
+        err << "Failed to read " << archive_path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    if (!::android::base::StartsWith(archive, kCaptureMagic)) {
+        err << archive_path << " is not a capture\n";
+        return false;
+    }
+
+    for (size_t pos = strlen(kCaptureMagic); pos < archive.size();) {
+        size_t eol = archive.find('\n', pos);
+        size_t space = archive.rfind(' ', eol);
+        size_t size;
+        if (eol == std::string::npos || space == std::string::npos || space < pos ||
+            !::android::base::ParseUint(archive.substr(space + 1, eol - space - 1), &size) ||
+            size > archive.size() - eol - 1) {
+            err << "Malformed capture " << archive_path << " at offset " << pos << "\n";
+            return false;
+        }
+        std::string path = archive.substr(pos, space - pos);
+        if (path.empty() || path[0] == '/' || path.find("..") != std::string::npos) {
+            err << "Invalid path '" << path << "' in capture " << archive_path << "\n";
+            return false;
+        }
+
+        std::filesystem::path file = std::filesystem::path(root) / path;
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
+        if (ec || !::android::base::WriteStringToFile(archive.substr(eol + 1, size), file.string())) {
+            err << "Failed to write " << file.string() << "\n";
+            return false;
+        }
+        pos = eol + 1 + size;
+    }
+    return true;
+}
+
+bool create_capture_processrecords(const std::string& root, std::set<pid_t>* pids,
+                                   std::map<pid_t, ProcessRecord>* processrecords,
+                                   std::ostream& err) {
+    std::string procfs_path = root + "/proc";
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(procfs_path.c_str()), closedir);
+    if (!dir) {
+        err << "Failed to open " << procfs_path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    struct dirent* dent;
+    pid_t pid;
+    while ((dent = readdir(dir.get()))) {
+        if (!::android::base::ParseInt(dent->d_name, &pid)) continue;
+        ProcessRecord proc(pid, false, 0, 0, true, true, err, true, procfs_path);
+        // Processes without maps are dropped, as their maps would be read again from the
+        // process with the same pid on this system.
+        if (!proc.valid() || proc.Usage(false).vss == 0) continue;
+        pids->insert(pid);
+        processrecords->emplace(pid, std::move(proc));
+    }
+    return true;
+}
+
+}  // namespace smapinfo
+}  // namespace android
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+
+#include <processrecord.h>
+
+namespace android {
+namespace smapinfo {
+
+// Captures the files that procrank, librank, showmap and dmabuf_dump read into a single
+// archive at 'archive_path', so that they can be analyzed on another machine:
+// a) cmdline, comm, oom_score_adj, stat, status, maps and smaps of all processes,
+// b) fdinfo of the file descriptors of all processes that refer to a dmabuf,
+// c) /proc/meminfo and the mm_stat of all zram devices.
+// Processes are read by 'nr_threads' threads, or one per cpu if 'nr_threads' is 0.
+// Processes that exit during the capture are skipped. Returns false if the archive could
+// not be written.
+bool capture_procfs(const std::string& archive_path, unsigned int nr_threads, std::ostream& err);
+
+// Unpacks an archive written by capture_procfs() into the 'root' directory, keeping the
+// paths of the captured files, e.g. <root>/proc/<pid>/smaps. The smaps of a process can
+// then be read by any tool that reads smaps from a file, e.g. ExtractAndroidHeapStatsFromFile.
+// Returns false if the archive is malformed or the files could not be written.
+bool extract_capture(const std::string& archive_path, const std::string& root, std::ostream& err);
+
+// Creates a ProcessRecord from the files of each process with memory mappings in a capture
+// unpacked at 'root', and adds its pid to 'pids'. The records can be passed to run_procrank,
+// run_librank and run_showmap, together with 'pids', to analyze the capture.
+bool create_capture_processrecords(const std::string& root, std::set<pid_t>* pids,
+                                   std::map<pid_t, ProcessRecord>* processrecords,
+                                   std::ostream& err);
+
+}  // namespace smapinfo
+}  // namespace android
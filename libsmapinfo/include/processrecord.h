@@ -32,8 +32,16 @@ namespace smapinfo {
 
 class ProcessRecord final {
   public:
+    // If 'get_usage' is false, the maps and usage of the process are not read, only
+    // ForEachMatchingVma() can be used to read the usage of some of its maps.
+    //
+    // If 'procfs_path' is not /proc, the files of the process were captured from another
+    // system and only its smaps is read: 'get_wss', 'pgflags' and 'pgflags_mask' are
+    // ignored and there are no swap offsets. The proportional swap is then the SwapPss of
+    // the smaps, and there is no unique swap.
     ProcessRecord(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t pgflags_mask,
-                  bool get_cmdline, bool get_oomadj, std::ostream& err);
+                  bool get_cmdline, bool get_oomadj, std::ostream& err, bool get_usage = true,
+                  const std::string& procfs_path = "/proc");
 
     bool valid() const;
     void CalculateSwap(const std::vector<uint16_t>& swap_offset_array,
@@ -57,6 +65,10 @@ class ProcessRecord final {
     bool ForEachExistingVma(const ::android::meminfo::VmaCallback& callback) {
         return procmem_.ForEachExistingVma(callback);
     }
+    bool ForEachMatchingVma(const ::android::meminfo::VmaPredicate& predicate,
+                            const ::android::meminfo::VmaCallback& callback) {
+        return procmem_.ForEachMatchingVma(predicate, callback);
+    }
 
   private:
     ::android::meminfo::ProcMemInfo procmem_;
@@ -66,6 +78,8 @@ class ProcessRecord final {
     uint64_t proportional_swap_;
     uint64_t unique_swap_;
     uint64_t zswap_;
+    // The process was read from a capture.
+    bool captured_;
     ::android::meminfo::MemUsage usage_or_wss_;
     std::vector<uint64_t> swap_offsets_;
 };
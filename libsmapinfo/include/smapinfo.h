@@ -32,19 +32,24 @@ namespace smapinfo {
 // The user-specified order to sort processes.
 enum class SortOrder { BY_PSS = 0, BY_RSS, BY_USS, BY_VSS, BY_SWAP, BY_OOMADJ };
 
-// Populates the input set with all pids present in the /proc directory. Only
+// Populates the input set with all pids present in the /proc directory. If 'mmless_pids'
+// is not null, kernel threads and zombies are found from /proc/<pid>/stat and added to
+// 'mmless_pids' instead of 'pids', so that their memory usage is never read. Only
 // returns false if /proc could not be opened, returns true otherwise.
-bool get_all_pids(std::set<pid_t>* pids);
+bool get_all_pids(std::set<pid_t>* pids, std::set<pid_t>* mmless_pids = nullptr);
 
 // Sorts processes provided in 'pids' by memory usage (or oomadj score) and
-// prints them. Returns false in the following failure cases:
+// prints them. If 'capture_root' is not empty, system memory information is read
+// from the capture unpacked there, see extract_capture(), and the proportional swap
+// of each process is its SwapPss, without a unique swap column. Returns false in the
+// following failure cases:
 // a) system memory information could not be read,
 // b) swap offsets could not be counted for some process,
 // c) reset_wss is true but the working set for some process could not be reset.
 bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>& pids,
                   bool get_oomadj, bool get_wss, SortOrder sort_order, bool reverse_sort,
                   std::map<pid_t, ProcessRecord>* processrecords_ptr, std::ostream& out,
-                  std::ostream& err);
+                  std::ostream& err, const std::string& capture_root = "");
 
 // Sorts libraries used by processes in 'pids' by memory usage and prints them.
 // Returns false if any process's usage info could not be read.
@@ -63,6 +68,30 @@ bool run_showmap(pid_t pid, const std::string& filename, bool terse, bool verbos
                  std::map<pid_t, ProcessRecord>* processrecords_ptr, std::ostream& out,
                  std::ostream& err);
 
+// Prints the transparent huge page usage of each process in 'pids', sorted by the memory
+// mapped with huge pages. If 'get_bloat' is true, partially mapped huge pages are also
+// found through pagemap, which requires root.
+bool run_procrank_thp(const std::set<pid_t>& pids, bool get_bloat, std::ostream& out,
+                      std::ostream& err);
+
+// Prints the kernel threads and zombies in 'pids' with their parent and state. Only
+// /proc/<pid>/stat is read, processes that have a user address space are skipped.
+bool run_procrank_mmless(const std::set<pid_t>& pids, std::ostream& out, std::ostream& err);
+
+// Prints how well the anonymous memory of each process in 'pids' compresses, and the
+// zram used by its swapped out memory estimated from it and its SwapPss, sorted by the
+// latter. At most 'page_budget' resident anonymous pages of each process are read and
+// compressed with LZ4, see PageContentSampler. Processes with no page to sample are
+// shown with the compression ratio of all of zram, and "-" as its error. Requires ptrace
+// access to the processes.
+bool run_procrank_zram(const std::set<pid_t>& pids, uint64_t page_budget, std::ostream& out,
+                       std::ostream& err);
+
+// Prints the transparent huge page usage of each vma of 'pid', read from 'filename'. Bloat
+// is only reported if 'get_bloat' is true and 'pid' is a live process.
+bool run_showmap_thp(pid_t pid, const std::string& filename, bool get_bloat, bool quiet,
+                     std::ostream& out, std::ostream& err);
+
 // Runs procrank, librank, and showmap with a single read of smaps. Default
 // arguments are used for all tools (except quiet output for showmap). This
 // prints output that is specifically meant to be included in bug reports.
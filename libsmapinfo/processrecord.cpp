@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <linux/oom.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <string>
@@ -40,16 +41,18 @@ using ::android::meminfo::Vma;
 using ::android::meminfo::VmaCallback;
 
 ProcessRecord::ProcessRecord(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t pgflags_mask,
-                             bool get_cmdline, bool get_oomadj, std::ostream& err)
+                             bool get_cmdline, bool get_oomadj, std::ostream& err,
+                             bool get_usage, const std::string& procfs_path)
     : procmem_(pid, get_wss, pgflags, pgflags_mask),
       pid_(-1),
       oomadj_(OOM_SCORE_ADJ_MAX + 1),
       proportional_swap_(0),
       unique_swap_(0),
-      zswap_(0) {
+      zswap_(0),
+      captured_(procfs_path != "/proc") {
     // cmdline_ only needs to be populated if this record will be used by procrank/librank.
     if (get_cmdline) {
-        std::string fname = StringPrintf("/proc/%d/cmdline", pid);
+        std::string fname = StringPrintf("%s/%d/cmdline", procfs_path.c_str(), pid);
         if (!::android::base::ReadFileToString(fname, &cmdline_)) {
             err << "Failed to read cmdline from: " << fname << "\n";
             cmdline_ = "<unknown>";
@@ -64,7 +67,7 @@ ProcessRecord::ProcessRecord(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t
         // If there is no cmdline (empty, not <unknown>), a kernel thread will have comm. This only
         // matters for bug reports, which output 'SHOW MAP <pid>: <cmdline>' as section titles.
         if (cmdline_.empty()) {
-            fname = StringPrintf("/proc/%d/comm", pid);
+            fname = StringPrintf("%s/%d/comm", procfs_path.c_str(), pid);
             if (!::android::base::ReadFileToString(fname, &cmdline_)) {
                 err << "Failed to read comm from: " << fname << "\n";
             }
@@ -79,7 +82,7 @@ ProcessRecord::ProcessRecord(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t
 
     // oomadj_ only needs to be populated if this record will be used by procrank/librank.
     if (get_oomadj) {
-        std::string fname = StringPrintf("/proc/%d/oom_score_adj", pid);
+        std::string fname = StringPrintf("%s/%d/oom_score_adj", procfs_path.c_str(), pid);
         std::string oom_score;
         if (!::android::base::ReadFileToString(fname, &oom_score)) {
             err << "Failed to read oom_score_adj file: " << fname << "\n";
@@ -91,6 +94,31 @@ ProcessRecord::ProcessRecord(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t
         }
     }
 
+    if (!get_usage) {
+        pid_ = pid;
+        return;
+    }
+
+    if (captured_) {
+        // Nothing but smaps can be read from a capture. Usage() would fall back to reading
+        // the pagemap of 'pid' on this system if there are no maps, so it isn't called then.
+        std::string fname = StringPrintf("%s/%d/smaps", procfs_path.c_str(), pid);
+        if (access(fname.c_str(), R_OK)) {
+            err << "Failed to read smaps file: " << fname << "\n";
+            return;
+        }
+        const std::vector<Vma>& maps = procmem_.Smaps(fname, true, false);
+        if (!maps.empty()) {
+            usage_or_wss_ = procmem_.Usage();
+        }
+        // Without the swap offsets, the kernel's SwapPss is the proportional swap.
+        for (const Vma& vma : maps) {
+            proportional_swap_ += vma.usage.swap_pss;
+        }
+        pid_ = pid;
+        return;
+    }
+
     // We generally want to use Smaps() to populate procmem_'s maps before calling Wss() or
     // Usage(), as these will fall back on the slower ReadMaps(). However, ReadMaps() must be
     // used if page flags are inspected, as Smaps() does not have per-page granularity.
@@ -108,6 +136,10 @@ bool ProcessRecord::valid() const {
 
 void ProcessRecord::CalculateSwap(const std::vector<uint16_t>& swap_offset_array,
                                   float zram_compression_ratio) {
+    if (captured_) {
+        zswap_ = proportional_swap_ * zram_compression_ratio;
+        return;
+    }
     for (auto& off : swap_offsets_) {
         proportional_swap_ += getpagesize() / swap_offset_array[off];
         unique_swap_ += swap_offset_array[off] == 1 ? getpagesize() : 0;
@@ -20,18 +20,22 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <meminfo/pagecontent.h>
+#include <meminfo/procstat.h>
 #include <meminfo/sysmeminfo.h>
 
 #include <processrecord.h>
@@ -44,23 +48,50 @@ using ::android::base::StringPrintf;
 using ::android::meminfo::EscapeCsvString;
 using ::android::meminfo::EscapeJsonString;
 using ::android::meminfo::Format;
+using ::android::meminfo::IsKernelThread;
+using ::android::meminfo::IsMmlessTask;
 using ::android::meminfo::MemUsage;
+using ::android::meminfo::ProcStat;
+using ::android::meminfo::ProcStatFromFile;
+using ::android::meminfo::ThpUsage;
 using ::android::meminfo::Vma;
 
-bool get_all_pids(std::set<pid_t>* pids) {
+bool get_all_pids(std::set<pid_t>* pids, std::set<pid_t>* mmless_pids) {
     pids->clear();
+    if (mmless_pids) mmless_pids->clear();
     std::unique_ptr<DIR, int (*)(DIR*)> procdir(opendir("/proc"), closedir);
     if (!procdir) return false;
 
     struct dirent* dir;
     pid_t pid;
+    ProcStat stat;
     while ((dir = readdir(procdir.get()))) {
         if (!::android::base::ParseInt(dir->d_name, &pid)) continue;
-        pids->insert(pid);
+        if (!mmless_pids) {
+            pids->insert(pid);
+            continue;
+        }
+        // Skip processes that exited in the meantime.
+        if (!ProcStatFromFile(StringPrintf("/proc/%d/stat", pid), &stat)) continue;
+        if (IsMmlessTask(stat)) {
+            mmless_pids->insert(pid);
+        } else {
+            pids->insert(pid);
+        }
     }
     return true;
 }
 
+// Returns the command of 'pid' without its arguments, or "<unknown>".
+static std::string read_cmdline(pid_t pid) {
+    std::string cmdline;
+    if (!::android::base::ReadFileToString(StringPrintf("/proc/%d/cmdline", pid), &cmdline)) {
+        return "<unknown>";
+    }
+    cmdline.resize(strlen(cmdline.c_str()));
+    return cmdline;
+}
+
 namespace procrank {
 
 static bool count_swap_offsets(const ProcessRecord& proc, std::vector<uint16_t>& swap_offset_array,
@@ -94,6 +125,8 @@ struct params {
     bool show_oomadj;
     bool show_wss;
     bool swap_enabled;
+    // Unique swap needs the swap offsets of the processes, which a capture doesn't have.
+    bool show_uswap;
     bool zram_enabled;
 
     // If zram is enabled, the compression ratio is zram used / swap used.
@@ -203,7 +236,10 @@ static void print_header(struct params* params, std::ostream& out) {
         // Swap statistics here, as working set pages by definition shouldn't end up in swap.
         out << StringPrintf("%8s  %7s  %7s  %7s  ", "Vss", "Rss", "Pss", "Uss");
         if (params->swap_enabled) {
-            out << StringPrintf("%7s  %7s  %7s  ", "Swap", "PSwap", "USwap");
+            out << StringPrintf("%7s  %7s  ", "Swap", "PSwap");
+            if (params->show_uswap) {
+                out << StringPrintf("%7s  ", "USwap");
+            }
             if (params->zram_enabled) {
                 out << StringPrintf("%7s  ", "ZSwap");
             }
@@ -224,7 +260,10 @@ static void print_divider(struct params* params, std::ostream& out) {
     } else {
         out << StringPrintf("%8s  %7s  %7s  %7s  ", "", "", "------", "------");
         if (params->swap_enabled) {
-            out << StringPrintf("%7s  %7s  %7s  ", "------", "------", "------");
+            out << StringPrintf("%7s  %7s  ", "------", "------");
+            if (params->show_uswap) {
+                out << StringPrintf("%7s  ", "------");
+            }
             if (params->zram_enabled) {
                 out << StringPrintf("%7s  ", "------");
             }
@@ -251,7 +290,9 @@ static void print_processrecord(struct params* params, ProcessRecord& proc, std:
         if (params->swap_enabled) {
             out << StringPrintf("%6" PRIu64 "K  ", proc.Usage(params->show_wss).swap);
             out << StringPrintf("%6" PRIu64 "K  ", proc.proportional_swap());
-            out << StringPrintf("%6" PRIu64 "K  ", proc.unique_swap());
+            if (params->show_uswap) {
+                out << StringPrintf("%6" PRIu64 "K  ", proc.unique_swap());
+            }
             if (params->zram_enabled) {
                 out << StringPrintf("%6" PRIu64 "K  ", proc.zswap());
             }
@@ -275,7 +316,9 @@ static void print_totals(struct params* params, std::ostream& out) {
         if (params->swap_enabled) {
             out << StringPrintf("%6" PRIu64 "K  ", params->total_swap);
             out << StringPrintf("%6" PRIu64 "K  ", params->total_pswap);
-            out << StringPrintf("%6" PRIu64 "K  ", params->total_uswap);
+            if (params->show_uswap) {
+                out << StringPrintf("%6" PRIu64 "K  ", params->total_uswap);
+            }
             if (params->zram_enabled) {
                 out << StringPrintf("%6" PRIu64 "K  ", params->total_zswap);
             }
@@ -285,11 +328,11 @@ static void print_totals(struct params* params, std::ostream& out) {
 }
 
 static void print_sysmeminfo(struct params* params, const ::android::meminfo::SysMemInfo& smi,
-                             std::ostream& out) {
+                             uint64_t zram_kb, std::ostream& out) {
     if (params->swap_enabled) {
         out << StringPrintf("ZRAM: %" PRIu64 "K physical used for %" PRIu64 "K in swap (%" PRIu64
                             "K total swap)\n",
-                            smi.mem_zram_kb(), (smi.mem_swap_kb() - smi.mem_swap_free_kb()),
+                            zram_kb, (smi.mem_swap_kb() - smi.mem_swap_free_kb()),
                             smi.mem_swap_kb());
     }
 
@@ -299,6 +342,22 @@ static void print_sysmeminfo(struct params* params, const ::android::meminfo::Sy
                         smi.mem_cached_kb(), smi.mem_shmem_kb(), smi.mem_slab_kb());
 }
 
+// Returns the memory used by all zram devices, either of this system or of the capture
+// unpacked at 'capture_root'.
+static uint64_t read_zram_kb(const ::android::meminfo::SysMemInfo& smi,
+                             const std::string& capture_root) {
+    if (capture_root.empty()) {
+        return smi.mem_zram_kb();
+    }
+    uint64_t zram_kb = 0;
+    for (uint32_t i = 0;; i++) {
+        std::string zram_dev = StringPrintf("%s/sys/block/zram%u", capture_root.c_str(), i);
+        if (access(zram_dev.c_str(), F_OK)) break;
+        zram_kb += smi.mem_zram_kb(zram_dev.c_str());
+    }
+    return zram_kb;
+}
+
 static void add_to_totals(struct params* params, ProcessRecord& proc,
                           const std::vector<uint16_t>& swap_offset_array) {
     params->total_pss += proc.Usage(params->show_wss).pss;
@@ -319,9 +378,10 @@ static void add_to_totals(struct params* params, ProcessRecord& proc,
 bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>& pids,
                   bool get_oomadj, bool get_wss, SortOrder sort_order, bool reverse_sort,
                   std::map<pid_t, ProcessRecord>* processrecords_ptr, std::ostream& out,
-                  std::ostream& err) {
+                  std::ostream& err, const std::string& capture_root) {
     ::android::meminfo::SysMemInfo smi;
-    if (!smi.ReadMemInfo()) {
+    std::string meminfo_path = capture_root + "/proc/meminfo";
+    if (!smi.ReadMemInfo(meminfo_path.c_str())) {
         err << "Failed to get system memory info\n";
         return false;
     }
@@ -336,6 +396,7 @@ bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>
             .show_oomadj = get_oomadj,
             .show_wss = get_wss,
             .swap_enabled = false,
+            .show_uswap = capture_root.empty(),
             .zram_enabled = false,
             .zram_compression_ratio = 0.0,
     };
@@ -345,10 +406,12 @@ bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>
     params.swap_enabled = swap_total > 0;
     // Allocate the swap array.
     std::vector<uint16_t> swap_offset_array(swap_total / getpagesize() + 1, 0);
+    uint64_t zram_kb = 0;
     if (params.swap_enabled) {
-        params.zram_enabled = smi.mem_zram_kb() > 0;
+        zram_kb = procrank::read_zram_kb(smi, capture_root);
+        params.zram_enabled = zram_kb > 0;
         if (params.zram_enabled) {
-            params.zram_compression_ratio = static_cast<float>(smi.mem_zram_kb()) /
+            params.zram_compression_ratio = static_cast<float>(zram_kb) /
                                             (smi.mem_swap_kb() - smi.mem_swap_free_kb());
         }
     }
@@ -366,7 +429,7 @@ bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>
         //   procrank -w -s -k
         //   procrank -w -o -k
         out << "<empty>\n\n";
-        procrank::print_sysmeminfo(&params, smi, out);
+        procrank::print_sysmeminfo(&params, smi, zram_kb, out);
         return true;
     }
 
@@ -390,7 +453,7 @@ bool run_procrank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>
 
     procrank::print_divider(&params, out);
     procrank::print_totals(&params, out);
-    procrank::print_sysmeminfo(&params, smi, out);
+    procrank::print_sysmeminfo(&params, smi, zram_kb, out);
 
     return true;
 }
@@ -411,81 +474,95 @@ static void add_mem_usage(MemUsage* to, const MemUsage& from) {
     to->shared_dirty += from.shared_dirty;
 }
 
+// A process in the process table of librank. Libraries refer to processes by their index
+// in the table, so the cmdline of each process is only copied once.
+struct LibProc {
+    pid_t pid;
+    int32_t oomadj;
+    std::string cmdline;
+};
+
 // Represents a specific process's usage of a library.
-struct LibProcRecord {
-  public:
-    LibProcRecord(ProcessRecord& proc) : pid_(-1), oomadj_(OOM_SCORE_ADJ_MAX + 1) {
-        pid_ = proc.pid();
-        cmdline_ = proc.cmdline();
-        oomadj_ = proc.oomadj();
-        usage_.clear();
-    }
-
-    bool valid() const { return pid_ != -1; }
-    void AddUsage(const MemUsage& mem_usage) { add_mem_usage(&usage_, mem_usage); }
-
-    // Getters
-    pid_t pid() const { return pid_; }
-    const std::string& cmdline() const { return cmdline_; }
-    int32_t oomadj() const { return oomadj_; }
-    const MemUsage& usage() const { return usage_; }
-
-  private:
-    pid_t pid_;
-    std::string cmdline_;
-    int32_t oomadj_;
-    MemUsage usage_;
+struct LibProcUsage {
+    // Index of the process in LibTable::procs.
+    uint32_t proc;
+    MemUsage usage;
 };
 
 // Represents all processes' usage of a specific library.
 struct LibRecord {
-  public:
-    LibRecord(const std::string& name) : name_(name) {}
+    // Points to the key of the library in LibTable::lib_ids.
+    const std::string* name;
+    MemUsage usage;
+    // Sorted by process index, as processes are added one after the other.
+    std::vector<LibProcUsage> procs;
+};
+
+// Usage of all libraries by all processes, as a sparse library x process matrix with one
+// row per library.
+struct LibTable {
+    std::vector<LibProc> procs;
+    std::vector<LibRecord> libs;
+    // Index of each library in 'libs'.
+    std::unordered_map<std::string, uint32_t> lib_ids;
+};
+
+static uint32_t add_proc(LibTable* table, const ProcessRecord& proc) {
+    table->procs.push_back({
+            .pid = proc.pid(),
+            .oomadj = proc.oomadj(),
+            .cmdline = proc.cmdline(),
+    });
+    return table->procs.size() - 1;
+}
 
-    void AddUsage(const LibProcRecord& proc, const MemUsage& mem_usage) {
-        auto [it, inserted] = procs_.insert(std::pair<pid_t, LibProcRecord>(proc.pid(), proc));
-        // Adds to proc's PID's contribution to usage of this lib, as well as total lib usage.
-        it->second.AddUsage(mem_usage);
-        add_mem_usage(&usage_, mem_usage);
+static void add_lib_usage(LibTable* table, uint32_t proc, const Vma& map) {
+    auto [it, inserted] = table->lib_ids.try_emplace(map.name, table->libs.size());
+    if (inserted) {
+        table->libs.push_back({.name = &it->first});
+        table->libs.back().usage.clear();
     }
-    uint64_t pss() const { return usage_.pss; }
 
-    // Getters
-    const std::string& name() const { return name_; }
-    const std::map<pid_t, LibProcRecord>& processes() const { return procs_; }
+    // Adds to the process's contribution to usage of this lib, as well as total lib usage.
+    LibRecord& lib = table->libs[it->second];
+    if (lib.procs.empty() || lib.procs.back().proc != proc) {
+        lib.procs.push_back({.proc = proc});
+        lib.procs.back().usage.clear();
+    }
+    add_mem_usage(&lib.procs.back().usage, map.usage);
+    add_mem_usage(&lib.usage, map.usage);
+}
 
-  private:
-    std::string name_;
-    MemUsage usage_;
-    std::map<pid_t, LibProcRecord> procs_;
-};
+using LibProcSort = std::function<bool(const LibProcUsage& a, const LibProcUsage& b)>;
 
-static std::function<bool(LibProcRecord& a, LibProcRecord& b)> select_sort(SortOrder sort_order) {
+static LibProcSort select_sort(SortOrder sort_order, const std::vector<LibProc>& procs) {
     // Create sort function based on sort_order.
-    std::function<bool(LibProcRecord & a, LibProcRecord & b)> proc_sort;
+    LibProcSort proc_sort;
     switch (sort_order) {
         case (SortOrder::BY_RSS):
-            proc_sort = [](LibProcRecord& a, LibProcRecord& b) {
-                return a.usage().rss > b.usage().rss;
+            proc_sort = [](const LibProcUsage& a, const LibProcUsage& b) {
+                return a.usage.rss > b.usage.rss;
             };
             break;
         case (SortOrder::BY_USS):
-            proc_sort = [](LibProcRecord& a, LibProcRecord& b) {
-                return a.usage().uss > b.usage().uss;
+            proc_sort = [](const LibProcUsage& a, const LibProcUsage& b) {
+                return a.usage.uss > b.usage.uss;
             };
             break;
         case (SortOrder::BY_VSS):
-            proc_sort = [](LibProcRecord& a, LibProcRecord& b) {
-                return a.usage().vss > b.usage().vss;
+            proc_sort = [](const LibProcUsage& a, const LibProcUsage& b) {
+                return a.usage.vss > b.usage.vss;
             };
             break;
         case (SortOrder::BY_OOMADJ):
-            proc_sort = [](LibProcRecord& a, LibProcRecord& b) { return a.oomadj() > b.oomadj(); };
+            proc_sort = [&procs](const LibProcUsage& a, const LibProcUsage& b) {
+                return procs[a.proc].oomadj > procs[b.proc].oomadj;
+            };
             break;
         case (SortOrder::BY_PSS):
         default:
-            proc_sort = [](LibProcRecord& a, LibProcRecord& b) {
-                return a.usage().pss > b.usage().pss;
+            proc_sort = [](const LibProcUsage& a, const LibProcUsage& b) {
+                return a.usage.pss > b.usage.pss;
             };
             break;
     }
@@ -506,9 +583,74 @@ struct params {
 };
 
 static bool populate_libs(struct params* params, uint64_t pgflags, uint64_t pgflags_mask,
-                          const std::set<pid_t>& pids,
-                          std::map<std::string, LibRecord>& lib_name_map,
+                          const std::set<pid_t>& pids, LibTable* table,
                           std::map<pid_t, ProcessRecord>* processrecords_ptr, std::ostream& err) {
+    auto match_map = [params](const Vma& map) {
+        // Skip library/map if the prefix for the path doesn't match.
+        if (!params->lib_prefix.empty() &&
+            !::android::base::StartsWith(map.name, params->lib_prefix)) {
+            return false;
+        }
+        // Skip excluded library/map names.
+        if (!params->all_libs &&
+            (std::find(params->excluded_libs.begin(), params->excluded_libs.end(), map.name) !=
+             params->excluded_libs.end())) {
+            return false;
+        }
+        // Skip maps based on map permissions.
+        if (params->mapflags_mask &&
+            ((map.flags & (PROT_READ | PROT_WRITE | PROT_EXEC)) != params->mapflags_mask)) {
+            return false;
+        }
+        return true;
+    };
+    auto add_map = [params, table](uint32_t proc, const Vma& map) {
+        // Add memory for lib usage.
+        add_lib_usage(table, proc, map);
+
+        if (!params->swap_enabled && map.usage.swap) {
+            params->swap_enabled = true;
+        }
+    };
+
+    // When only the libraries with a given prefix are shown, read the usage of the matching
+    // maps only instead of the usage of all maps. Process records passed in by the caller are
+    // shared with other tools though, so they need the usage of all maps anyway.
+    if (!params->lib_prefix.empty() && !processrecords_ptr) {
+        for (pid_t pid : pids) {
+            ProcessRecord proc(pid, false, pgflags, pgflags_mask, true, params->show_oomadj, err,
+                               false);
+            if (!proc.valid()) {
+                err << "error: failed to create process record for: " << pid << "\n";
+                return false;
+            }
+
+            // The usage of a process is only added once all its matching maps are read, so
+            // that a failure part way doesn't leave partial library totals behind.
+            std::vector<Vma> maps;
+            if (!proc.ForEachMatchingVma(match_map, [&](Vma& map) {
+                    maps.emplace_back(map);
+                    return true;
+                })) {
+                // Skip processes that were killed in the meantime.
+                std::string procdir = StringPrintf("/proc/%d", pid);
+                if (access(procdir.c_str(), F_OK | R_OK)) continue;
+                err << "warning: failed to read the maps of: " << pid << "\n";
+                continue;
+            }
+            // Processes may have no maps at all, e.g. kernel threads.
+            if (maps.empty()) {
+                continue;
+            }
+
+            uint32_t record = add_proc(table, proc);
+            for (const Vma& map : maps) {
+                add_map(record, map);
+            }
+        }
+        return true;
+    }
+
     // Fall back to using an empty map of ProcessRecords if nullptr was passed in.
     std::map<pid_t, ProcessRecord> processrecords;
     if (!processrecords_ptr) {
@@ -535,31 +677,10 @@ static bool populate_libs(struct params* params, uint64_t pgflags, uint64_t pgfl
             continue;
         }
 
-        LibProcRecord record(proc);
+        uint32_t record = add_proc(table, proc);
         for (const Vma& map : maps) {
-            // Skip library/map if the prefix for the path doesn't match.
-            if (!params->lib_prefix.empty() &&
-                !::android::base::StartsWith(map.name, params->lib_prefix)) {
-                continue;
-            }
-            // Skip excluded library/map names.
-            if (!params->all_libs &&
-                (std::find(params->excluded_libs.begin(), params->excluded_libs.end(), map.name) !=
-                 params->excluded_libs.end())) {
-                continue;
-            }
-            // Skip maps based on map permissions.
-            if (params->mapflags_mask &&
-                ((map.flags & (PROT_READ | PROT_WRITE | PROT_EXEC)) != params->mapflags_mask)) {
-                continue;
-            }
-
-            // Add memory for lib usage.
-            auto [it, inserted] = lib_name_map.emplace(map.name, LibRecord(map.name));
-            it->second.AddUsage(record, map.usage);
-
-            if (!params->swap_enabled && map.usage.swap) {
-                params->swap_enabled = true;
+            if (match_map(map)) {
+                add_map(record, map);
             }
         }
     }
@@ -607,7 +728,7 @@ static void print_library(struct params* params, const LibRecord& lib,
                           std::ostream& out) {
     if (params->format == Format::RAW) {
         // clang-format off
-        out << std::setw(6) << lib.pss() << "K"
+        out << std::setw(6) << lib.usage.pss << "K"
             << std::setw(10) << ""
             << std::setw(9) << ""
             << std::setw(9) << ""
@@ -622,12 +743,12 @@ static void print_library(struct params* params, const LibRecord& lib,
             out << std::setw(7) << ""
                 << "  ";
         }
-        out << lib.name() << "\n";
+        out << *lib.name << "\n";
     }
 }
 
-static void print_proc_as_raw(struct params* params, const LibProcRecord& p, std::ostream& out) {
-    const MemUsage& usage = p.usage();
+static void print_proc_as_raw(struct params* params, const LibProc& p, const MemUsage& usage,
+                              std::ostream& out) {
     // clang-format off
     out << std::setw(7) << ""
         << std::setw(9) << usage.vss << "K  "
@@ -639,19 +760,18 @@ static void print_proc_as_raw(struct params* params, const LibProcRecord& p, std
         out << std::setw(6) << usage.swap << "K  ";
     }
     if (params->show_oomadj) {
-        out << std::setw(7) << p.oomadj() << "  ";
+        out << std::setw(7) << p.oomadj << "  ";
     }
-    out << "  " << p.cmdline() << " [" << p.pid() << "]\n";
+    out << "  " << p.cmdline << " [" << p.pid << "]\n";
 }
 
-static void print_proc_as_json(struct params* params, const LibRecord& l, const LibProcRecord& p,
-                               std::ostream& out) {
-    const MemUsage& usage = p.usage();
+static void print_proc_as_json(struct params* params, const LibRecord& l, const LibProc& p,
+                               const MemUsage& usage, std::ostream& out) {
     // clang-format off
-    out << "{\"Library\":" << EscapeJsonString(l.name())
-        << ",\"Total_RSS\":" << l.pss()
-        << ",\"Process\":" << EscapeJsonString(p.cmdline())
-        << ",\"PID\":\"" << p.pid() << "\""
+    out << "{\"Library\":" << EscapeJsonString(*l.name)
+        << ",\"Total_RSS\":" << l.usage.pss
+        << ",\"Process\":" << EscapeJsonString(p.cmdline)
+        << ",\"PID\":\"" << p.pid << "\""
         << ",\"VSS\":" << usage.vss
         << ",\"RSS\":" << usage.rss
         << ",\"PSS\":" << usage.pss
@@ -661,19 +781,18 @@ static void print_proc_as_json(struct params* params, const LibRecord& l, const
         out << ",\"Swap\":" << usage.swap;
     }
     if (params->show_oomadj) {
-        out << ",\"Oom\":" << p.oomadj();
+        out << ",\"Oom\":" << p.oomadj;
     }
     out << "}\n";
 }
 
-static void print_proc_as_csv(struct params* params, const LibRecord& l, const LibProcRecord& p,
-                              std::ostream& out) {
-    const MemUsage& usage = p.usage();
+static void print_proc_as_csv(struct params* params, const LibRecord& l, const LibProc& p,
+                              const MemUsage& usage, std::ostream& out) {
     // clang-format off
-    out << EscapeCsvString(l.name())
-        << "," << l.pss()
-        << "," << EscapeCsvString(p.cmdline())
-        << ",\"[" << p.pid() << "]\""
+    out << EscapeCsvString(*l.name)
+        << "," << l.usage.pss
+        << "," << EscapeCsvString(p.cmdline)
+        << ",\"[" << p.pid << "]\""
         << "," << usage.vss
         << "," << usage.rss
         << "," << usage.pss
@@ -683,23 +802,24 @@ static void print_proc_as_csv(struct params* params, const LibRecord& l, const L
         out << "," << usage.swap;
     }
     if (params->show_oomadj) {
-        out << "," << p.oomadj();
+        out << "," << p.oomadj;
     }
     out << "\n";
 }
 
 static void print_procs(struct params* params, const LibRecord& lib,
-                        const std::vector<LibProcRecord>& procs, std::ostream& out) {
-    for (const LibProcRecord& p : procs) {
+                        const std::vector<LibProc>& procs, std::ostream& out) {
+    for (const LibProcUsage& u : lib.procs) {
+        const LibProc& p = procs[u.proc];
         switch (params->format) {
             case Format::RAW:
-                print_proc_as_raw(params, p, out);
+                print_proc_as_raw(params, p, u.usage, out);
                 break;
             case Format::JSON:
-                print_proc_as_json(params, lib, p, out);
+                print_proc_as_json(params, lib, p, u.usage, out);
                 break;
             case Format::CSV:
-                print_proc_as_csv(params, lib, p, out);
+                print_proc_as_csv(params, lib, p, u.usage, out);
                 break;
             default:
                 break;
@@ -726,42 +846,38 @@ bool run_librank(uint64_t pgflags, uint64_t pgflags_mask, const std::set<pid_t>&
     };
 
     // Fills in usage info for each LibRecord.
-    std::map<std::string, librank::LibRecord> lib_name_map;
-    if (!librank::populate_libs(&params, pgflags, pgflags_mask, pids, lib_name_map,
-                                processrecords_ptr, err)) {
+    librank::LibTable table;
+    if (!librank::populate_libs(&params, pgflags, pgflags_mask, pids, &table, processrecords_ptr,
+                                err)) {
         return false;
     }
 
     librank::print_header(&params, out);
 
-    // Create vector of all LibRecords, sorted by descending PSS.
-    std::vector<librank::LibRecord> libs;
-    libs.reserve(lib_name_map.size());
-    for (const auto& [k, v] : lib_name_map) {
-        libs.push_back(v);
+    // Sort libraries by descending PSS, by name for libraries with the same PSS.
+    std::vector<librank::LibRecord*> libs;
+    libs.reserve(table.libs.size());
+    for (librank::LibRecord& lib : table.libs) {
+        libs.push_back(&lib);
     }
     std::sort(libs.begin(), libs.end(),
-              [](const librank::LibRecord& l1, const librank::LibRecord& l2) {
-                  return l1.pss() > l2.pss();
+              [](const librank::LibRecord* l1, const librank::LibRecord* l2) {
+                  if (l1->usage.pss != l2->usage.pss) return l1->usage.pss > l2->usage.pss;
+                  return *l1->name < *l2->name;
               });
 
-    std::function<bool(librank::LibProcRecord & a, librank::LibProcRecord & b)> libproc_sort =
-            librank::select_sort(sort_order);
-    for (librank::LibRecord& lib : libs) {
-        // Sort all processes for this library, default is PSS-descending.
-        std::vector<librank::LibProcRecord> procs;
-        procs.reserve(lib.processes().size());
-        for (const auto& [k, v] : lib.processes()) {
-            procs.push_back(v);
-        }
+    librank::LibProcSort libproc_sort = librank::select_sort(sort_order, table.procs);
+    for (librank::LibRecord* lib : libs) {
+        // Sort all processes for this library in place, default is PSS-descending.
+        std::vector<librank::LibProcUsage>& procs = lib->procs;
         if (reverse_sort) {
             std::sort(procs.rbegin(), procs.rend(), libproc_sort);
         } else {
             std::sort(procs.begin(), procs.end(), libproc_sort);
         }
 
-        librank::print_library(&params, lib, out);
-        librank::print_procs(&params, lib, procs, out);
+        librank::print_library(&params, *lib, out);
+        librank::print_procs(&params, *lib, table.procs, out);
     }
 
     return true;
@@ -1174,6 +1290,227 @@ bool run_showmap(pid_t pid, const std::string& filename, bool terse, bool verbos
     return true;
 }
 
+namespace thp {
+
+struct ProcThpRecord {
+    pid_t pid;
+    std::string cmdline;
+    ThpUsage usage;
+};
+
+static void print_header(bool show_bloat, std::ostream& out) {
+    out << StringPrintf("%8s  %8s  %8s  %8s  %8s  ", "Vss", "Rss", "THP", "Eligible", "Unbacked");
+    if (show_bloat) {
+        out << StringPrintf("%8s  ", "Bloat");
+    }
+}
+
+static void print_usage(const ThpUsage& usage, bool show_bloat, std::ostream& out) {
+    out << StringPrintf("%7" PRIu64 "K  %7" PRIu64 "K  %7" PRIu64 "K  %7" PRIu64 "K  %7" PRIu64
+                        "K  ",
+                        usage.vss, usage.rss, usage.thp, usage.eligible, usage.eligible_unbacked);
+    if (show_bloat) {
+        out << StringPrintf("%7" PRIu64 "K  ", usage.bloat);
+    }
+}
+
+}  // namespace thp
+
+bool run_procrank_thp(const std::set<pid_t>& pids, bool get_bloat, std::ostream& out,
+                      std::ostream& err) {
+    std::vector<thp::ProcThpRecord> procs;
+    for (pid_t pid : pids) {
+        thp::ProcThpRecord proc = {.pid = pid};
+        ::android::meminfo::ProcMemInfo procmem(pid);
+        if (!procmem.ThpUsageKb(&proc.usage, nullptr, get_bloat)) {
+            // Skip processes that were killed in the meantime.
+            std::string procdir = StringPrintf("/proc/%d", pid);
+            if (access(procdir.c_str(), F_OK | R_OK)) continue;
+            err << "warning: failed to read THP usage of: " << pid << "\n";
+            continue;
+        }
+        // Skip processes with no memory mappings.
+        if (proc.usage.vss == 0) continue;
+
+        proc.cmdline = read_cmdline(pid);
+        procs.emplace_back(std::move(proc));
+    }
+
+    std::sort(procs.begin(), procs.end(),
+              [](const thp::ProcThpRecord& a, const thp::ProcThpRecord& b) {
+                  return a.usage.thp > b.usage.thp;
+              });
+
+    out << StringPrintf("%5s  ", "PID");
+    thp::print_header(get_bloat, out);
+    out << "cmdline\n";
+
+    ThpUsage total;
+    for (const auto& proc : procs) {
+        total.add(proc.usage);
+        out << StringPrintf("%5d  ", proc.pid);
+        thp::print_usage(proc.usage, get_bloat, out);
+        out << proc.cmdline << "\n";
+    }
+
+    out << StringPrintf("%5s  ", "");
+    thp::print_usage(total, get_bloat, out);
+    out << "TOTAL\n";
+    return true;
+}
+
+bool run_procrank_mmless(const std::set<pid_t>& pids, std::ostream& out, std::ostream& err) {
+    out << StringPrintf("%5s  %5s  %1s  %-7s  %s\n", "PID", "PPID", "S", "Type", "comm");
+
+    uint32_t nr_kthreads = 0;
+    uint32_t nr_zombies = 0;
+    ProcStat stat;
+    for (pid_t pid : pids) {
+        if (!ProcStatFromFile(StringPrintf("/proc/%d/stat", pid), &stat)) {
+            // Skip processes that were reaped in the meantime.
+            std::string procdir = StringPrintf("/proc/%d", pid);
+            if (access(procdir.c_str(), F_OK | R_OK)) continue;
+            err << "warning: failed to read stat of: " << pid << "\n";
+            continue;
+        }
+        if (!IsMmlessTask(stat)) continue;
+
+        bool kthread = IsKernelThread(stat);
+        kthread ? nr_kthreads++ : nr_zombies++;
+        out << StringPrintf("%5d  %5d  %c  %-7s  %s\n", stat.pid, stat.ppid, stat.state,
+                            kthread ? "kthread" : "zombie", stat.comm);
+    }
+
+    out << StringPrintf("%u kernel threads, %u zombies\n", nr_kthreads, nr_zombies);
+    return true;
+}
+
+namespace zram {
+
+struct ProcZramRecord {
+    pid_t pid;
+    std::string cmdline;
+    // Proportional swap, so that swap shared after fork isn't counted once per sharer.
+    uint64_t swap_pss_kb;
+    ::android::meminfo::PageContentStats stats;
+};
+
+}  // namespace zram
+
+bool run_procrank_zram(const std::set<pid_t>& pids, uint64_t page_budget, std::ostream& out,
+                       std::ostream& err) {
+    ::android::meminfo::PageContentSampler sampler(page_budget, true);
+    std::vector<zram::ProcZramRecord> procs;
+    for (pid_t pid : pids) {
+        zram::ProcZramRecord proc = {.pid = pid};
+        MemUsage usage;
+        ::android::meminfo::ProcMemInfo procmem(pid);
+        if (!procmem.SmapsOrRollup(&usage) || !sampler.AddProcess(pid)) {
+            // Skip processes that were killed in the meantime.
+            std::string procdir = StringPrintf("/proc/%d", pid);
+            if (access(procdir.c_str(), F_OK | R_OK)) continue;
+            err << "warning: failed to sample the memory of: " << pid << "\n";
+            continue;
+        }
+        proc.swap_pss_kb = usage.swap_pss;
+
+        proc.cmdline = read_cmdline(pid);
+        procs.emplace_back(std::move(proc));
+    }
+
+    std::map<pid_t, ::android::meminfo::PageContentStats> stats;
+    sampler.ProcessStats(&stats);
+    for (auto& proc : procs) {
+        proc.stats = stats[proc.pid];
+    }
+    // Processes with no resident anonymous page to sample, e.g. ones that are swapped out
+    // entirely, are assumed to compress like all of zram does.
+    double system_ratio = 0.0;
+    ::android::meminfo::SysMemInfo smi;
+    if (smi.ReadMemInfo() && smi.mem_swap_kb() > smi.mem_swap_free_kb()) {
+        system_ratio = static_cast<double>(smi.mem_zram_kb()) /
+                       (smi.mem_swap_kb() - smi.mem_swap_free_kb());
+    }
+    auto ratio = [system_ratio](const zram::ProcZramRecord& proc) {
+        return proc.stats.sampled_pages ? proc.stats.compression_ratio : system_ratio;
+    };
+    // The swapped out pages can't be read, they are assumed to compress as well as the
+    // resident ones.
+    auto zswap_kb = [&](const zram::ProcZramRecord& proc) {
+        return static_cast<uint64_t>(proc.swap_pss_kb * ratio(proc));
+    };
+    std::sort(procs.begin(), procs.end(),
+              [&](const zram::ProcZramRecord& a, const zram::ProcZramRecord& b) {
+                  return zswap_kb(a) > zswap_kb(b);
+              });
+
+    out << StringPrintf("%5s  %8s  %8s  %6s  %6s  %8s  %8s  %8s  %s\n", "PID", "Anon", "Sampled",
+                        "Ratio", "+/-", "AnonZram", "SwapPss", "ZSwap", "cmdline");
+    uint64_t total_anon_kb = 0;
+    uint64_t total_zram_kb = 0;
+    uint64_t total_swap_pss_kb = 0;
+    uint64_t total_zswap_kb = 0;
+    const uint64_t pagesz_kb = getpagesize() / 1024;
+    for (const auto& proc : procs) {
+        uint64_t anon_kb = proc.stats.resident_pages * pagesz_kb;
+        uint64_t zram_kb = proc.stats.zram_bytes / 1024;
+        total_anon_kb += anon_kb;
+        total_zram_kb += zram_kb;
+        total_swap_pss_kb += proc.swap_pss_kb;
+        total_zswap_kb += zswap_kb(proc);
+        std::string error = proc.stats.sampled_pages
+                                    ? StringPrintf("%6.3f", proc.stats.compression_ratio_error)
+                                    : "-";
+        out << StringPrintf("%5d  %7" PRIu64 "K  %8" PRIu64 "  %6.3f  %6s  %7" PRIu64
+                            "K  %7" PRIu64 "K  %7" PRIu64 "K  %s\n",
+                            proc.pid, anon_kb, proc.stats.sampled_pages, ratio(proc),
+                            error.c_str(), zram_kb, proc.swap_pss_kb, zswap_kb(proc),
+                            proc.cmdline.c_str());
+    }
+
+    out << StringPrintf("%5s  %7" PRIu64 "K  %8s  %6s  %6s  %7" PRIu64 "K  %7" PRIu64
+                        "K  %7" PRIu64 "K  TOTAL\n",
+                        "", total_anon_kb, "", "", "", total_zram_kb, total_swap_pss_kb,
+                        total_zswap_kb);
+    return true;
+}
+
+bool run_showmap_thp(pid_t pid, const std::string& filename, bool get_bloat, bool quiet,
+                     std::ostream& out, std::ostream& err) {
+    std::vector<std::pair<Vma, ThpUsage>> vmas;
+    auto collect_vma = [&](const Vma& vma, const ThpUsage& usage) {
+        vmas.emplace_back(vma, usage);
+    };
+
+    // Bloat can only be found through the pagemap of a live process.
+    get_bloat = get_bloat && pid > 0;
+    ThpUsage total;
+    bool success;
+    if (get_bloat) {
+        ::android::meminfo::ProcMemInfo procmem(pid);
+        success = procmem.ThpUsageKb(&total, collect_vma, true);
+    } else {
+        success = ::android::meminfo::ThpUsageKbFromFile(filename, &total, collect_vma);
+    }
+    if (!success) {
+        if (!quiet) {
+            err << "Failed to read THP usage from " << filename << "\n";
+        }
+        return false;
+    }
+
+    thp::print_header(get_bloat, out);
+    out << StringPrintf("%16s  %16s  %s\n", "start", "end", "object");
+    for (const auto& [vma, usage] : vmas) {
+        thp::print_usage(usage, get_bloat, out);
+        out << StringPrintf("%16" PRIx64 "  %16" PRIx64 "  %s\n", vma.start, vma.end,
+                            vma.name.c_str());
+    }
+    thp::print_usage(total, get_bloat, out);
+    out << StringPrintf("%16s  %16s  %s\n", "", "", "TOTAL");
+    return true;
+}
+
 namespace bugreport_procdump {
 
 static void create_processrecords(const std::set<pid_t>& pids,
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+#include <capture.h>
+#include <processrecord.h>
+#include <smapinfo.h>
+
+using namespace android::smapinfo;
+
+// Two anonymous maps, with 600 kB swapped out of which 300 kB proportionally.
+static const char kSmaps[] =
+        R"smaps(7b5e10000000-7b5e10100000 rw-p 00000000 00:00 0                          [anon:scudo:primary]
+Size:               1024 kB
+KernelPageSize:        4 kB
+MMUPageSize:           4 kB
+Rss:                 512 kB
+Pss:                 256 kB
+Shared_Clean:          0 kB
+Shared_Dirty:        512 kB
+Private_Clean:         0 kB
+Private_Dirty:         0 kB
+Referenced:          512 kB
+Anonymous:           512 kB
+AnonHugePages:         0 kB
+ShmemPmdMapped:        0 kB
+Shared_Hugetlb:        0 kB
+Private_Hugetlb:       0 kB
+Swap:                400 kB
+SwapPss:             100 kB
+Locked:                0 kB
+VmFlags: rd wr mr mw me ac
+7b5e20000000-7b5e20080000 rw-p 00000000 00:00 0                          [anon:libc_malloc]
+Size:                512 kB
+KernelPageSize:        4 kB
+MMUPageSize:           4 kB
+Rss:                 256 kB
+Pss:                 256 kB
+Shared_Clean:          0 kB
+Shared_Dirty:          0 kB
+Private_Clean:         0 kB
+Private_Dirty:       256 kB
+Referenced:          256 kB
+Anonymous:           256 kB
+AnonHugePages:         0 kB
+ShmemPmdMapped:        0 kB
+Shared_Hugetlb:        0 kB
+Private_Hugetlb:       0 kB
+Swap:                200 kB
+SwapPss:             200 kB
+Locked:                0 kB
+VmFlags: rd wr mr mw me ac
+)smaps";
+
+// 1000 kB of swap used, stored in 250 kB of zram.
+static const char kMeminfo[] =
+        "MemTotal:        4000000 kB\n"
+        "MemFree:         1000000 kB\n"
+        "Buffers:            1000 kB\n"
+        "Cached:           500000 kB\n"
+        "Shmem:             10000 kB\n"
+        "Slab:              50000 kB\n"
+        "SwapTotal:          4096 kB\n"
+        "SwapFree:           3096 kB\n";
+static const char kZramMmStat[] = "2048000 256000 256000 0 256000 0 0 0 0\n";
+
+static void WriteCaptureFile(const std::string& root, const std::string& path,
+                             const std::string& content) {
+    std::vector<std::string> dirs = ::android::base::Split(path, "/");
+    std::string dir = root;
+    for (size_t i = 0; i + 1 < dirs.size(); i++) {
+        dir += "/" + dirs[i];
+        mkdir(dir.c_str(), 0700);
+    }
+    ASSERT_TRUE(::android::base::WriteStringToFile(content, root + "/" + path));
+}
+
+TEST(ProcRankReplay, SwapFromSmaps) {
+    TemporaryDir root;
+    WriteCaptureFile(root.path, "proc/meminfo", kMeminfo);
+    WriteCaptureFile(root.path, "sys/block/zram0/mm_stat", kZramMmStat);
+    WriteCaptureFile(root.path, "proc/1234/cmdline", std::string("replayed\0", 9));
+    WriteCaptureFile(root.path, "proc/1234/oom_score_adj", "0\n");
+    WriteCaptureFile(root.path, "proc/1234/smaps", kSmaps);
+
+    std::set<pid_t> pids;
+    std::map<pid_t, ProcessRecord> processrecords;
+    std::stringstream out, err;
+    ASSERT_TRUE(create_capture_processrecords(root.path, &pids, &processrecords, err));
+    ASSERT_EQ(pids, std::set<pid_t>({1234}));
+    ASSERT_TRUE(run_procrank(0, 0, pids, false, false, SortOrder::BY_PSS, false, &processrecords,
+                             out, err, root.path))
+            << err.str();
+
+    // A capture has no swap offsets to find the unique swap from, so there is no USwap column.
+    std::vector<std::string> lines = ::android::base::Split(out.str(), "\n");
+    ASSERT_GE(lines.size(), 4);
+    EXPECT_EQ(::android::base::Tokenize(lines[0], " "),
+              std::vector<std::string>({"PID", "Vss", "Rss", "Pss", "Uss", "Swap", "PSwap",
+                                        "ZSwap", "cmdline"}));
+    // PSwap is the SwapPss of the smaps, and ZSwap its share of zram.
+    EXPECT_EQ(::android::base::Tokenize(lines[1], " "),
+              std::vector<std::string>({"1234", "1536K", "768K", "512K", "256K", "600K", "300K",
+                                        "75K", "replayed"}));
+    EXPECT_EQ(::android::base::Tokenize(lines[3], " "),
+              std::vector<std::string>({"512K", "256K", "600K", "300K", "75K", "TOTAL"}));
+}
@@ -20,10 +20,20 @@
 #include <unistd.h>
 
 #include <meminfo/androidprocheaps.h>
+#include <meminfo/asyncscan.h>
+#include <meminfo/damon.h>
+#include <meminfo/footprint.h>
 #include <meminfo/meminfo.h>
+#include <meminfo/memtrend.h>
 #include <meminfo/pageacct.h>
+#include <meminfo/pageage.h>
+#include <meminfo/pagecache.h>
+#include <meminfo/pagecontent.h>
+#include <meminfo/pagesharing.h>
 #include <meminfo/procmeminfo.h>
+#include <meminfo/procstat.h>
 #include <meminfo/sysmeminfo.h>
+#include <meminfo/workstealing.h>
 
 #define _BITS(x, offset, bits) (((x) >> (offset)) & ((1LL << (bits)) - 1))
 
@@ -37,3 +47,35 @@
 
 // Macros to do per-page kpageflags data manipulation
 #define KPAGEFLAG_THP(x) (_BITS(x, 22, 1))
+
+// Page flags exported by /proc/kpageflags that are missing from the uapi
+// <linux/kernel-page-flags.h>.
+#ifndef KPF_MLOCKED
+#define KPF_MLOCKED 33
+#endif
+
+namespace android {
+namespace meminfo {
+
+// Adds up the usage of vmas or processes. swap_pss is left out, it is only meaningful
+// as read from smaps_rollup.
+inline void add_mem_usage(MemUsage* to, const MemUsage& from) {
+    to->vss += from.vss;
+    to->rss += from.rss;
+    to->pss += from.pss;
+    to->uss += from.uss;
+
+    to->swap += from.swap;
+
+    to->private_clean += from.private_clean;
+    to->private_dirty += from.private_dirty;
+
+    to->shared_clean += from.shared_clean;
+    to->shared_dirty += from.shared_dirty;
+}
+
+// Adds the pids of all processes in 'procfs_path' to 'pids'.
+bool list_pids(const std::string& procfs_path, std::vector<pid_t>* pids);
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "meminfo_private.h"
+
+namespace android {
+namespace meminfo {
+
+// Deviations from the trend smaller than this many standard deviations don't add to the
+// CUSUM, so that noise doesn't add up to a change point.
+static constexpr double kCusumSlack = 0.5;
+
+void MemSeries::Reset() {
+    nr_samples_ = 0;
+    nr_trend_samples_ = 0;
+    average_ = 0;
+    variance_ = 0;
+    cusum_up_ = 0;
+    cusum_down_ = 0;
+    time_origin_ = 0;
+    last_time_ = 0;
+    last_value_ = 0;
+    sum_w_ = sum_t_ = sum_v_ = sum_tt_ = sum_tv_ = 0;
+}
+
+void MemSeries::Rebase() {
+    average_ = last_value_;
+    cusum_up_ = 0;
+    cusum_down_ = 0;
+    time_origin_ = last_time_;
+    nr_trend_samples_ = 1;
+    sum_w_ = 1;
+    sum_t_ = 0;
+    sum_v_ = last_value_;
+    sum_tt_ = 0;
+    sum_tv_ = 0;
+}
+
+void MemSeries::Add(double time_s, double value, double noise_floor) {
+    nr_samples_++;
+    if (nr_samples_ == 1) {
+        last_time_ = time_s;
+        last_value_ = value;
+        Rebase();
+        return;
+    }
+
+    // The sample is compared to the trend before it is added to it.
+    double residual = value - Predict(time_s);
+    double z = residual / std::max(stddev(), noise_floor);
+    cusum_up_ = std::max(0.0, cusum_up_ + z - kCusumSlack);
+    cusum_down_ = std::max(0.0, cusum_down_ - z - kCusumSlack);
+    variance_ = nr_samples_ == 2 ? residual * residual
+                                 : (1 - alpha_) * variance_ + alpha_ * residual * residual;
+    average_ += alpha_ * (value - average_);
+
+    const double decay = 1 - alpha_;
+    const double t = time_s - time_origin_;
+    sum_w_ = decay * sum_w_ + 1;
+    sum_t_ = decay * sum_t_ + t;
+    sum_v_ = decay * sum_v_ + value;
+    sum_tt_ = decay * sum_tt_ + t * t;
+    sum_tv_ = decay * sum_tv_ + t * value;
+    nr_trend_samples_++;
+    last_time_ = time_s;
+    last_value_ = value;
+}
+
+double MemSeries::stddev() const {
+    return std::sqrt(variance_);
+}
+
+double MemSeries::slope() const {
+    double den = sum_w_ * sum_tt_ - sum_t_ * sum_t_;
+    if (nr_trend_samples_ < 2 || den <= 0) {
+        return 0;
+    }
+    return (sum_w_ * sum_tv_ - sum_t_ * sum_v_) / den;
+}
+
+double MemSeries::Predict(double time_s) const {
+    if (nr_trend_samples_ < 2) {
+        return last_value_;
+    }
+    double mean_t = sum_t_ / sum_w_;
+    double mean_v = sum_v_ / sum_w_;
+    return mean_v + slope() * (time_s - time_origin_ - mean_t);
+}
+
+void MemAnomalyDetector::AddMetricSample(pid_t pid, const char* metric, uint64_t time_ms,
+                                         uint64_t value_kb, MemSeries* series, bool* growing) {
+    double slope_before = series->slope();
+    series->Add(time_ms / 1000.0, value_kb, thresholds_.noise_floor_kb);
+    if (series->nr_samples() < thresholds_.min_samples) {
+        return;
+    }
+
+    MemAlert alert = {
+            .pid = pid,
+            .metric = metric,
+            .time_ms = time_ms,
+            .value_kb = value_kb,
+            .average_kb = series->average(),
+            .stddev_kb = series->stddev(),
+    };
+    if (series->cusum_up() > thresholds_.change_threshold) {
+        alert.type = MemAlertType::CHANGE_POINT;
+        alert.slope_kb_per_s = slope_before;
+        // The trend before the change doesn't predict the samples after it.
+        series->Rebase();
+        *growing = false;
+        callback_(alert);
+        return;
+    }
+    if (series->cusum_down() > thresholds_.change_threshold) {
+        // Memory was freed, which is no anomaly, but the trend starts over as well.
+        series->Rebase();
+        *growing = false;
+        return;
+    }
+
+    if (series->nr_trend_samples() < thresholds_.min_samples) {
+        return;
+    }
+    double slope = series->slope();
+    if (!*growing && slope > thresholds_.max_growth_kb_per_s) {
+        *growing = true;
+        alert.type = MemAlertType::GROWTH;
+        alert.slope_kb_per_s = slope;
+        callback_(alert);
+    } else if (*growing && slope < thresholds_.max_growth_kb_per_s / 2) {
+        *growing = false;
+    }
+}
+
+void MemAnomalyDetector::AddSample(pid_t pid, uint64_t time_ms, const MemUsage& usage) {
+    auto [it, inserted] = procs_.try_emplace(pid, ProcessSeries{
+                                                          .pss = MemSeries(thresholds_.alpha),
+                                                          .rss = MemSeries(thresholds_.alpha),
+                                                          .pss_growing = false,
+                                                          .rss_growing = false,
+                                                  });
+    ProcessSeries& proc = it->second;
+    AddMetricSample(pid, "pss", time_ms, usage.pss, &proc.pss, &proc.pss_growing);
+    AddMetricSample(pid, "rss", time_ms, usage.rss, &proc.rss, &proc.rss_growing);
+}
+
+bool MemAnomalyDetector::SampleProcess(pid_t pid) {
+    MemUsage usage;
+    if (!ProcMemInfo(pid).SmapsOrRollup(&usage)) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    AddSample(pid, std::chrono::duration_cast<std::chrono::milliseconds>(now).count(), usage);
+    return true;
+}
+
+const MemSeries* MemAnomalyDetector::PssSeries(pid_t pid) const {
+    auto it = procs_.find(pid);
+    return it == procs_.end() ? nullptr : &it->second.pss;
+}
+
+const MemSeries* MemAnomalyDetector::RssSeries(pid_t pid) const {
+    auto it = procs_.find(pid);
+    return it == procs_.end() ? nullptr : &it->second.rss;
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -16,8 +16,15 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/kernel-page-flags.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 
@@ -74,6 +81,28 @@ bool PageAcct::InitPageAcct(bool pageidle_enable) {
     return true;
 }
 
+// Reads the entry of every pfn in 'pfns' from one of the /proc/kpage* files into 'entries',
+// with a single pread for each run of consecutive pfns.
+static bool read_pfn_entries(int fd, const std::vector<uint64_t>& pfns,
+                             std::vector<uint64_t>* entries, const char* what) {
+    entries->resize(pfns.size());
+    size_t run_start = 0;
+    for (size_t i = 1; i <= pfns.size(); i++) {
+        if (i < pfns.size() && pfns[i] == pfns[i - 1] + 1) {
+            continue;
+        }
+        size_t bytes = (i - run_start) * sizeof(uint64_t);
+        if (pread64(fd, entries->data() + run_start, bytes, pfns[run_start] * sizeof(uint64_t)) !=
+            static_cast<ssize_t>(bytes)) {
+            PLOG(ERROR) << "Failed to read " << what << " for pages " << pfns[run_start] << "-"
+                        << pfns[i - 1];
+            return false;
+        }
+        run_start = i;
+    }
+    return true;
+}
+
 bool PageAcct::PageFlags(uint64_t pfn, uint64_t* flags) {
     if (!flags) return false;
 
@@ -89,6 +118,22 @@ bool PageAcct::PageFlags(uint64_t pfn, uint64_t* flags) {
     return true;
 }
 
+bool PageAcct::PageFlags(uint64_t pfn, size_t nr_pages, std::vector<uint64_t>* flags) {
+    if (!flags) return false;
+
+    if (kpageflags_fd_ < 0) {
+        if (!InitPageAcct()) return false;
+    }
+
+    flags->resize(nr_pages);
+    ssize_t bytes = nr_pages * sizeof(uint64_t);
+    if (pread64(kpageflags_fd_, flags->data(), bytes, pfn * sizeof(uint64_t)) != bytes) {
+        PLOG(ERROR) << "Failed to read page flags for pages " << pfn << "-" << pfn + nr_pages;
+        return false;
+    }
+    return true;
+}
+
 bool PageAcct::PageMapCount(uint64_t pfn, uint64_t* mapcount) {
     if (!mapcount) return false;
 
@@ -104,6 +149,43 @@ bool PageAcct::PageMapCount(uint64_t pfn, uint64_t* mapcount) {
     return true;
 }
 
+bool PageAcct::PageFlags(const std::vector<uint64_t>& pfns, std::vector<uint64_t>* flags) {
+    if (!flags) return false;
+
+    if (kpageflags_fd_ < 0) {
+        if (!InitPageAcct()) return false;
+    }
+
+    return read_pfn_entries(kpageflags_fd_, pfns, flags, "page flags");
+}
+
+bool PageAcct::PageMapCounts(const std::vector<uint64_t>& pfns,
+                             std::vector<uint64_t>* mapcounts) {
+    if (!mapcounts) return false;
+
+    if (kpagecount_fd_ < 0) {
+        if (!InitPageAcct()) return false;
+    }
+
+    return read_pfn_entries(kpagecount_fd_, pfns, mapcounts, "map count");
+}
+
+bool PageAcct::PageCgroups(const std::vector<uint64_t>& pfns, std::vector<uint64_t>* memcg_inos) {
+    if (!memcg_inos) return false;
+
+    if (kpagecgroup_fd_ < 0) {
+        unique_fd cgroup_fd(
+                TEMP_FAILURE_RETRY(open("/proc/kpagecgroup", O_RDONLY | O_CLOEXEC)));
+        if (cgroup_fd < 0) {
+            PLOG(ERROR) << "Failed to open /proc/kpagecgroup";
+            return false;
+        }
+        kpagecgroup_fd_ = std::move(cgroup_fd);
+    }
+
+    return read_pfn_entries(kpagecgroup_fd_, pfns, memcg_inos, "memory cgroup");
+}
+
 int PageAcct::IsPageIdle(uint64_t pfn) {
     if (pageidle_fd_ < 0) {
         if (!InitPageAcct(true)) return -EOPNOTSUPP;
@@ -140,6 +222,234 @@ int PageAcct::GetPageIdle(uint64_t pfn) const {
     return !!(idle_bits & (1ULL << (pfn % 64)));
 }
 
+// Number of PFNs read from kpageflags / kpagecount at a time, i.e. 4MB per read.
+static constexpr size_t kCensusChunkPages = 512 * 1024;
+
+// Adds up the page types of 'nr_pages' kpageflags entries. Every counter is a plain sum of
+// extracted bits without any branches, so that the compiler can vectorize the loop.
+static void census_page_flags(const uint64_t* flags, size_t nr_pages, PageCensus* census) {
+    uint64_t nopage = 0, buddy = 0, slab = 0, pgtable = 0, anon = 0, file = 0, other = 0;
+    uint64_t thp = 0, ksm = 0, mlocked = 0, unevictable = 0, idle = 0, mmap = 0, dirty = 0;
+
+    for (size_t i = 0; i < nr_pages; i++) {
+        const uint64_t f = flags[i];
+
+        // The page types are checked in order of priority, as some flags are not exclusive,
+        // e.g. slab pages may also report KPF_ANON. Each 'seen' accumulates the types
+        // already matched, so that every page ends up in exactly one of them.
+        const uint64_t is_nopage = (f >> KPF_NOPAGE) & 1;
+        uint64_t seen = is_nopage;
+        const uint64_t is_buddy = (f >> KPF_BUDDY) & ~seen & 1;
+        seen |= is_buddy;
+        const uint64_t is_slab = (f >> KPF_SLAB) & ~seen & 1;
+        seen |= is_slab;
+        const uint64_t is_pgtable = (f >> KPF_PGTABLE) & ~seen & 1;
+        seen |= is_pgtable;
+        const uint64_t is_anon = ((f >> KPF_ANON) | (f >> KPF_SWAPBACKED)) & ~seen & 1;
+        seen |= is_anon;
+        const uint64_t is_file = (f >> KPF_LRU) & ~seen & 1;
+        seen |= is_file;
+
+        nopage += is_nopage;
+        buddy += is_buddy;
+        slab += is_slab;
+        pgtable += is_pgtable;
+        anon += is_anon;
+        file += is_file;
+        other += seen ^ 1;
+
+        thp += (f >> KPF_THP) & 1;
+        ksm += (f >> KPF_KSM) & 1;
+        mlocked += (f >> KPF_MLOCKED) & 1;
+        unevictable += (f >> KPF_UNEVICTABLE) & 1;
+        idle += (f >> KPF_IDLE) & 1;
+        mmap += (f >> KPF_MMAP) & 1;
+        dirty += (f >> KPF_DIRTY) & 1;
+    }
+
+    census->nopage += nopage;
+    census->buddy += buddy;
+    census->slab += slab;
+    census->pgtable += pgtable;
+    census->anon += anon;
+    census->file += file;
+    census->other += other;
+    census->thp += thp;
+    census->ksm += ksm;
+    census->mlocked += mlocked;
+    census->unevictable += unevictable;
+    census->idle += idle;
+    census->mmap += mmap;
+    census->dirty += dirty;
+}
+
+static void census_page_counts(const uint64_t* counts, size_t nr_pages, PageCensus* census) {
+    uint64_t shared = 0;
+    for (size_t i = 0; i < nr_pages; i++) {
+        shared += counts[i] > 1;
+    }
+    census->shared += shared;
+}
+
+// Reads up to 'nr_pages' entries starting at 'pfn'. Returns the number of entries read,
+// 0 at the end of the file or -1 on error.
+static ssize_t read_pfn_range(int fd, uint64_t pfn, size_t nr_pages, uint64_t* buf) {
+    ssize_t bytes = TEMP_FAILURE_RETRY(
+            pread64(fd, buf, nr_pages * sizeof(uint64_t), pfn * sizeof(uint64_t)));
+    if (bytes < 0) {
+        return -1;
+    }
+    return bytes / sizeof(uint64_t);
+}
+
+static unique_fd open_pfn_file(const std::string& path) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to open " << path;
+    }
+    return fd;
+}
+
+using PfnRangeCallback = std::function<void(const uint64_t* flags, const uint64_t* counts,
+                                            const uint64_t* memcgs, size_t nr_pages)>;
+
+// Reads kpageflags, and kpagecount / kpagecgroup if their path is not empty, for all
+// PFNs in chunks of kCensusChunkPages and calls 'callback' for each chunk. 'counts' and
+// 'memcgs' are nullptr if the respective file is not read.
+static bool walk_pfns(const std::string& kpageflags_path, const std::string& kpagecount_path,
+                      const std::string& kpagecgroup_path, const PfnRangeCallback& callback) {
+    unique_fd flags_fd = open_pfn_file(kpageflags_path);
+    if (flags_fd < 0) {
+        return false;
+    }
+
+    unique_fd count_fd;
+    if (!kpagecount_path.empty() && (count_fd = open_pfn_file(kpagecount_path)) < 0) {
+        return false;
+    }
+
+    unique_fd cgroup_fd;
+    if (!kpagecgroup_path.empty() && (cgroup_fd = open_pfn_file(kpagecgroup_path)) < 0) {
+        return false;
+    }
+
+    std::vector<uint64_t> flags(kCensusChunkPages);
+    std::vector<uint64_t> counts(count_fd < 0 ? 0 : kCensusChunkPages);
+    std::vector<uint64_t> memcgs(cgroup_fd < 0 ? 0 : kCensusChunkPages);
+    uint64_t pfn = 0;
+    while (true) {
+        ssize_t nr_pages = read_pfn_range(flags_fd, pfn, flags.size(), flags.data());
+        if (nr_pages < 0) {
+            PLOG(ERROR) << "Failed to read " << kpageflags_path << " at pfn " << pfn;
+            return false;
+        }
+        if (nr_pages == 0) {
+            break;
+        }
+
+        if (count_fd >= 0 && read_pfn_range(count_fd, pfn, nr_pages, counts.data()) != nr_pages) {
+            PLOG(ERROR) << "Failed to read " << kpagecount_path << " at pfn " << pfn;
+            return false;
+        }
+        if (cgroup_fd >= 0 && read_pfn_range(cgroup_fd, pfn, nr_pages, memcgs.data()) != nr_pages) {
+            PLOG(ERROR) << "Failed to read " << kpagecgroup_path << " at pfn " << pfn;
+            return false;
+        }
+
+        callback(flags.data(), count_fd < 0 ? nullptr : counts.data(),
+                 cgroup_fd < 0 ? nullptr : memcgs.data(), nr_pages);
+        pfn += nr_pages;
+    }
+
+    return true;
+}
+
+static void census_pages(const uint64_t* flags, const uint64_t* counts, size_t nr_pages,
+                         PageCensus* census) {
+    census_page_flags(flags, nr_pages, census);
+    if (counts) {
+        census_page_counts(counts, nr_pages, census);
+    }
+    census->total += nr_pages;
+}
+
+bool ReadPageCensus(PageCensus* census, bool read_mapcount, const std::string& kpageflags_path,
+                    const std::string& kpagecount_path) {
+    census->clear();
+    return walk_pfns(kpageflags_path, read_mapcount ? kpagecount_path : "", "",
+                     [&](const uint64_t* flags, const uint64_t* counts, const uint64_t*,
+                         size_t nr_pages) { census_pages(flags, counts, nr_pages, census); });
+}
+
+bool ReadMemcgPageCensus(std::map<uint64_t, PageCensus>* memcg_census, bool read_mapcount,
+                         const std::string& kpageflags_path, const std::string& kpagecount_path,
+                         const std::string& kpagecgroup_path) {
+    memcg_census->clear();
+    auto census_by_memcg = [&](const uint64_t* flags, const uint64_t* counts,
+                               const uint64_t* memcgs, size_t nr_pages) {
+        // Neighbouring pages are mostly charged to the same memcg, so classify each run of
+        // pages with the same memcg at once rather than looking up the memcg for every page.
+        size_t run_start = 0;
+        PageCensus* census = &(*memcg_census)[memcgs[0]];
+        for (size_t i = 1; i <= nr_pages; i++) {
+            if (i < nr_pages && memcgs[i] == memcgs[run_start]) {
+                continue;
+            }
+            census_pages(flags + run_start, counts ? counts + run_start : nullptr, i - run_start,
+                         census);
+            if (i < nr_pages) {
+                run_start = i;
+                census = &(*memcg_census)[memcgs[i]];
+            }
+        }
+    };
+
+    if (!walk_pfns(kpageflags_path, read_mapcount ? kpagecount_path : "", kpagecgroup_path,
+                   census_by_memcg)) {
+        memcg_census->clear();
+        return false;
+    }
+    return true;
+}
+
+bool ReadMemcgPaths(std::unordered_map<uint64_t, std::string>* paths,
+                    const std::string& cgroup_root) {
+    namespace fs = std::filesystem;
+
+    paths->clear();
+    struct stat st;
+    if (stat(cgroup_root.c_str(), &st) != 0) {
+        PLOG(ERROR) << "Failed to stat " << cgroup_root;
+        return false;
+    }
+    (*paths)[st.st_ino] = "/";
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(cgroup_root, fs::directory_options::skip_permission_denied,
+                                        ec);
+    if (ec) {
+        LOG(ERROR) << "Failed to walk " << cgroup_root << ": " << ec.message();
+        return false;
+    }
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            LOG(ERROR) << "Failed to walk " << cgroup_root << ": " << ec.message();
+            return false;
+        }
+        // Cgroups are the directories of the hierarchy, the files are the control files.
+        if (!it->is_directory(ec) || it->is_symlink(ec)) {
+            continue;
+        }
+        if (stat(it->path().c_str(), &st) != 0) {
+            // The cgroup was removed while walking the hierarchy.
+            continue;
+        }
+        (*paths)[st.st_ino] = "/" + it->path().lexically_relative(cgroup_root).string();
+    }
+
+    return true;
+}
+
 // Public methods
 bool page_present(uint64_t pagemap_val) {
     return PAGE_PRESENT(pagemap_val);
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include "meminfo_private.h"
+
+using unique_fd = ::android::base::unique_fd;
+
+namespace android {
+namespace meminfo {
+
+// Number of bitmap words read or written at a time, i.e. 1MB covering 8M pages.
+static constexpr size_t kBitmapChunkWords = 128 * 1024;
+
+// Number of pagemap entries read at a time.
+static constexpr size_t kPagemapChunkPages = 2048;
+
+// Updates the ages of the 64 pages described by one bitmap word. 'ages' points to the
+// 32 bytes holding their ages.
+static void age_bitmap_word(uint64_t idle_bits, uint8_t* ages) {
+    if (idle_bits == 0) {
+        // All pages were accessed, or are not tracked at all.
+        memset(ages, 0, 32);
+        return;
+    }
+
+    for (size_t i = 0; i < 32; i++, idle_bits >>= 2) {
+        uint8_t lo = ages[i] & 0xf;
+        uint8_t hi = ages[i] >> 4;
+        lo = (idle_bits & 1) ? lo + (lo < PageIdleAger::kMaxAge) : 0;
+        hi = (idle_bits & 2) ? hi + (hi < PageIdleAger::kMaxAge) : 0;
+        ages[i] = lo | (hi << 4);
+    }
+}
+
+bool PageIdleAger::Init() {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(bitmap_path_.c_str(), O_RDWR | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to open " << bitmap_path_;
+        return false;
+    }
+
+    // The bitmap has no size, read it until the end to find out how many pages it covers.
+    std::vector<uint64_t> buf(kBitmapChunkWords);
+    uint64_t nr_words = 0;
+    while (true) {
+        ssize_t bytes = TEMP_FAILURE_RETRY(
+                pread64(fd, buf.data(), buf.size() * sizeof(uint64_t), nr_words * sizeof(uint64_t)));
+        if (bytes < 0) {
+            PLOG(ERROR) << "Failed to read " << bitmap_path_;
+            return false;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        nr_words += bytes / sizeof(uint64_t);
+    }
+    if (nr_words == 0) {
+        LOG(ERROR) << bitmap_path_ << " is empty";
+        return false;
+    }
+
+    bitmap_fd_ = std::move(fd);
+    nr_pfns_ = nr_words * 64;
+    ages_.assign(nr_pfns_ / 2, 0);
+    generations_ = 0;
+    return MarkAllIdle();
+}
+
+bool PageIdleAger::MarkAllIdle() {
+    const std::vector<uint64_t> buf(kBitmapChunkWords, ~0ULL);
+    const uint64_t nr_words = nr_pfns_ / 64;
+    for (uint64_t word = 0; word < nr_words; word += buf.size()) {
+        size_t bytes = std::min<uint64_t>(buf.size(), nr_words - word) * sizeof(uint64_t);
+        if (TEMP_FAILURE_RETRY(pwrite64(bitmap_fd_, buf.data(), bytes,
+                                        word * sizeof(uint64_t))) != static_cast<ssize_t>(bytes)) {
+            PLOG(ERROR) << "Failed to mark pages idle at pfn " << word * 64;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PageIdleAger::Age() {
+    if (bitmap_fd_ < 0) {
+        LOG(ERROR) << "Page idle aging was not initialized";
+        return false;
+    }
+
+    std::vector<uint64_t> buf(kBitmapChunkWords);
+    const uint64_t nr_words = nr_pfns_ / 64;
+    for (uint64_t word = 0; word < nr_words; word += buf.size()) {
+        size_t nr_chunk_words = std::min<uint64_t>(buf.size(), nr_words - word);
+        size_t bytes = nr_chunk_words * sizeof(uint64_t);
+        if (TEMP_FAILURE_RETRY(pread64(bitmap_fd_, buf.data(), bytes, word * sizeof(uint64_t))) !=
+            static_cast<ssize_t>(bytes)) {
+            PLOG(ERROR) << "Failed to read idle pages at pfn " << word * 64;
+            return false;
+        }
+        for (size_t i = 0; i < nr_chunk_words; i++) {
+            age_bitmap_word(buf[i], &ages_[(word + i) * 32]);
+        }
+    }
+
+    generations_++;
+    return MarkAllIdle();
+}
+
+bool PageIdleAger::ProcessAgeHistogram(pid_t pid, std::vector<uint64_t>* kb_by_age) const {
+    kb_by_age->resize(kMaxAge + 1);
+
+    std::string pagemap_file = ::android::base::StringPrintf("/proc/%d/pagemap", pid);
+    unique_fd pagemap_fd(TEMP_FAILURE_RETRY(open(pagemap_file.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (pagemap_fd < 0) {
+        PLOG(ERROR) << "Failed to open " << pagemap_file;
+        return false;
+    }
+
+    ProcMemInfo proc_mem(pid);
+    const std::vector<Vma>& maps = proc_mem.MapsWithoutUsageStats();
+    if (maps.empty()) {
+        return false;
+    }
+
+    const uint64_t pagesz = getpagesize();
+    const uint64_t pagesz_kb = pagesz / 1024;
+    std::vector<uint64_t> pagemap(kPagemapChunkPages);
+    for (const Vma& vma : maps) {
+        for (uint64_t page = vma.start / pagesz; page < vma.end / pagesz;) {
+            size_t nr_pages = std::min<uint64_t>(pagemap.size(), vma.end / pagesz - page);
+            size_t bytes = nr_pages * sizeof(uint64_t);
+            if (TEMP_FAILURE_RETRY(pread64(pagemap_fd, pagemap.data(), bytes,
+                                           page * sizeof(uint64_t))) !=
+                static_cast<ssize_t>(bytes)) {
+                PLOG(ERROR) << "Failed to read " << pagemap_file << " for vma " << vma.name;
+                return false;
+            }
+            for (size_t i = 0; i < nr_pages; i++) {
+                if (!PAGE_PRESENT(pagemap[i])) continue;
+                uint64_t pfn = PAGE_PFN(pagemap[i]);
+                if (pfn == 0) {
+                    LOG(ERROR) << "No page frame numbers in " << pagemap_file
+                               << ", CAP_SYS_ADMIN is required";
+                    return false;
+                }
+                (*kb_by_age)[PageAge(pfn)] += pagesz_kb;
+            }
+            page += nr_pages;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace meminfo
+}  // namespace android
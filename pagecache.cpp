@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <procinfo/process_map.h>
+
+#include "meminfo_private.h"
+
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
+
+namespace android {
+namespace meminfo {
+
+using ::android::base::StringPrintf;
+using ::android::base::unique_fd;
+
+// Mirrors of the uapi structs from <linux/mman.h>, which older headers don't have.
+struct CacheStatRange {
+    uint64_t off;
+    uint64_t len;
+};
+
+struct CacheStat {
+    uint64_t nr_cache;
+    uint64_t nr_dirty;
+    uint64_t nr_writeback;
+    uint64_t nr_evicted;
+    uint64_t nr_recently_evicted;
+};
+
+// Set once cachestat(2) fails because the kernel doesn't implement it (or it is filtered
+// out by seccomp), so that we don't keep trying for every file.
+static std::atomic_bool g_cachestat_unsupported(false);
+
+// Size of the window mapped at a time when falling back to mincore(2).
+static constexpr uint64_t kMincoreWindow = 1ULL << 30;
+
+static bool read_cachestat(int fd, PageCacheStats* stats) {
+    CacheStatRange range = {.off = 0, .len = 0};
+    CacheStat cs;
+    if (syscall(__NR_cachestat, fd, &range, &cs, 0) != 0) {
+        if (errno == ENOSYS || errno == EPERM) {
+            g_cachestat_unsupported = true;
+        } else if (errno != EOPNOTSUPP) {
+            PLOG(WARNING) << "cachestat failed";
+        }
+        return false;
+    }
+
+    stats->cached = cs.nr_cache;
+    stats->dirty = cs.nr_dirty;
+    stats->writeback = cs.nr_writeback;
+    stats->evicted = cs.nr_evicted;
+    stats->recently_evicted = cs.nr_recently_evicted;
+    stats->from_cachestat = true;
+    return true;
+}
+
+static bool read_mincore(int fd, uint64_t file_size, PageCacheStats* stats) {
+    const uint64_t pagesz = getpagesize();
+    std::vector<unsigned char> vec(kMincoreWindow / pagesz);
+
+    stats->cached = 0;
+    for (uint64_t off = 0; off < file_size; off += kMincoreWindow) {
+        uint64_t len = std::min(kMincoreWindow, file_size - off);
+        void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, off);
+        if (addr == MAP_FAILED) {
+            PLOG(WARNING) << "Failed to map file at offset " << off;
+            return false;
+        }
+        int ret = mincore(addr, len, vec.data());
+        munmap(addr, len);
+        if (ret != 0) {
+            PLOG(WARNING) << "mincore failed at offset " << off;
+            return false;
+        }
+        uint64_t nr_pages = (len + pagesz - 1) / pagesz;
+        for (uint64_t i = 0; i < nr_pages; i++) {
+            stats->cached += vec[i] & 1;
+        }
+    }
+    return true;
+}
+
+bool PageCacheStatsFromFd(int fd, PageCacheStats* stats, bool use_cachestat) {
+    stats->clear();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        PLOG(ERROR) << "Failed to stat fd " << fd;
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        LOG(ERROR) << "fd " << fd << " is not a regular file";
+        return false;
+    }
+
+    const uint64_t pagesz = getpagesize();
+    stats->size = (st.st_size + pagesz - 1) / pagesz;
+    if (stats->size == 0) {
+        return true;
+    }
+
+    if (use_cachestat && !g_cachestat_unsupported && read_cachestat(fd, stats)) {
+        return true;
+    }
+
+    return read_mincore(fd, st.st_size, stats);
+}
+
+bool PageCacheInfo::AddFileAt(const std::string& path, const std::string& open_path,
+                              ino_t inode) {
+    struct stat st;
+    if (stat(open_path.c_str(), &st) != 0) {
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || (inode != 0 && st.st_ino != inode)) {
+        return false;
+    }
+
+    std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+    path_keys_[path] = key;
+    if (files_.find(key) == files_.end()) {
+        files_[key] = PageCacheFile{.key = key,
+                                    .path = path,
+                                    .open_path = open_path,
+                                    .queried = false,
+                                    .stats = {}};
+    }
+    return true;
+}
+
+bool PageCacheInfo::AddVma(const Vma& vma, pid_t pid) {
+    // Only file backed vmas are of interest.
+    if (vma.inode == 0 || vma.name.empty() || vma.name[0] != '/') {
+        return true;
+    }
+
+    auto it = path_keys_.find(vma.name);
+    if (it != path_keys_.end() && it->second.second == vma.inode) {
+        return true;
+    }
+
+    if (!::android::base::EndsWith(vma.name, " (deleted)") &&
+        AddFileAt(vma.name, vma.name, vma.inode)) {
+        return true;
+    }
+
+    // The file has been deleted or replaced since it was mapped, or lives in a different
+    // mount namespace. Go through map_files instead.
+    if (pid > 0) {
+        std::string map_file =
+                StringPrintf("/proc/%d/map_files/%" PRIx64 "-%" PRIx64, pid, vma.start, vma.end);
+        if (AddFileAt(vma.name, map_file, vma.inode)) {
+            return true;
+        }
+    }
+
+    LOG(WARNING) << "Failed to find file for vma " << vma.name;
+    return false;
+}
+
+bool PageCacheInfo::AddFile(const std::string& path) {
+    if (!AddFileAt(path, path, 0)) {
+        PLOG(ERROR) << "Failed to add file " << path;
+        return false;
+    }
+    return true;
+}
+
+bool PageCacheInfo::AddProcess(pid_t pid) {
+    bool success = true;
+    auto collect_vmas = [&](const android::procinfo::MapInfo& mapinfo) {
+        Vma vma(mapinfo.start, mapinfo.end, mapinfo.pgoff, mapinfo.flags, mapinfo.name.c_str(),
+                mapinfo.inode, mapinfo.shared);
+        success &= AddVma(vma, pid);
+    };
+
+    std::string maps_file = StringPrintf("/proc/%d/maps", pid);
+    if (!::android::procinfo::ReadMapFile(maps_file, collect_vmas)) {
+        LOG(ERROR) << "Failed to read maps for Process " << pid;
+        return false;
+    }
+    return success;
+}
+
+bool PageCacheInfo::Scan() {
+    bool success = true;
+    for (auto& [key, file] : files_) {
+        if (file.queried) {
+            continue;
+        }
+        file.queried = true;
+
+        unique_fd fd(TEMP_FAILURE_RETRY(open(file.open_path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (fd == -1) {
+            PLOG(WARNING) << "Failed to open " << file.open_path;
+            success = false;
+            continue;
+        }
+        if (!PageCacheStatsFromFd(fd, &file.stats)) {
+            LOG(WARNING) << "Failed to read page cache stats for " << file.path;
+            success = false;
+        }
+    }
+    return success;
+}
+
+std::map<std::string, PageCacheStats> PageCacheInfo::GroupStats(
+        const PageCacheGroupFn& group_fn) const {
+    std::map<std::string, PageCacheStats> groups;
+    for (const auto& [key, file] : files_) {
+        if (!file.queried) {
+            continue;
+        }
+        auto [it, inserted] = groups.try_emplace(group_fn ? group_fn(file.path) : file.path);
+        PageCacheStats& group = it->second;
+        group.from_cachestat = (inserted || group.from_cachestat) && file.stats.from_cachestat;
+        group.size += file.stats.size;
+        group.cached += file.stats.cached;
+        group.dirty += file.stats.dirty;
+        group.writeback += file.stats.writeback;
+        group.evicted += file.stats.evicted;
+        group.recently_evicted += file.stats.recently_evicted;
+    }
+    return groups;
+}
+
+void PageCacheInfo::Reset() {
+    files_.clear();
+    path_keys_.clear();
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <lz4.h>
+
+#include "meminfo_private.h"
+
+using unique_fd = ::android::base::unique_fd;
+
+namespace android {
+namespace meminfo {
+
+// Number of pagemap entries read at a time.
+static constexpr size_t kPagemapChunkPages = 2048;
+
+// Number of pages read with a single process_vm_readv().
+static constexpr size_t kReadBatchPages = 64;
+
+// Vmas without a file that are not process memory.
+static constexpr const char* kSpecialVmas[] = {"[vvar]", "[vvar_vclock]", "[vdso]", "[vsyscall]"};
+
+static bool is_anon_vma(const Vma& vma) {
+    return vma.inode == 0 &&
+           std::none_of(std::begin(kSpecialVmas), std::end(kSpecialVmas),
+                        [&](const char* name) { return vma.name == name; });
+}
+
+// Hashes the page and finds out if all its words are the same. The hash only needs to
+// tell pages apart, multiplying by an odd constant and folding the high bits back mixes
+// every word into all bits.
+static uint64_t hash_page(const uint64_t* words, size_t nr_words, bool* same_filled) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    uint64_t diff = 0;
+    for (size_t i = 0; i < nr_words; i++) {
+        diff |= words[i] ^ words[0];
+        hash = (hash ^ words[i]) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    *same_filled = diff == 0;
+    return hash;
+}
+
+// Returns the size of the page in zram if compressed with LZ4. zram stores pages that don't
+// compress whole.
+static uint32_t compressed_size(const uint64_t* words, size_t pagesz, std::vector<char>* buf) {
+    int size = LZ4_compress_default(reinterpret_cast<const char*>(words), buf->data(), pagesz,
+                                    buf->size());
+    return size > 0 ? std::min<uint32_t>(size, pagesz) : pagesz;
+}
+
+bool PageContentSampler::AddProcess(pid_t pid) {
+    ProcMemInfo proc_mem(pid);
+    const std::vector<Vma>& maps = proc_mem.MapsWithoutUsageStats();
+    if (maps.empty()) {
+        return false;
+    }
+
+    std::vector<Vma> vmas;
+    std::copy_if(maps.begin(), maps.end(), std::back_inserter(vmas), is_anon_vma);
+    return AddVmas(pid, vmas);
+}
+
+bool PageContentSampler::AddVmas(pid_t pid, const std::vector<Vma>& vmas) {
+    std::string pagemap_file = ::android::base::StringPrintf("/proc/%d/pagemap", pid);
+    unique_fd pagemap_fd(TEMP_FAILURE_RETRY(open(pagemap_file.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (pagemap_fd < 0) {
+        PLOG(ERROR) << "Failed to open " << pagemap_file;
+        return false;
+    }
+
+    // Finds the resident pages first, so that the budget can be spread over all of them.
+    const uint64_t pagesz = getpagesize();
+    std::vector<uint64_t> pagemap(kPagemapChunkPages);
+    std::vector<uint64_t> addrs;
+    std::vector<uint32_t> addr_names;
+    for (const Vma& vma : vmas) {
+        const std::string& name = vma.name.empty() ? "[anon]" : vma.name;
+        auto name_it = name_ids_.find(name);
+        if (name_it == name_ids_.end()) {
+            name_it = name_ids_.emplace(name, names_.size()).first;
+            names_.push_back(name);
+            name_resident_pages_.push_back(0);
+        }
+
+        for (uint64_t page = vma.start / pagesz; page < vma.end / pagesz;) {
+            size_t nr_pages = std::min<uint64_t>(pagemap.size(), vma.end / pagesz - page);
+            size_t bytes = nr_pages * sizeof(uint64_t);
+            if (TEMP_FAILURE_RETRY(pread64(pagemap_fd, pagemap.data(), bytes,
+                                           page * sizeof(uint64_t))) !=
+                static_cast<ssize_t>(bytes)) {
+                PLOG(ERROR) << "Failed to read " << pagemap_file << " for vma " << vma.name;
+                return false;
+            }
+            for (size_t i = 0; i < nr_pages; i++) {
+                if (!PAGE_PRESENT(pagemap[i])) continue;
+                uint64_t pfn = PAGE_PFN(pagemap[i]);
+                if (pfn != 0 && !sampled_pfns_.insert(pfn).second) continue;
+                addrs.push_back((page + i) * pagesz);
+                addr_names.push_back(name_it->second);
+                name_resident_pages_[name_it->second]++;
+            }
+            page += nr_pages;
+        }
+    }
+
+    uint64_t nr_samples = std::min<uint64_t>(addrs.size(), page_budget_);
+    uint32_t proc = procs_.size();
+    procs_.push_back({.pid = pid, .resident_pages = addrs.size(), .scale = 0});
+
+    // Reads the pages in batches, each page from its own remote iovec. The kernel stops at
+    // the first page that can't be read, e.g. because it was unmapped meanwhile, which is
+    // skipped. The resident pages are scaled from the pages that were read only.
+    uint64_t nr_read_total = 0;
+    auto set_scale = [&]() {
+        if (nr_read_total) {
+            procs_[proc].scale = static_cast<double>(addrs.size()) / nr_read_total;
+        }
+    };
+    const size_t nr_words = pagesz / sizeof(uint64_t);
+    std::vector<uint64_t> buf(kReadBatchPages * nr_words);
+    std::vector<struct iovec> remote(kReadBatchPages);
+    std::vector<char> compressed(LZ4_compressBound(pagesz));
+    for (uint64_t sample = 0; sample < nr_samples;) {
+        size_t nr_batch = std::min<uint64_t>(kReadBatchPages, nr_samples - sample);
+        std::vector<uint32_t> batch_names(nr_batch);
+        for (size_t i = 0; i < nr_batch; i++) {
+            uint64_t addr = (sample + i) * addrs.size() / nr_samples;
+            remote[i] = {.iov_base = reinterpret_cast<void*>(addrs[addr]), .iov_len = pagesz};
+            batch_names[i] = addr_names[addr];
+        }
+        struct iovec local = {.iov_base = buf.data(), .iov_len = nr_batch * pagesz};
+        ssize_t bytes = process_vm_readv(pid, &local, 1, remote.data(), nr_batch, 0);
+        if (bytes < 0 && errno != EFAULT) {
+            PLOG(ERROR) << "Failed to read the memory of pid " << pid;
+            set_scale();
+            return false;
+        }
+
+        size_t nr_read = bytes < 0 ? 0 : bytes / pagesz;
+        nr_read_total += nr_read;
+        for (size_t i = 0; i < nr_read; i++) {
+            bool same_filled;
+            const uint64_t* words = buf.data() + i * nr_words;
+            uint64_t hash = hash_page(words, nr_words, &same_filled);
+            pages_.push_back({.hash = hash,
+                              .proc = proc,
+                              .name = batch_names[i],
+                              .compressed_size = 0,
+                              .zero = same_filled && words[0] == 0,
+                              .same_filled = same_filled});
+            if (compress_ && !same_filled) {
+                pages_.back().compressed_size = compressed_size(words, pagesz, &compressed);
+            }
+        }
+        sample += std::min(nr_read + 1, nr_batch);
+    }
+    set_scale();
+    return true;
+}
+
+void PageContentSampler::CountCopies(std::vector<uint32_t>* nr_copies,
+                                     std::vector<uint32_t>* nr_self_copies) const {
+    std::unordered_map<uint64_t, uint32_t> copies;
+    // Pages of a process are sampled together, counting the copies within a process only
+    // needs the pages of one process at a time.
+    std::unordered_map<uint64_t, uint32_t> self_copies;
+    for (size_t i = 0; i < pages_.size(); i++) {
+        copies[pages_[i].hash]++;
+    }
+
+    nr_copies->resize(pages_.size());
+    nr_self_copies->resize(pages_.size());
+    for (size_t first = 0; first < pages_.size();) {
+        size_t last = first;
+        self_copies.clear();
+        for (; last < pages_.size() && pages_[last].proc == pages_[first].proc; last++) {
+            self_copies[pages_[last].hash]++;
+        }
+        for (size_t i = first; i < last; i++) {
+            (*nr_copies)[i] = copies[pages_[i].hash];
+            (*nr_self_copies)[i] = self_copies[pages_[i].hash];
+        }
+        first = last;
+    }
+}
+
+void PageContentSampler::GroupStats(const std::vector<uint32_t>& groups,
+                                    std::vector<PageContentStats>* stats) const {
+    std::vector<uint32_t> nr_copies;
+    std::vector<uint32_t> nr_self_copies;
+    CountCopies(&nr_copies, &nr_self_copies);
+
+    const double pagesz = getpagesize();
+    for (size_t i = 0; i < pages_.size(); i++) {
+        const SampledPage& page = pages_[i];
+        PageContentStats& group = (*stats)[groups[i]];
+        const double scaled_pagesz = procs_[page.proc].scale * pagesz;
+        double duplicate = (nr_copies[i] - 1) / static_cast<double>(nr_copies[i]);
+
+        group.sampled_pages++;
+        group.zero_pages += page.zero;
+        group.same_filled_pages += page.same_filled;
+        group.duplicate_pages += duplicate;
+        group.self_duplicate_pages +=
+                (nr_self_copies[i] - 1) / static_cast<double>(nr_self_copies[i]);
+        group.ksm_savings_bytes += duplicate * scaled_pagesz;
+        group.zram_same_bytes += page.same_filled * scaled_pagesz;
+        group.compressed_bytes += page.compressed_size;
+        group.zram_bytes += page.compressed_size * procs_[page.proc].scale;
+    }
+    if (!compress_) {
+        return;
+    }
+
+    // The error is estimated from the variance of the ratio of the sampled pages, it gets
+    // smaller as a larger part of the resident pages is sampled.
+    std::vector<double> sq_sums(stats->size());
+    for (PageContentStats& group : *stats) {
+        if (group.sampled_pages) {
+            group.compression_ratio = group.compressed_bytes / (group.sampled_pages * pagesz);
+        }
+    }
+    for (size_t i = 0; i < pages_.size(); i++) {
+        double diff = pages_[i].compressed_size / pagesz - (*stats)[groups[i]].compression_ratio;
+        sq_sums[groups[i]] += diff * diff;
+    }
+    for (size_t i = 0; i < stats->size(); i++) {
+        PageContentStats& group = (*stats)[i];
+        uint64_t n = group.sampled_pages;
+        if (n < 2 || group.resident_pages <= n) {
+            continue;
+        }
+        double variance = sq_sums[i] / (n - 1);
+        double correction =
+                static_cast<double>(group.resident_pages - n) / (group.resident_pages - 1);
+        group.compression_ratio_error = 1.96 * std::sqrt(variance / n * correction);
+    }
+}
+
+void PageContentSampler::ProcessStats(std::map<pid_t, PageContentStats>* stats) const {
+    // A process added more than once is reported as a single group.
+    std::map<pid_t, uint32_t> pid_groups;
+    std::vector<uint32_t> proc_groups;
+    for (const SampledProcess& proc : procs_) {
+        proc_groups.push_back(pid_groups.try_emplace(proc.pid, pid_groups.size()).first->second);
+    }
+    std::vector<PageContentStats> group_stats(pid_groups.size());
+    for (size_t i = 0; i < procs_.size(); i++) {
+        group_stats[proc_groups[i]].resident_pages += procs_[i].resident_pages;
+    }
+
+    std::vector<uint32_t> groups;
+    for (const SampledPage& page : pages_) {
+        groups.push_back(proc_groups[page.proc]);
+    }
+    GroupStats(groups, &group_stats);
+
+    stats->clear();
+    for (const auto& [pid, group] : pid_groups) {
+        (*stats)[pid] = group_stats[group];
+    }
+}
+
+void PageContentSampler::VmaNameStats(std::map<std::string, PageContentStats>* stats) const {
+    std::vector<PageContentStats> group_stats(names_.size());
+    for (size_t i = 0; i < names_.size(); i++) {
+        group_stats[i].resident_pages = name_resident_pages_[i];
+    }
+
+    std::vector<uint32_t> groups;
+    for (const SampledPage& page : pages_) {
+        groups.push_back(page.name);
+    }
+    GroupStats(groups, &group_stats);
+
+    stats->clear();
+    for (size_t i = 0; i < names_.size(); i++) {
+        (*stats)[names_[i]] = group_stats[i];
+    }
+}
+
+}  // namespace meminfo
+}  // namespace android
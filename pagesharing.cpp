@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include "meminfo_private.h"
+
+using unique_fd = ::android::base::unique_fd;
+
+namespace android {
+namespace meminfo {
+
+// Number of pagemap entries read at a time.
+static constexpr size_t kPagemapChunkPages = 2048;
+
+// A page mapped by a process is stored as a single word holding the page frame number above
+// the index of its vma, and sorted while building the index as the page frame number above
+// the index of the process.
+static constexpr int kIdBits = 16;
+static constexpr uint64_t kIdMask = (1ULL << kIdBits) - 1;
+static constexpr uint64_t kMaxPfn = (1ULL << (64 - kIdBits)) - 1;
+
+// Returns the bucket of VmaSharingHistogram of a page mapped 'nr_maps' times.
+static uint8_t sharing_bucket(uint64_t nr_maps) {
+    uint8_t bucket = 0;
+    while (bucket + 1U < VmaSharingHistogram::kNrBuckets && (2ULL << bucket) <= nr_maps) {
+        bucket++;
+    }
+    return bucket;
+}
+
+bool PageSharingIndex::AddProcess(pid_t pid) {
+    std::string pagemap_file = ::android::base::StringPrintf("/proc/%d/pagemap", pid);
+    unique_fd pagemap_fd(TEMP_FAILURE_RETRY(open(pagemap_file.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (pagemap_fd < 0) {
+        PLOG(ERROR) << "Failed to open " << pagemap_file;
+        return false;
+    }
+
+    ProcMemInfo proc_mem(pid);
+    const std::vector<Vma>& maps = proc_mem.MapsWithoutUsageStats();
+    if (maps.empty()) {
+        return false;
+    }
+
+    PageAcct& pinfo = PageAcct::Instance();
+    const uint64_t pagesz = getpagesize();
+    std::vector<uint64_t> pagemap(kPagemapChunkPages);
+    std::vector<uint64_t> pfns;
+    std::vector<uint64_t> mapcounts;
+    for (const Vma& vma : maps) {
+        pfns.clear();
+        for (uint64_t page = vma.start / pagesz; page < vma.end / pagesz;) {
+            size_t nr_pages = std::min<uint64_t>(pagemap.size(), vma.end / pagesz - page);
+            size_t bytes = nr_pages * sizeof(uint64_t);
+            if (TEMP_FAILURE_RETRY(pread64(pagemap_fd, pagemap.data(), bytes,
+                                           page * sizeof(uint64_t))) !=
+                static_cast<ssize_t>(bytes)) {
+                PLOG(ERROR) << "Failed to read " << pagemap_file << " for vma " << vma.name;
+                return false;
+            }
+            for (size_t i = 0; i < nr_pages; i++) {
+                if (!PAGE_PRESENT(pagemap[i])) continue;
+                uint64_t pfn = PAGE_PFN(pagemap[i]);
+                if (pfn == 0) {
+                    LOG(ERROR) << "No page frame numbers in " << pagemap_file
+                               << ", CAP_SYS_ADMIN is required";
+                    return false;
+                }
+                pfns.push_back(pfn);
+            }
+            page += nr_pages;
+        }
+        if (!pfns.empty() && !pinfo.PageMapCounts(pfns, &mapcounts)) {
+            LOG(ERROR) << "Failed to read the mapcounts of vma " << vma.name << " of pid " << pid;
+            return false;
+        }
+        if (!AddVmaPages(pid, vma, pfns, mapcounts)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool PageSharingIndex::AddVmaPages(pid_t pid, const Vma& vma, const std::vector<uint64_t>& pfns,
+                                   const std::vector<uint64_t>& mapcounts) {
+    if (built_) {
+        LOG(ERROR) << "Failed to add pages of pid " << pid << ", the index is already built";
+        return false;
+    }
+    if (pfns.empty()) {
+        return true;
+    }
+    if (mapcounts.size() != pfns.size()) {
+        LOG(ERROR) << "Mismatched mapcounts of vma " << vma.name << " of pid " << pid;
+        return false;
+    }
+    if (std::any_of(pfns.begin(), pfns.end(), [](uint64_t pfn) { return pfn > kMaxPfn; })) {
+        LOG(ERROR) << "Invalid page frame number in vma " << vma.name << " of pid " << pid;
+        return false;
+    }
+
+    auto it = proc_ids_.find(pid);
+    if (it == proc_ids_.end()) {
+        if (pids_.size() > kIdMask) {
+            LOG(ERROR) << "Failed to add pid " << pid << ", too many processes";
+            return false;
+        }
+        it = proc_ids_.emplace(pid, pids_.size()).first;
+        pids_.push_back(pid);
+        procs_.emplace_back();
+    }
+
+    ProcessPages& proc = procs_[it->second];
+    if (proc.vmas.size() > kIdMask) {
+        LOG(ERROR) << "Failed to add vma " << vma.name << " of pid " << pid << ", too many vmas";
+        return false;
+    }
+    uint64_t vma_id = proc.vmas.size();
+    proc.vmas.push_back({.start = vma.start, .end = vma.end, .name = vma.name});
+    for (size_t i = 0; i < pfns.size(); i++) {
+        proc.pages.push_back((pfns[i] << kIdBits) | vma_id);
+        mapcounts_.push_back((pfns[i] << kIdBits) | std::min(mapcounts[i], kIdMask));
+    }
+    return true;
+}
+
+void PageSharingIndex::Build() {
+    if (built_) {
+        return;
+    }
+    built_ = true;
+
+    // Sorting the pages of each process lets the walk below find the pages of a page frame
+    // with a cursor per process. Sorting all pages at once brings the processes that map a
+    // page frame next to each other, in the order of their index.
+    size_t nr_pages = 0;
+    for (ProcessPages& proc : procs_) {
+        std::sort(proc.pages.begin(), proc.pages.end());
+        proc.buckets.resize(proc.pages.size());
+        proc.indexed_buckets.resize(proc.pages.size());
+        nr_pages += proc.pages.size();
+    }
+    std::sort(mapcounts_.begin(), mapcounts_.end());
+    std::vector<uint64_t> keys;
+    keys.reserve(nr_pages);
+    for (size_t i = 0; i < procs_.size(); i++) {
+        for (uint64_t page : procs_[i].pages) {
+            keys.push_back((page & ~kIdMask) | i);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    // A process may map the same page more than once.
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    auto same_set = [this](uint32_t set, const std::vector<uint16_t>& members) {
+        return std::equal(set_members_.begin() + set_offsets_[set],
+                          set_members_.begin() + set_offsets_[set + 1], members.begin(),
+                          members.end());
+    };
+
+    // Sets of sharers by their members, as raw bytes. Private pages are the most common,
+    // the sets of a single process are looked up by its index instead.
+    std::unordered_map<std::string, int64_t> set_ids;
+    std::vector<int64_t> private_set_ids(procs_.size(), -1);
+    std::vector<size_t> cursors(procs_.size());
+    std::vector<uint16_t> members;
+    size_t mapcount_cursor = 0;
+    set_offsets_.assign(1, 0);
+    for (size_t k = 0; k < keys.size();) {
+        uint64_t pfn = keys[k] >> kIdBits;
+        members.clear();
+        for (; k < keys.size() && (keys[k] >> kIdBits) == pfn; k++) {
+            members.push_back(keys[k] & kIdMask);
+        }
+
+        // The mapcount of a page is read once per process that maps it, and may differ if
+        // the page was mapped or unmapped in between, the largest is kept. Both lists hold
+        // the same page frames in ascending order.
+        uint64_t mapcount = 0;
+        for (; mapcount_cursor < mapcounts_.size() &&
+               (mapcounts_[mapcount_cursor] >> kIdBits) == pfn;
+             mapcount_cursor++) {
+            mapcount = std::max(mapcount, mapcounts_[mapcount_cursor] & kIdMask);
+        }
+        uint8_t bucket = sharing_bucket(mapcount);
+        uint8_t indexed_bucket = sharing_bucket(members.size());
+        for (uint16_t member : members) {
+            ProcessPages& proc = procs_[member];
+            size_t& cursor = cursors[member];
+            for (; cursor < proc.pages.size() && (proc.pages[cursor] >> kIdBits) == pfn; cursor++) {
+                proc.buckets[cursor] = bucket;
+                proc.indexed_buckets[cursor] = indexed_bucket;
+            }
+        }
+
+        // Consecutive page frames are often mapped by the same processes, e.g. the pages
+        // of a large folio, extending the last run avoids the lookup of the set.
+        if (!runs_.empty()) {
+            Run& last = runs_.back();
+            if (last.pfn + last.nr_pages == pfn && same_set(last.set, members)) {
+                last.nr_pages++;
+                set_pages_[last.set]++;
+                continue;
+            }
+        }
+
+        int64_t* set_id;
+        if (members.size() == 1) {
+            set_id = &private_set_ids[members[0]];
+        } else {
+            std::string set_key(reinterpret_cast<const char*>(members.data()),
+                                members.size() * sizeof(uint16_t));
+            set_id = &set_ids.try_emplace(std::move(set_key), -1).first->second;
+        }
+        if (*set_id < 0) {
+            *set_id = set_pages_.size();
+            set_members_.insert(set_members_.end(), members.begin(), members.end());
+            set_offsets_.push_back(set_members_.size());
+            set_pages_.push_back(0);
+        }
+        runs_.push_back({.pfn = pfn, .nr_pages = 1, .set = static_cast<uint32_t>(*set_id)});
+        set_pages_[*set_id]++;
+    }
+    runs_.shrink_to_fit();
+    mapcounts_.clear();
+    mapcounts_.shrink_to_fit();
+}
+
+const PageSharingIndex::Run* PageSharingIndex::FindRun(uint64_t pfn) const {
+    auto it = std::upper_bound(runs_.begin(), runs_.end(), pfn,
+                               [](uint64_t pfn, const Run& run) { return pfn < run.pfn; });
+    if (it == runs_.begin()) {
+        return nullptr;
+    }
+    --it;
+    return pfn < it->pfn + it->nr_pages ? &*it : nullptr;
+}
+
+std::vector<pid_t> PageSharingIndex::Sharers(uint64_t pfn) const {
+    std::vector<pid_t> sharers;
+    const Run* run = FindRun(pfn);
+    if (run) {
+        for (uint32_t i = set_offsets_[run->set]; i < set_offsets_[run->set + 1]; i++) {
+            sharers.push_back(pids_[set_members_[i]]);
+        }
+    }
+    return sharers;
+}
+
+void PageSharingIndex::SharedBytesMatrix(std::vector<uint64_t>* matrix) const {
+    const size_t n = pids_.size();
+    const uint64_t pagesz = getpagesize();
+    matrix->assign(n * n, 0);
+    for (size_t set = 0; set < set_pages_.size(); set++) {
+        uint64_t bytes = set_pages_[set] * pagesz;
+        for (uint32_t i = set_offsets_[set]; i < set_offsets_[set + 1]; i++) {
+            uint64_t* row = matrix->data() + set_members_[i] * n;
+            for (uint32_t j = set_offsets_[set]; j < set_offsets_[set + 1]; j++) {
+                row[set_members_[j]] += bytes;
+            }
+        }
+    }
+}
+
+void PageSharingIndex::ZygoteSharingStats(const std::set<pid_t>& zygote_pids,
+                                          std::vector<ZygoteSharing>* stats) const {
+    std::vector<bool> is_zygote(pids_.size());
+    for (size_t i = 0; i < pids_.size(); i++) {
+        is_zygote[i] = zygote_pids.count(pids_[i]);
+    }
+
+    const uint64_t pagesz = getpagesize();
+    stats->assign(pids_.size(), {});
+    for (size_t set = 0; set < set_pages_.size(); set++) {
+        uint64_t bytes = set_pages_[set] * pagesz;
+        uint32_t first = set_offsets_[set];
+        uint32_t last = set_offsets_[set + 1];
+        if (last - first == 1) {
+            (*stats)[set_members_[first]].private_bytes += bytes;
+            continue;
+        }
+
+        uint32_t nr_zygotes = 0;
+        for (uint32_t i = first; i < last; i++) {
+            nr_zygotes += is_zygote[set_members_[i]];
+        }
+        for (uint32_t i = first; i < last; i++) {
+            ZygoteSharing& proc = (*stats)[set_members_[i]];
+            // A zygote only counts memory shared with another zygote as zygote shared.
+            if (nr_zygotes > is_zygote[set_members_[i]]) {
+                proc.zygote_shared_bytes += bytes;
+            } else {
+                proc.other_shared_bytes += bytes;
+            }
+        }
+    }
+}
+
+bool PageSharingIndex::VmaSharingHistograms(pid_t pid,
+                                            std::vector<VmaSharingHistogram>* histograms) const {
+    if (!built_) {
+        LOG(ERROR) << "Failed to get sharing histograms of pid " << pid << ", index not built";
+        return false;
+    }
+    auto it = proc_ids_.find(pid);
+    if (it == proc_ids_.end()) {
+        return false;
+    }
+
+    const ProcessPages& proc = procs_[it->second];
+    histograms->clear();
+    for (const VmaPages& vma : proc.vmas) {
+        VmaSharingHistogram histogram = {.start = vma.start, .end = vma.end, .name = vma.name};
+        histogram.pages.fill(0);
+        histogram.indexed_pages.fill(0);
+        histograms->push_back(std::move(histogram));
+    }
+    for (size_t i = 0; i < proc.pages.size(); i++) {
+        VmaSharingHistogram& histogram = (*histograms)[proc.pages[i] & kIdMask];
+        histogram.pages[proc.buckets[i]]++;
+        histogram.indexed_pages[proc.indexed_buckets[i]]++;
+    }
+    return true;
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -18,19 +18,26 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <linux/kernel-page-flags.h>
+#include <limits.h>
 #include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
@@ -51,19 +58,20 @@ static const std::vector<std::string> g_excluded_vmas = {
 #endif
 };
 
-static void add_mem_usage(MemUsage* to, const MemUsage& from) {
-    to->vss += from.vss;
-    to->rss += from.rss;
-    to->pss += from.pss;
-    to->uss += from.uss;
+// The Pss read from pagemap is added up in fixed point like the kernel does for smaps, see
+// PSS_SHIFT in fs/proc/task_mmu.c, so that the shares of pages mapped by many processes
+// aren't truncated to 0 kB each and the Pss of a vma matches its Pss in smaps.
+static constexpr uint64_t kPssShift = 12;
 
-    to->swap += from.swap;
-
-    to->private_clean += from.private_clean;
-    to->private_dirty += from.private_dirty;
+// Returns the share of a page mapped 'mapcount' times, in the fixed point of kPssShift.
+template <uint64_t kPageSize>
+static inline uint64_t pss_share(uint64_t mapcount) {
+    return (kPageSize << kPssShift) / mapcount;
+}
 
-    to->shared_clean += from.shared_clean;
-    to->shared_dirty += from.shared_dirty;
+// Converts a sum of pss_share() to kB.
+static inline uint64_t pss_to_kb(uint64_t pss) {
+    return pss >> (kPssShift + 10);
 }
 
 // Converts MemUsage stats from KB to B in case usage is expected in bytes.
@@ -149,6 +157,12 @@ static bool parse_smaps_field(const char* line, MemUsage* stats) {
                     stats->locked = strtoull(c, nullptr, 10);
                 }
                 break;
+            case 'T':
+                // Follows 'Size:', so the size of the vma is already known.
+                if (strncmp(line, "THPeligible:", 12) == 0) {
+                    stats->thp_eligible = strtoull(c, nullptr, 10) ? stats->vss : 0;
+                }
+                break;
         }
         return true;
     }
@@ -167,7 +181,11 @@ bool ProcMemInfo::ResetWorkingSet(pid_t pid) {
 }
 
 ProcMemInfo::ProcMemInfo(pid_t pid, bool get_wss, uint64_t pgflags, uint64_t pgflags_mask)
-    : pid_(pid), get_wss_(get_wss), pgflags_(pgflags), pgflags_mask_(pgflags_mask) {}
+    : pid_(pid),
+      get_wss_(get_wss),
+      pgflags_(pgflags),
+      pgflags_mask_(pgflags_mask),
+      memcg_usage_read_(false) {}
 
 const std::vector<Vma>& ProcMemInfo::Maps() {
     if (maps_.empty() && !ReadMaps(get_wss_)) {
@@ -275,22 +293,16 @@ const MemUsage& ProcMemInfo::Wss() {
     return usage_;
 }
 
+std::string ProcMemInfo::VmaFilePath(bool use_smaps) const {
+    return ::android::base::StringPrintf("/proc/%d/%s", pid_, use_smaps ? "smaps" : "maps");
+}
+
 bool ProcMemInfo::ForEachVma(const VmaCallback& callback, bool use_smaps) {
-    std::string path =
-            ::android::base::StringPrintf("/proc/%d/%s", pid_, use_smaps ? "smaps" : "maps");
-    return ForEachVmaFromFile(path, callback, use_smaps);
+    return ForEachVma<const VmaCallback&>(callback, use_smaps);
 }
 
 bool ProcMemInfo::ForEachExistingVma(const VmaCallback& callback) {
-    if (maps_.empty()) {
-        return false;
-    }
-    for (auto& vma : maps_) {
-        if (!callback(vma)) {
-            return false;
-        }
-    }
-    return true;
+    return ForEachExistingVma<const VmaCallback&>(callback);
 }
 
 bool ProcMemInfo::ForEachVmaFromMaps(const VmaCallback& callback) {
@@ -332,6 +344,310 @@ bool ProcMemInfo::ForEachVmaFromMaps(const VmaCallback& callback, std::string& m
     return success;
 }
 
+// Mirror of struct procmap_query from <linux/fs.h>, which was added in Linux 6.11 and is
+// missing from older headers.
+struct ProcmapQuery {
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+};
+
+static constexpr unsigned long kProcmapQuery = _IOWR('f', 17, ProcmapQuery);
+static constexpr uint64_t kProcmapQueryVmaReadable = 0x01;
+static constexpr uint64_t kProcmapQueryVmaWritable = 0x02;
+static constexpr uint64_t kProcmapQueryVmaExecutable = 0x04;
+static constexpr uint64_t kProcmapQueryVmaShared = 0x08;
+static constexpr uint64_t kProcmapQueryCoveringOrNextVma = 0x10;
+
+static bool is_excluded_vma(const std::string& name) {
+    return std::find(g_excluded_vmas.begin(), g_excluded_vmas.end(), name) !=
+           g_excluded_vmas.end();
+}
+
+// Enumerates the vmas of the process with the PROCMAP_QUERY ioctl on its maps file, which
+// skips formatting and parsing the text of every vma, and adds the ones accepted by
+// 'predicate' to 'vmas'. Returns false if the maps can't be queried this way, e.g. if the
+// kernel doesn't support the ioctl.
+static bool query_matching_vmas(pid_t pid, const VmaPredicate& predicate,
+                                std::vector<Vma>* vmas) {
+    std::string maps_file = ::android::base::StringPrintf("/proc/%d/maps", pid);
+    ::android::base::unique_fd maps_fd(
+            TEMP_FAILURE_RETRY(open(maps_file.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (maps_fd < 0) {
+        return false;
+    }
+
+    char name[PATH_MAX];
+    Vma vma;
+    for (uint64_t addr = 0;;) {
+        ProcmapQuery query = {
+                .size = sizeof(query),
+                .query_flags = kProcmapQueryCoveringOrNextVma,
+                .query_addr = addr,
+                .vma_name_size = sizeof(name),
+                .vma_name_addr = reinterpret_cast<uintptr_t>(name),
+        };
+        if (ioctl(maps_fd, kProcmapQuery, &query) == -1) {
+            // There are no more vmas past 'addr', or no address space at all for kernel
+            // threads.
+            if (errno == ENOENT || errno == ESRCH) return true;
+            if (errno != ENOTTY && errno != EINVAL) {
+                PLOG(WARNING) << "PROCMAP_QUERY failed for " << maps_file;
+            }
+            vmas->clear();
+            return false;
+        }
+
+        vma.start = query.vma_start;
+        vma.end = query.vma_end;
+        vma.offset = query.vma_offset;
+        vma.flags = ((query.vma_flags & kProcmapQueryVmaReadable) ? PROT_READ : 0) |
+                    ((query.vma_flags & kProcmapQueryVmaWritable) ? PROT_WRITE : 0) |
+                    ((query.vma_flags & kProcmapQueryVmaExecutable) ? PROT_EXEC : 0);
+        vma.is_shared = query.vma_flags & kProcmapQueryVmaShared;
+        vma.inode = query.inode;
+        // The size includes the terminating null byte, or is 0 for vmas without a name.
+        vma.name.assign(name, query.vma_name_size ? query.vma_name_size - 1 : 0);
+        if (!is_excluded_vma(vma.name) && predicate(vma)) {
+            vmas->emplace_back(vma);
+        }
+        addr = query.vma_end;
+    }
+}
+
+bool ProcMemInfo::ForEachMatchingVma(const VmaPredicate& predicate, const VmaCallback& callback) {
+    std::vector<Vma> vmas;
+    if (!query_matching_vmas(pid_, predicate, &vmas)) {
+        std::string maps_file = ::android::base::StringPrintf("/proc/%d/maps", pid_);
+        Vma vma;
+        if (!::android::procinfo::ReadMapFile(
+                    maps_file, [&](const android::procinfo::MapInfo& mapinfo) {
+                        vma.start = mapinfo.start;
+                        vma.end = mapinfo.end;
+                        vma.flags = mapinfo.flags;
+                        vma.offset = mapinfo.pgoff;
+                        vma.name = mapinfo.name;
+                        vma.inode = mapinfo.inode;
+                        vma.is_shared = mapinfo.shared;
+                        if (!is_excluded_vma(vma.name) && predicate(vma)) {
+                            vmas.emplace_back(vma);
+                        }
+                    })) {
+            LOG(ERROR) << "Failed to parse " << maps_file;
+            return false;
+        }
+    }
+    if (vmas.empty()) {
+        return true;
+    }
+
+    ::android::base::unique_fd pagemap_fd(GetPagemapFd(pid_));
+    if (pagemap_fd == -1) {
+        return false;
+    }
+
+    // Don't leave the swap offsets of the matching vmas behind in 'swap_offsets_'.
+    const size_t nr_swap_offsets = swap_offsets_.size();
+    bool success = true;
+    for (Vma& vma : vmas) {
+        if (!ReadVmaStats(pagemap_fd.get(), vma, get_wss_, false, true, true)) {
+            LOG(ERROR) << "Failed to read page map for vma " << vma.name << "[" << vma.start
+                       << "-" << vma.end << "]";
+            success = false;
+            break;
+        }
+        if (!callback(vma)) {
+            success = false;
+            break;
+        }
+    }
+    swap_offsets_.resize(std::min(swap_offsets_.size(), nr_swap_offsets));
+    return success;
+}
+
+bool ProcMemInfo::ForEachNumaVma(const NumaVmaCallback& callback) {
+    // numa_maps only has the start address of each vma, so pair it up with maps. Both
+    // files list the vmas in the same (ascending) order.
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (!ForEachVmaFromMaps([&](Vma& vma) {
+            ranges.emplace_back(vma.start, vma.end);
+            return true;
+        })) {
+        LOG(ERROR) << "Failed to read maps for Process " << pid_;
+        return false;
+    }
+
+    size_t cur_range = 0;
+    auto match_vma = [&](NumaVma& vma) {
+        while (cur_range < ranges.size() && ranges[cur_range].first < vma.start) {
+            cur_range++;
+        }
+        if (cur_range < ranges.size() && ranges[cur_range].first == vma.start) {
+            vma.end = ranges[cur_range].second;
+        }
+        return callback(vma);
+    };
+
+    std::string path = ::android::base::StringPrintf("/proc/%d/numa_maps", pid_);
+    return ForEachNumaVmaFromFile(path, match_vma);
+}
+
+bool ProcMemInfo::NumaUsageKb(NumaUsage* usage) const {
+    std::string path = ::android::base::StringPrintf("/proc/%d/numa_maps", pid_);
+    return NumaUsageKbFromFile(path, usage);
+}
+
+static void thp_usage_from_vma(const Vma& vma, ThpUsage* usage) {
+    usage->clear();
+    usage->vss = vma.usage.vss;
+    usage->rss = vma.usage.rss;
+    usage->thp = vma.usage.anon_huge_pages + vma.usage.shmem_pmd_mapped +
+                 vma.usage.file_pmd_mapped;
+    usage->eligible = vma.usage.thp_eligible;
+    if (usage->eligible && usage->rss > usage->thp) {
+        usage->eligible_unbacked = usage->rss - usage->thp;
+    }
+}
+
+// Returns the number of base pages in a PMD sized transparent huge page.
+static uint64_t hpage_pmd_pages() {
+    std::string content;
+    uint64_t size;
+    if (!::android::base::ReadFileToString("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+                                           &content) ||
+        !::android::base::ParseUint(::android::base::Trim(content), &size) || size == 0) {
+        size = 2 * 1024 * 1024;
+    }
+    return size / getpagesize();
+}
+
+// Walks the pagemap of the vmas and adds the subpages of PMD sized huge pages that are
+// not mapped by the process to the 'bloat' of the vma that maps the first subpage found.
+static bool read_thp_bloat(pid_t pid, std::vector<std::pair<Vma, ThpUsage>>* vmas) {
+    // Kernel threads have no pagemap to read.
+    if (vmas->empty()) {
+        return true;
+    }
+
+    PageAcct& pinfo = PageAcct::Instance();
+    if (!pinfo.InitPageAcct()) {
+        LOG(ERROR) << "Failed to init page accounting";
+        return false;
+    }
+
+    std::string pagemap_file = ::android::base::StringPrintf("/proc/%d/pagemap", pid);
+    ::android::base::unique_fd pagemap_fd(
+            TEMP_FAILURE_RETRY(open(pagemap_file.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (pagemap_fd < 0) {
+        PLOG(ERROR) << "Failed to open " << pagemap_file;
+        return false;
+    }
+
+    const uint64_t pagesz = getpagesize();
+    const uint64_t hpage_pages = hpage_pmd_pages();
+    // Head pfn of each huge page -> number of its subpages mapped by the process and the
+    // index of the vma it is attributed to.
+    std::unordered_map<uint64_t, std::pair<uint64_t, size_t>> hpages;
+    std::vector<uint64_t> pagemap(2048);
+    for (size_t i = 0; i < vmas->size(); i++) {
+        const Vma& vma = (*vmas)[i].first;
+        if (vma.usage.rss == 0 || std::find(g_excluded_vmas.begin(), g_excluded_vmas.end(),
+                                            vma.name) != g_excluded_vmas.end()) {
+            continue;
+        }
+        for (uint64_t page = vma.start / pagesz; page < vma.end / pagesz;) {
+            size_t nr_pages = std::min<uint64_t>(pagemap.size(), vma.end / pagesz - page);
+            ssize_t bytes = nr_pages * sizeof(uint64_t);
+            if (pread64(pagemap_fd, pagemap.data(), bytes, page * sizeof(uint64_t)) != bytes) {
+                PLOG(ERROR) << "Failed to read " << pagemap_file << " for vma " << vma.name;
+                return false;
+            }
+            for (size_t j = 0; j < nr_pages; j++) {
+                if (!PAGE_PRESENT(pagemap[j])) continue;
+                uint64_t pfn = PAGE_PFN(pagemap[j]);
+                if (pfn == 0) {
+                    LOG(ERROR) << "No page frame numbers in " << pagemap_file
+                               << ", CAP_SYS_ADMIN is required";
+                    return false;
+                }
+                uint64_t flags;
+                if (!pinfo.PageFlags(pfn, &flags)) {
+                    return false;
+                }
+                if (!KPAGEFLAG_THP(flags) || (flags & (1ULL << KPF_ZERO_PAGE))) continue;
+                auto [it, inserted] = hpages.try_emplace(pfn & ~(hpage_pages - 1), 0, i);
+                it->second.first++;
+            }
+            page += nr_pages;
+        }
+    }
+
+    const uint64_t pagesz_kb = pagesz / 1024;
+    std::vector<uint64_t> flags;
+    for (const auto& [head, mapping] : hpages) {
+        const auto& [nr_mapped, vma_index] = mapping;
+        if (nr_mapped >= hpage_pages) continue;
+
+        // Smaller, multi-size huge pages don't span the whole aligned range. Only count
+        // the range if it is a single PMD sized compound page.
+        if (!pinfo.PageFlags(head, hpage_pages + 1, &flags)) {
+            return false;
+        }
+        bool is_pmd_sized = (flags[0] & (1ULL << KPF_COMPOUND_HEAD)) &&
+                            !(flags[hpage_pages] & (1ULL << KPF_COMPOUND_TAIL));
+        for (size_t i = 1; is_pmd_sized && i < hpage_pages; i++) {
+            is_pmd_sized = flags[i] & (1ULL << KPF_COMPOUND_TAIL);
+        }
+        if (is_pmd_sized) {
+            (*vmas)[vma_index].second.bloat += (hpage_pages - nr_mapped) * pagesz_kb;
+        }
+    }
+    return true;
+}
+
+bool ProcMemInfo::ThpUsageKb(ThpUsage* usage, const ThpVmaCallback& callback,
+                             bool get_bloat) const {
+    std::string path = ::android::base::StringPrintf("/proc/%d/smaps", pid_);
+    if (!get_bloat) {
+        return ThpUsageKbFromFile(path, usage, callback);
+    }
+
+    // The bloat of a vma is only known once all vmas were walked, as the subpages of a
+    // huge page may be spread over several of them.
+    std::vector<std::pair<Vma, ThpUsage>> vmas;
+    if (!ForEachVmaFromFile(path, [&](Vma& vma) {
+            vmas.emplace_back(vma, ThpUsage());
+            thp_usage_from_vma(vma, &vmas.back().second);
+            return true;
+        })) {
+        return false;
+    }
+    if (!read_thp_bloat(pid_, &vmas)) {
+        return false;
+    }
+
+    usage->clear();
+    for (const auto& [vma, vma_usage] : vmas) {
+        usage->add(vma_usage);
+        if (callback) {
+            callback(vma, vma_usage);
+        }
+    }
+    return true;
+}
+
 bool ProcMemInfo::SmapsOrRollup(MemUsage* stats) const {
     std::string path = ::android::base::StringPrintf(
             "/proc/%d/%s", pid_, IsSmapsRollupSupported() ? "smaps_rollup" : "smaps");
@@ -349,6 +665,56 @@ bool ProcMemInfo::StatusVmRSS(uint64_t* rss) const {
     return StatusVmRSSFromFile(path, rss);
 }
 
+const std::map<uint64_t, MemUsage>& ProcMemInfo::MemcgUsage() {
+    if (memcg_usage_read_) {
+        return memcg_usage_;
+    }
+    memcg_usage_read_ = true;
+
+    // If the maps haven't been read yet, read them along with their usage so that the
+    // pagemap is walked only once. Otherwise read into copies of the vmas and drop the swap
+    // offsets collected on the way, leaving 'maps_', 'usage_' and 'swap_offsets_' as they were.
+    bool read_maps = maps_.empty();
+    if (read_maps && !ReadMaps(get_wss_, false, false)) {
+        LOG(ERROR) << "Failed to get memory cgroup usage for Process " << pid_;
+        return memcg_usage_;
+    }
+
+    ::android::base::unique_fd pagemap_fd(GetPagemapFd(pid_));
+    if (pagemap_fd == -1) {
+        if (read_maps) maps_.clear();
+        return memcg_usage_;
+    }
+
+    size_t nr_swap_offsets = swap_offsets_.size();
+    for (auto& vma : maps_) {
+        Vma vma_copy(vma);
+        vma_copy.clear();
+        if (!ReadVmaStats(pagemap_fd.get(), read_maps ? vma : vma_copy, get_wss_, false, true,
+                          read_maps, &memcg_usage_)) {
+            LOG(ERROR) << "Failed to read page map for vma " << vma.name << "[" << vma.start
+                       << "-" << vma.end << "]";
+            memcg_usage_.clear();
+            if (read_maps) {
+                maps_.clear();
+                usage_.clear();
+            }
+            return memcg_usage_;
+        }
+        if (read_maps) {
+            add_mem_usage(&usage_, vma.usage);
+        }
+    }
+    if (!read_maps) {
+        swap_offsets_.resize(nr_swap_offsets);
+    }
+    for (auto& [memcg, usage] : memcg_usage_) {
+        usage.pss = pss_to_kb(usage.pss);
+    }
+
+    return memcg_usage_;
+}
+
 const std::vector<uint64_t>& ProcMemInfo::SwapOffsets() {
     if (get_wss_) {
         LOG(WARNING) << "Trying to read process swap offsets for " << pid_
@@ -464,192 +830,462 @@ bool ProcMemInfo::FillInVmaStats(Vma& vma, bool use_kb) {
     return true;
 }
 
-bool ProcMemInfo::ReadVmaStats(int pagemap_fd, Vma& vma, bool get_wss, bool use_pageidle,
-                               bool update_mem_usage, bool update_swap_usage) {
-    PageAcct& pinfo = PageAcct::Instance();
-    if (get_wss && use_pageidle && !pinfo.InitPageAcct(true)) {
-        LOG(ERROR) << "Failed to init idle page accounting";
+bool ProcMemInfo::FillInVmasStats(std::vector<Vma>* vmas) {
+    ::android::base::unique_fd pagemap_fd(GetPagemapFd(pid_));
+    if (pagemap_fd == -1) {
         return false;
     }
 
-    uint64_t pagesz_kb = getpagesize() / 1024;
-    size_t num_pages = (vma.end - vma.start) / getpagesize();
-    size_t first_page = vma.start / getpagesize();
-
-    std::vector<uint64_t> page_cache;
-    size_t cur_page_cache_index = 0;
-    size_t num_in_page_cache = 0;
-    size_t num_leftover_pages = num_pages;
-    for (size_t cur_page = first_page; cur_page < first_page + num_pages; ++cur_page) {
-        // Cache page map data.
-        if (cur_page_cache_index == num_in_page_cache) {
-            static constexpr size_t kMaxPages = 2048;
-            num_leftover_pages -= num_in_page_cache;
-            if (num_leftover_pages > kMaxPages) {
-                num_in_page_cache = kMaxPages;
+    for (auto& vma : *vmas) {
+        if (!ReadVmaStats(pagemap_fd.get(), vma, get_wss_, false, true, true)) {
+            LOG(ERROR) << "Failed to read page map for vma " << vma.name << "[" << vma.start
+                       << "-" << vma.end << "]";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Accounting modes of ReadVmaStats. They are fixed for a whole vma, so read_vma_stats() is
+// instantiated for every consistent combination of them and the per page loop doesn't
+// check any of them.
+enum VmaStatsMode : uint32_t {
+    kVmaStatsSwapUsage = 1 << 0,
+    kVmaStatsMemUsage = 1 << 1,
+    kVmaStatsWss = 1 << 2,
+    // Only with kVmaStatsMemUsage and kVmaStatsWss.
+    kVmaStatsPageIdle = 1 << 3,
+    // Only with kVmaStatsMemUsage.
+    kVmaStatsMemcg = 1 << 4,
+};
+
+using VmaStatsModes = std::integer_sequence<
+        uint32_t, 0, kVmaStatsSwapUsage, kVmaStatsWss, kVmaStatsWss | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage, kVmaStatsMemUsage | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage | kVmaStatsWss, kVmaStatsMemUsage | kVmaStatsWss | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage | kVmaStatsWss | kVmaStatsPageIdle,
+        kVmaStatsMemUsage | kVmaStatsWss | kVmaStatsPageIdle | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage | kVmaStatsMemcg, kVmaStatsMemUsage | kVmaStatsMemcg | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage | kVmaStatsMemcg | kVmaStatsWss,
+        kVmaStatsMemUsage | kVmaStatsMemcg | kVmaStatsWss | kVmaStatsSwapUsage,
+        kVmaStatsMemUsage | kVmaStatsMemcg | kVmaStatsWss | kVmaStatsPageIdle,
+        kVmaStatsMemUsage | kVmaStatsMemcg | kVmaStatsWss | kVmaStatsPageIdle |
+                kVmaStatsSwapUsage>;
+
+// State of the ProcMemInfo object that read_vma_stats() needs.
+struct VmaStatsContext {
+    pid_t pid;
+    uint64_t pgflags;
+    uint64_t pgflags_mask;
+    std::vector<uint64_t>* swap_offsets;
+    // The Pss of each memory cgroup is added up in the fixed point of pss_share() across
+    // all vmas, and converted to kB by the caller once the last vma is read.
+    std::map<uint64_t, MemUsage>* memcg_usage;
+};
+
+// Number of pagemap entries read at a time.
+static constexpr size_t kVmaStatsChunkPages = 2048;
+
+// Adds a page to all stats but the Pss, which callers keep track of themselves.
+template <uint64_t kPagesizeKb, bool kWss>
+static inline void add_page_usage(MemUsage* usage, uint64_t flags, uint64_t mapcount) {
+    const uint64_t is_dirty = (flags >> KPF_DIRTY) & 1;
+    const uint64_t is_clean = is_dirty ^ 1;
+    const uint64_t is_private = mapcount == 1;
+    const uint64_t is_shared = is_private ^ 1;
+    if constexpr (kWss) {
+        // This effectively makes vss = rss for the working set is requested.
+        // The libpagemap implementation returns vss > rss for
+        // working set, which doesn't make sense.
+        usage->vss += kPagesizeKb;
+    }
+    usage->rss += kPagesizeKb;
+    usage->uss += is_private * kPagesizeKb;
+    usage->private_dirty += (is_private & is_dirty) * kPagesizeKb;
+    usage->private_clean += (is_private & is_clean) * kPagesizeKb;
+    usage->shared_dirty += (is_shared & is_dirty) * kPagesizeKb;
+    usage->shared_clean += (is_shared & is_clean) * kPagesizeKb;
+}
+
+template <uint64_t kPageSize, uint32_t kMode>
+static bool read_vma_stats(int pagemap_fd, Vma& vma, const VmaStatsContext& ctx) {
+    constexpr bool kSwapUsage = kMode & kVmaStatsSwapUsage;
+    constexpr bool kMemUsage = kMode & kVmaStatsMemUsage;
+    constexpr bool kWss = kMode & kVmaStatsWss;
+    constexpr bool kPageIdle = kMode & kVmaStatsPageIdle;
+    constexpr bool kMemcg = kMode & kVmaStatsMemcg;
+    constexpr uint64_t kPagesizeKb = kPageSize / 1024;
+
+    PageAcct& pinfo = PageAcct::Instance();
+    const uint64_t first_page = vma.start / kPageSize;
+    const uint64_t num_pages = (vma.end - vma.start) / kPageSize;
+
+    std::vector<uint64_t> pagemap(std::min<uint64_t>(num_pages, kVmaStatsChunkPages));
+    // Frame number, flags, map count and memory cgroup of each present page in a chunk.
+    std::vector<uint64_t> pfns;
+    std::vector<uint64_t> flags;
+    std::vector<uint64_t> mapcounts;
+    std::vector<uint64_t> memcgs;
+    uint64_t num_swapped = 0;
+    uint64_t pss = 0;
+    for (uint64_t cur_page = first_page; cur_page < first_page + num_pages;) {
+        const size_t num_in_chunk =
+                std::min<uint64_t>(pagemap.size(), first_page + num_pages - cur_page);
+        const size_t total_bytes = num_in_chunk * sizeof(uint64_t);
+        ssize_t bytes =
+                pread64(pagemap_fd, pagemap.data(), total_bytes, cur_page * sizeof(uint64_t));
+        if (bytes != total_bytes) {
+            if (bytes == -1) {
+                PLOG(ERROR) << "Failed to read page data at offset 0x" << std::hex
+                            << cur_page * sizeof(uint64_t);
             } else {
-                num_in_page_cache = num_leftover_pages;
+                LOG(ERROR) << "Failed to read page data at offset 0x" << std::hex
+                           << cur_page * sizeof(uint64_t) << std::dec << " read bytes " << bytes
+                           << " expected bytes " << total_bytes;
             }
-            page_cache.resize(num_in_page_cache);
-            size_t total_bytes = page_cache.size() * sizeof(uint64_t);
-            ssize_t bytes = pread64(pagemap_fd, page_cache.data(), total_bytes,
-                                    cur_page * sizeof(uint64_t));
-            if (bytes != total_bytes) {
-                if (bytes == -1) {
-                    PLOG(ERROR) << "Failed to read page data at offset 0x" << std::hex
-                                << cur_page * sizeof(uint64_t);
-                } else {
-                    LOG(ERROR) << "Failed to read page data at offset 0x" << std::hex
-                               << cur_page * sizeof(uint64_t) << std::dec << " read bytes " << bytes
-                               << " expected bytes " << total_bytes;
-                }
+            return false;
+        }
+        cur_page += num_in_chunk;
+
+        pfns.clear();
+        for (size_t i = 0; i < num_in_chunk; i++) {
+            const uint64_t page_info = pagemap[i];
+            if (PAGE_SWAPPED(page_info)) {
+                num_swapped++;
+                ctx.swap_offsets->emplace_back(PAGE_SWAP_OFFSET(page_info));
+            } else if (kMemUsage && PAGE_PRESENT(page_info)) {
+                pfns.emplace_back(PAGE_PFN(page_info));
+            }
+        }
+        if (!kMemUsage || pfns.empty()) continue;
+
+        if (!pinfo.PageFlags(pfns, &flags) || !pinfo.PageMapCounts(pfns, &mapcounts)) {
+            LOG(ERROR) << "Failed to get page flags and counts in process " << ctx.pid;
+            ctx.swap_offsets->clear();
+            return false;
+        }
+        if constexpr (kMemcg) {
+            if (!pinfo.PageCgroups(pfns, &memcgs)) {
+                LOG(ERROR) << "Failed to get memory cgroups in process " << ctx.pid;
+                ctx.swap_offsets->clear();
                 return false;
             }
-            cur_page_cache_index = 0;
         }
 
-        uint64_t page_info = page_cache[cur_page_cache_index++];
-        if (!PAGE_PRESENT(page_info) && !PAGE_SWAPPED(page_info)) continue;
+        for (size_t i = 0; i < pfns.size(); i++) {
+            const uint64_t page_flags = flags[i];
+            vma.usage.thp += KPAGEFLAG_THP(page_flags) * kPagesizeKb;
 
-        if (PAGE_SWAPPED(page_info)) {
-            if (update_swap_usage) {
-                vma.usage.swap += pagesz_kb;
+            // skip unwanted pages from the count
+            if ((page_flags & ctx.pgflags_mask) != ctx.pgflags) continue;
+
+            // Page was unmapped between reading the pagemap and here.
+            const uint64_t mapcount = mapcounts[i];
+            if (mapcount == 0) continue;
+
+            // Working set
+            if constexpr (kPageIdle) {
+                if (pinfo.IsPageIdle(pfns[i]) != 1) continue;
+            } else if constexpr (kWss) {
+                if (!(page_flags & (1 << KPF_REFERENCED))) continue;
+            }
+
+            add_page_usage<kPagesizeKb, kWss>(&vma.usage, page_flags, mapcount);
+            pss += pss_share<kPageSize>(mapcount);
+            if constexpr (kMemcg) {
+                MemUsage& memcg_usage = (*ctx.memcg_usage)[memcgs[i]];
+                add_page_usage<kPagesizeKb, kWss>(&memcg_usage, page_flags, mapcount);
+                memcg_usage.pss += pss_share<kPageSize>(mapcount);
             }
-            swap_offsets_.emplace_back(PAGE_SWAP_OFFSET(page_info));
-            continue;
         }
+    }
 
-        if (!update_mem_usage) continue;
+    vma.usage.pss += pss_to_kb(pss);
+    if constexpr (kSwapUsage) {
+        vma.usage.swap += num_swapped * kPagesizeKb;
+    }
+    if constexpr (!kWss) {
+        vma.usage.vss += kPagesizeKb * num_pages;
+    }
+    return true;
+}
 
-        uint64_t page_frame = PAGE_PFN(page_info);
-        uint64_t cur_page_flags;
-        if (!pinfo.PageFlags(page_frame, &cur_page_flags)) {
-            LOG(ERROR) << "Failed to get page flags for " << page_frame << " in process " << pid_;
-            swap_offsets_.clear();
-            return false;
-        }
+using ReadVmaStatsFn = bool (*)(int pagemap_fd, Vma& vma, const VmaStatsContext& ctx);
 
-        if (KPAGEFLAG_THP(cur_page_flags)) {
-            vma.usage.thp += pagesz_kb;
-        }
+template <uint64_t kPageSize, uint32_t... kModes>
+static ReadVmaStatsFn select_read_vma_stats(uint32_t mode,
+                                            std::integer_sequence<uint32_t, kModes...>) {
+    ReadVmaStatsFn fn = nullptr;
+    ((fn = (mode == kModes) ? read_vma_stats<kPageSize, kModes> : fn), ...);
+    return fn;
+}
 
-        // skip unwanted pages from the count
-        if ((cur_page_flags & pgflags_mask_) != pgflags_) continue;
+bool ProcMemInfo::ReadVmaStats(int pagemap_fd, Vma& vma, bool get_wss, bool use_pageidle,
+                               bool update_mem_usage, bool update_swap_usage,
+                               std::map<uint64_t, MemUsage>* memcg_usage) {
+    PageAcct& pinfo = PageAcct::Instance();
+    if (get_wss && use_pageidle && !pinfo.InitPageAcct(true)) {
+        LOG(ERROR) << "Failed to init idle page accounting";
+        return false;
+    }
+
+    uint32_t mode = 0;
+    mode |= update_swap_usage ? kVmaStatsSwapUsage : 0;
+    mode |= get_wss ? kVmaStatsWss : 0;
+    if (update_mem_usage) {
+        mode |= kVmaStatsMemUsage;
+        mode |= (get_wss && use_pageidle) ? kVmaStatsPageIdle : 0;
+        mode |= memcg_usage ? kVmaStatsMemcg : 0;
+    }
 
-        uint64_t cur_page_counts;
-        if (!pinfo.PageMapCount(page_frame, &cur_page_counts)) {
-            LOG(ERROR) << "Failed to get page count for " << page_frame << " in process " << pid_;
-            swap_offsets_.clear();
+    static const uint64_t pagesz = getpagesize();
+    ReadVmaStatsFn read_fn = nullptr;
+    switch (pagesz) {
+        case 4096:
+            read_fn = select_read_vma_stats<4096>(mode, VmaStatsModes{});
+            break;
+        case 16384:
+            read_fn = select_read_vma_stats<16384>(mode, VmaStatsModes{});
+            break;
+        case 65536:
+            read_fn = select_read_vma_stats<65536>(mode, VmaStatsModes{});
+            break;
+        default:
+            LOG(ERROR) << "Unsupported page size " << pagesz;
             return false;
+    }
+
+    VmaStatsContext ctx = {
+            .pid = pid_,
+            .pgflags = pgflags_,
+            .pgflags_mask = pgflags_mask_,
+            .swap_offsets = &swap_offsets_,
+            .memcg_usage = memcg_usage,
+    };
+    return read_fn(pagemap_fd, vma, ctx);
+}
+
+VmaFileReader::VmaFileReader(const std::string& path, bool read_smaps_fields)
+    : path_(path), read_smaps_fields_(read_smaps_fields), fp_(fopen(path.c_str(), "re"), fclose) {
+    ok_ = fp_ != nullptr;
+}
+
+VmaFileReader::~VmaFileReader() {
+    // free getline() managed buffer
+    free(line_);
+}
+
+bool VmaFileReader::ReadLine() {
+    ssize_t line_len = getline(&line_, &line_alloc_, fp_.get());
+    if (line_len <= 0) {
+        return false;
+    }
+    // Make sure the line buffer terminates like a C string for ReadMapFile
+    line_[line_len] = '\0';
+    return true;
+}
+
+bool VmaFileReader::Next(Vma* vma) {
+    if (!ok_ || (!pending_ && !ReadLine())) {
+        return false;
+    }
+    pending_ = false;
+
+    vma->clear();
+    // 00400000-00409000 r-xp 00000000 fc:00 426998  /usr/lib/gvfs/gvfsd-http
+    if (!::android::procinfo::ReadMapFileContent(
+                line_, [&](const android::procinfo::MapInfo& mapinfo) {
+                    vma->start = mapinfo.start;
+                    vma->end = mapinfo.end;
+                    vma->flags = mapinfo.flags;
+                    vma->offset = mapinfo.pgoff;
+                    vma->name = mapinfo.name;
+                    vma->inode = mapinfo.inode;
+                    vma->is_shared = mapinfo.shared;
+                })) {
+        LOG(ERROR) << "Failed to parse " << path_;
+        ok_ = false;
+        return false;
+    }
+
+    if (read_smaps_fields_) {
+        // Collect the stats fields up to the first line of the next vma.
+        while (ReadLine()) {
+            if (!parse_smaps_field(line_, &vma->usage)) {
+                pending_ = true;
+                break;
+            }
         }
+    }
+    return true;
+}
+
+// Public APIs
+bool ForEachVmaFromFile(const std::string& path, const VmaCallback& callback,
+                        bool read_smaps_fields) {
+    return ForEachVmaFromFile<const VmaCallback&>(path, callback, read_smaps_fields);
+}
+
+// Parses a single line of /proc/<pid>/numa_maps, e.g.
+// 7f4c2e800000 default file=/system/lib64/libc.so mapped=10 mapmax=5 N0=6 N1=4 kernelpagesize_kB=4
+// Returns false if the line is malformed.
+static bool parse_numa_maps_line(char* line, NumaVma* vma) {
+    vma->clear();
+
+    char* saveptr = nullptr;
+    char* field = strtok_r(line, " \n", &saveptr);
+    if (field == nullptr) {
+        return false;
+    }
+    char* end;
+    vma->start = strtoull(field, &end, 16);
+    if (end == field || *end != '\0') {
+        return false;
+    }
 
-        // Page was unmapped between the presence check at the beginning of the loop and here.
-        if (cur_page_counts == 0) {
+    field = strtok_r(nullptr, " \n", &saveptr);
+    if (field == nullptr) {
+        return false;
+    }
+    vma->policy = field;
+
+    while ((field = strtok_r(nullptr, " \n", &saveptr)) != nullptr) {
+        char* value = strchr(field, '=');
+        if (value == nullptr) {
+            if (strcmp(field, "heap") == 0) {
+                vma->name = "[heap]";
+            } else if (strcmp(field, "stack") == 0) {
+                vma->name = "[stack]";
+            } else if (strcmp(field, "huge") == 0) {
+                vma->is_huge = true;
+            }
             continue;
         }
+        *value++ = '\0';
 
-        bool is_dirty = !!(cur_page_flags & (1 << KPF_DIRTY));
-        bool is_private = (cur_page_counts == 1);
-        // Working set
-        if (get_wss) {
-            bool is_referenced = use_pageidle ? (pinfo.IsPageIdle(page_frame) == 1)
-                                              : !!(cur_page_flags & (1 << KPF_REFERENCED));
-            if (!is_referenced) {
-                continue;
-            }
-            // This effectively makes vss = rss for the working set is requested.
-            // The libpagemap implementation returns vss > rss for
-            // working set, which doesn't make sense.
-            vma.usage.vss += pagesz_kb;
+        if (strcmp(field, "file") == 0) {
+            vma->name = value;
+            continue;
         }
 
-        vma.usage.rss += pagesz_kb;
-        vma.usage.uss += is_private ? pagesz_kb : 0;
-        vma.usage.pss += pagesz_kb / cur_page_counts;
-        if (is_private) {
-            vma.usage.private_dirty += is_dirty ? pagesz_kb : 0;
-            vma.usage.private_clean += is_dirty ? 0 : pagesz_kb;
-        } else {
-            vma.usage.shared_dirty += is_dirty ? pagesz_kb : 0;
-            vma.usage.shared_clean += is_dirty ? 0 : pagesz_kb;
+        uint64_t val = strtoull(value, &end, 10);
+        if (end == value) {
+            return false;
+        }
+        switch (field[0]) {
+            case 'N': {
+                uint64_t node = strtoull(field + 1, &end, 10);
+                if (end == field + 1 || *end != '\0') {
+                    return false;
+                }
+                if (vma->usage.nodes.size() <= node) {
+                    vma->usage.nodes.resize(node + 1);
+                }
+                vma->usage.nodes[node] = val;
+                break;
+            }
+            case 'a':
+                if (strcmp(field, "anon") == 0) {
+                    vma->usage.anon = val;
+                } else if (strcmp(field, "active") == 0) {
+                    vma->usage.active = val;
+                }
+                break;
+            case 'd':
+                if (strcmp(field, "dirty") == 0) {
+                    vma->usage.dirty = val;
+                }
+                break;
+            case 'k':
+                if (strcmp(field, "kernelpagesize_kB") == 0) {
+                    vma->pagesize_kb = val;
+                }
+                break;
+            case 'm':
+                if (strcmp(field, "mapped") == 0) {
+                    vma->usage.mapped = val;
+                } else if (strcmp(field, "mapmax") == 0) {
+                    vma->mapmax = val;
+                }
+                break;
+            case 's':
+                if (strcmp(field, "swapcache") == 0) {
+                    vma->usage.swapcache = val;
+                }
+                break;
+            case 'w':
+                if (strcmp(field, "writeback") == 0) {
+                    vma->usage.writeback = val;
+                }
+                break;
         }
     }
-    if (!get_wss) {
-        vma.usage.vss += pagesz_kb * num_pages;
+
+    if (vma->pagesize_kb == 0) {
+        vma->pagesize_kb = getpagesize() / 1024;
     }
     return true;
 }
 
-// Public APIs
-bool ForEachVmaFromFile(const std::string& path, const VmaCallback& callback,
-                        bool read_smaps_fields) {
+bool ForEachNumaVmaFromFile(const std::string& path, const NumaVmaCallback& callback) {
     auto fp = std::unique_ptr<FILE, decltype(&fclose)>{fopen(path.c_str(), "re"), fclose};
     if (fp == nullptr) {
         return false;
     }
 
     char* line = nullptr;
-    bool parsing_vma = false;
-    ssize_t line_len;
     size_t line_alloc = 0;
-    Vma vma;
-    while ((line_len = getline(&line, &line_alloc, fp.get())) > 0) {
-        // Make sure the line buffer terminates like a C string for ReadMapFile
-        line[line_len] = '\0';
-
-        if (parsing_vma) {
-            if (parse_smaps_field(line, &vma.usage)) {
-                // This was a stats field
-                continue;
-            }
-
-            // Done collecting stats, make the call back
-            if (!callback(vma)) {
-                free(line);
-                return false;
-            }
-            parsing_vma = false;
-        }
-
-        vma.clear();
-        // If it has, we are looking for the vma stats
-        // 00400000-00409000 r-xp 00000000 fc:00 426998  /usr/lib/gvfs/gvfsd-http
-        if (!::android::procinfo::ReadMapFileContent(
-                    line, [&](const android::procinfo::MapInfo& mapinfo) {
-                        vma.start = mapinfo.start;
-                        vma.end = mapinfo.end;
-                        vma.flags = mapinfo.flags;
-                        vma.offset = mapinfo.pgoff;
-                        vma.name = mapinfo.name;
-                        vma.inode = mapinfo.inode;
-                        vma.is_shared = mapinfo.shared;
-                    })) {
+    NumaVma vma;
+    while (getline(&line, &line_alloc, fp.get()) > 0) {
+        if (!parse_numa_maps_line(line, &vma)) {
             // free getline() managed buffer
             free(line);
             LOG(ERROR) << "Failed to parse " << path;
             return false;
         }
-        if (read_smaps_fields) {
-            parsing_vma = true;
-        } else {
-            // Done collecting stats, make the call back
-            if (!callback(vma)) {
-                free(line);
-                return false;
-            }
+        if (!callback(vma)) {
+            free(line);
+            return false;
         }
     }
 
     // free getline() managed buffer
     free(line);
+    return true;
+}
 
-    if (parsing_vma) {
-        if (!callback(vma)) {
-            return false;
+bool NumaUsageKbFromFile(const std::string& path, NumaUsage* usage) {
+    usage->clear();
+    return ForEachNumaVmaFromFile(path, [&](NumaVma& vma) {
+        const uint64_t pagesz_kb = vma.pagesize_kb;
+        usage->anon += vma.usage.anon * pagesz_kb;
+        usage->dirty += vma.usage.dirty * pagesz_kb;
+        usage->mapped += vma.usage.mapped * pagesz_kb;
+        usage->swapcache += vma.usage.swapcache * pagesz_kb;
+        usage->active += vma.usage.active * pagesz_kb;
+        usage->writeback += vma.usage.writeback * pagesz_kb;
+        if (usage->nodes.size() < vma.usage.nodes.size()) {
+            usage->nodes.resize(vma.usage.nodes.size());
         }
-    }
+        for (size_t node = 0; node < vma.usage.nodes.size(); node++) {
+            usage->nodes[node] += vma.usage.nodes[node] * pagesz_kb;
+        }
+        return true;
+    });
+}
 
-    return true;
+bool ThpUsageKbFromFile(const std::string& path, ThpUsage* usage,
+                        const ThpVmaCallback& callback) {
+    usage->clear();
+    return ForEachVmaFromFile(path, [&](Vma& vma) {
+        ThpUsage vma_usage;
+        thp_usage_from_vma(vma, &vma_usage);
+        usage->add(vma_usage);
+        if (callback) {
+            callback(vma, vma_usage);
+        }
+        return true;
+    });
 }
 
 enum smaps_rollup_support { UNTRIED, SUPPORTED, UNSUPPORTED };
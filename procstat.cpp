@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include "meminfo_private.h"
+
+namespace android {
+namespace meminfo {
+
+// Large enough for any /proc/<pid>/stat, including 64 byte kernel thread names.
+static constexpr size_t kStatBufferSize = 2048;
+
+// PF_KTHREAD from <linux/sched.h>, which is not part of the uapi.
+static constexpr uint32_t kPfKthread = 0x00200000;
+
+// 1-based indices of the fields of /proc/<pid>/stat, see proc(5).
+enum ProcStatField {
+    kStatState = 3,
+    kStatPpid = 4,
+    kStatFlags = 9,
+    kStatMinflt = 10,
+    kStatMajflt = 12,
+    kStatUtime = 14,
+    kStatStime = 15,
+    kStatNumThreads = 20,
+    kStatStarttime = 22,
+    kStatVsize = 23,
+    kStatRss = 24,
+};
+
+// Parses the unsigned decimal at 'p' and advances 'p' past it. Returns false if there is
+// no number at 'p'.
+static bool parse_stat_number(const char*& p, const char* end, uint64_t* val) {
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
+    const char* start = p;
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (p == start) {
+        return false;
+    }
+    *val = negative ? -v : v;
+    return true;
+}
+
+bool ParseProcStat(const char* buf, size_t len, ProcStat* stat) {
+    stat->clear();
+    const char* end = buf + len;
+
+    // The comm can contain anything, including spaces and parentheses, so it spans from
+    // the first '(' to the last ')'.
+    const char* comm_start = static_cast<const char*>(memchr(buf, '(', len));
+    const char* comm_end = static_cast<const char*>(memrchr(buf, ')', len));
+    if (comm_start == nullptr || comm_end == nullptr || comm_end < comm_start) {
+        return false;
+    }
+
+    const char* p = buf;
+    uint64_t pid;
+    if (!parse_stat_number(p, comm_start, &pid)) {
+        return false;
+    }
+    stat->pid = pid;
+
+    size_t comm_len = std::min<size_t>(comm_end - comm_start - 1, sizeof(stat->comm) - 1);
+    memcpy(stat->comm, comm_start + 1, comm_len);
+    stat->comm[comm_len] = '\0';
+
+    p = comm_end + 1;
+    for (int field = kStatState; field <= kStatRss; field++) {
+        // Skip the separator
+        if (p >= end || *p != ' ') {
+            return false;
+        }
+        p++;
+
+        if (field == kStatState) {
+            if (p >= end) {
+                return false;
+            }
+            stat->state = *p++;
+            continue;
+        }
+
+        uint64_t val;
+        if (!parse_stat_number(p, end, &val)) {
+            return false;
+        }
+        switch (field) {
+            case kStatPpid:
+                stat->ppid = val;
+                break;
+            case kStatFlags:
+                stat->flags = val;
+                break;
+            case kStatMinflt:
+                stat->minflt = val;
+                break;
+            case kStatMajflt:
+                stat->majflt = val;
+                break;
+            case kStatUtime:
+                stat->utime = val;
+                break;
+            case kStatStime:
+                stat->stime = val;
+                break;
+            case kStatNumThreads:
+                stat->num_threads = val;
+                break;
+            case kStatStarttime:
+                stat->starttime = val;
+                break;
+            case kStatVsize:
+                stat->vsize = val;
+                break;
+            case kStatRss:
+                stat->rss = val;
+                break;
+        }
+    }
+
+    return true;
+}
+
+static bool read_proc_stat(int fd, ProcStat* stat) {
+    char buf[kStatBufferSize];
+    ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf), 0));
+    if (len <= 0) {
+        return false;
+    }
+    return ParseProcStat(buf, len, stat);
+}
+
+bool ProcStatFromFile(const std::string& path, ProcStat* stat) {
+    ::android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        return false;
+    }
+    return read_proc_stat(fd, stat);
+}
+
+bool IsKernelThread(const ProcStat& stat) {
+    return stat.flags & kPfKthread;
+}
+
+bool IsMmlessTask(const ProcStat& stat) {
+    if (IsKernelThread(stat)) return true;
+    // Zombies release their memory on exit, but a task that is being torn down may still
+    // be in any state, so also check the size of the address space.
+    return stat.state == 'Z' || stat.state == 'X' || stat.vsize == 0;
+}
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+bool ProcStatReader::AddPid(pid_t pid) {
+    if (entries_.count(pid)) {
+        return true;
+    }
+
+    std::string path = ::android::base::StringPrintf("/proc/%d/stat", pid);
+    ::android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to open " << path;
+        return false;
+    }
+
+    Entry& entry = entries_[pid];
+    entry.fd = std::move(fd);
+    entry.cur_ms = entry.prev_ms = 0;
+    entry.nr_samples = 0;
+    return true;
+}
+
+void ProcStatReader::RemovePid(pid_t pid) {
+    entries_.erase(pid);
+}
+
+std::vector<pid_t> ProcStatReader::Pids() const {
+    std::vector<pid_t> pids;
+    pids.reserve(entries_.size());
+    for (const auto& [pid, entry] : entries_) {
+        pids.emplace_back(pid);
+    }
+    std::sort(pids.begin(), pids.end());
+    return pids;
+}
+
+bool ProcStatReader::Sample(std::vector<pid_t>* exited) {
+    const uint64_t sample_ms = now_ms();
+    bool success = true;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        Entry& entry = it->second;
+        ProcStat stat;
+        errno = 0;
+        if (!read_proc_stat(entry.fd, &stat)) {
+            // The process is gone, reads of its stat file fail with ESRCH from now on.
+            if (errno != ESRCH) {
+                PLOG(WARNING) << "Failed to read stat of process " << it->first;
+                success = false;
+            }
+            if (exited) {
+                exited->emplace_back(it->first);
+            }
+            it = entries_.erase(it);
+            continue;
+        }
+
+        entry.prev = entry.cur;
+        entry.prev_ms = entry.cur_ms;
+        entry.cur = stat;
+        entry.cur_ms = sample_ms;
+        entry.nr_samples++;
+        ++it;
+    }
+    return success;
+}
+
+const ProcStat* ProcStatReader::Stat(pid_t pid) const {
+    auto it = entries_.find(pid);
+    if (it == entries_.end() || it->second.nr_samples == 0) {
+        return nullptr;
+    }
+    return &it->second.cur;
+}
+
+bool ProcStatReader::ComputeDelta(const Entry& entry, ProcStatDelta* delta) {
+    if (entry.nr_samples < 2) {
+        return false;
+    }
+
+    const ProcStat& cur = entry.cur;
+    const ProcStat& prev = entry.prev;
+    delta->minflt = cur.minflt - prev.minflt;
+    delta->majflt = cur.majflt - prev.majflt;
+    delta->cpu_time = (cur.utime + cur.stime) - (prev.utime + prev.stime);
+    delta->rss = static_cast<int64_t>(cur.rss) - static_cast<int64_t>(prev.rss);
+    delta->vsize = static_cast<int64_t>(cur.vsize) - static_cast<int64_t>(prev.vsize);
+    delta->interval_ms = entry.cur_ms - entry.prev_ms;
+    return true;
+}
+
+bool ProcStatReader::Delta(pid_t pid, ProcStatDelta* delta) const {
+    auto it = entries_.find(pid);
+    if (it == entries_.end()) {
+        return false;
+    }
+    return ComputeDelta(it->second, delta);
+}
+
+void ProcStatReader::ForEachSample(const SampleCallback& callback) const {
+    for (const auto& [pid, entry] : entries_) {
+        if (entry.nr_samples == 0) {
+            continue;
+        }
+        ProcStatDelta delta;
+        callback(entry.cur, ComputeDelta(entry, &delta) ? &delta : nullptr);
+    }
+}
+
+}  // namespace meminfo
+}  // namespace android
@@ -15,6 +15,7 @@
  */
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -84,12 +85,64 @@ bool SysMemInfo::ReadMemInfo(size_t ntags, const std::string_view* tags, uint64_
     });
 }
 
+bool SysMemInfo::ReadNodeMemInfo(int node, const std::string& node_root) {
+    std::string path = ::android::base::StringPrintf("%s/node%d/meminfo", node_root.c_str(), node);
+    std::string content;
+    if (!::android::base::ReadFileToString(path, &content)) {
+        PLOG(ERROR) << "Failed to read file :" << path;
+        return false;
+    }
+
+    // Every line is prefixed with "Node <node> ", drop it so that the lines
+    // look the same as the ones in /proc/meminfo.
+    std::string prefix = ::android::base::StringPrintf("Node %d ", node);
+    std::string buffer;
+    buffer.reserve(content.size());
+    for (const auto& line : ::android::base::Split(content, "\n")) {
+        if (::android::base::StartsWith(line, prefix)) {
+            buffer.append(line, prefix.size());
+        } else {
+            buffer.append(line);
+        }
+        buffer.push_back('\n');
+    }
+
+    return ParseMemInfo(buffer.data(), path.c_str(), SysMemInfo::kDefaultSysMemInfoTags.size(),
+                        &*SysMemInfo::kDefaultSysMemInfoTags.begin(),
+                        [&](std::string_view tag, uint64_t val) { mem_in_kb_[tag] = val; });
+}
+
+bool ReadNodesMemInfo(std::map<int, SysMemInfo>* nodes, const std::string& node_root) {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(node_root.c_str()), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Failed to open " << node_root;
+        return false;
+    }
+
+    nodes->clear();
+    struct dirent* dent;
+    while ((dent = readdir(dir.get()))) {
+        int node;
+        if (!::android::base::StartsWith(dent->d_name, "node") ||
+            !::android::base::ParseInt(dent->d_name + 4, &node, 0)) {
+            continue;
+        }
+        if (!(*nodes)[node].ReadNodeMemInfo(node, node_root)) {
+            nodes->clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
 uint64_t SysMemInfo::ReadVmallocInfo() {
     return ::android::meminfo::ReadVmallocInfo();
 }
 
+template <typename F>
 bool SysMemInfo::ReadMemInfo(const char* path, size_t ntags, const std::string_view* tags,
-                             std::function<void(std::string_view, uint64_t)> store_val) {
+                             F&& store_val) {
     char buffer[4096];
     int fd = open(path, O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
@@ -104,6 +157,12 @@ bool SysMemInfo::ReadMemInfo(const char* path, size_t ntags, const std::string_v
     }
 
     buffer[len] = '\0';
+    return ParseMemInfo(buffer, path, ntags, tags, store_val);
+}
+
+template <typename F>
+bool SysMemInfo::ParseMemInfo(char* buffer, const char* path, size_t ntags,
+                              const std::string_view* tags, F&& store_val) {
     char* p = buffer;
     uint32_t found = 0;
     uint32_t lineno = 0;
@@ -146,6 +205,19 @@ bool SysMemInfo::ReadMemInfo(const char* path, size_t ntags, const std::string_v
     return true;
 }
 
+bool SysMemInfo::ReadMemInfo(const char* path, size_t ntags, const std::string_view* tags,
+                             std::function<void(std::string_view, uint64_t)> store_val) {
+    return ReadMemInfo<std::function<void(std::string_view, uint64_t)>&>(path, ntags, tags,
+                                                                          store_val);
+}
+
+bool SysMemInfo::ParseMemInfo(char* buffer, const char* path, size_t ntags,
+                              const std::string_view* tags,
+                              std::function<void(std::string_view, uint64_t)> store_val) {
+    return ParseMemInfo<std::function<void(std::string_view, uint64_t)>&>(buffer, path, ntags,
+                                                                           tags, store_val);
+}
+
 uint64_t SysMemInfo::mem_zram_kb(const char* zram_dev_cstr) const {
     uint64_t mem_zram_total = 0;
     if (zram_dev_cstr) {
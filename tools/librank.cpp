@@ -26,10 +26,12 @@
 #include <memory>
 #include <set>
 
+#include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <meminfo/procmeminfo.h>
 
+#include <capture.h>
 #include <processrecord.h>
 #include <smapinfo.h>
 
@@ -57,6 +59,8 @@ using ::android::smapinfo::SortOrder;
               << "    -k  Only show pages collapsed by KSM\n"
               << "    -f  [raw][json][csv] Print output in the specified format.\n"
               << "        (Default format is raw text.)\n"
+              << "    -F  Report the memory usage in a file written with procrank -S instead of\n"
+              << "        this system. Page flag options can't be used with it.\n"
               << "    -h  Display this help screen.\n";
     exit(exit_status);
 }
@@ -98,8 +102,10 @@ int main(int argc, char* argv[]) {
     SortOrder sort_order = SortOrder::BY_PSS;
     bool reverse_sort = false;
 
+    std::string replay_path;
+
     int opt;
-    while ((opt = getopt(argc, argv, "acCf:hkm:opP:uvrsR")) != -1) {
+    while ((opt = getopt(argc, argv, "acCf:F:hkm:opP:uvrsR")) != -1) {
         switch (opt) {
             case 'a':
                 all_libs = true;
@@ -119,6 +125,9 @@ int main(int argc, char* argv[]) {
                     usage(EXIT_FAILURE);
                 }
                 break;
+            case 'F':
+                replay_path = optarg;
+                break;
             case 'h':
                 usage(EXIT_SUCCESS);
             case 'k':
@@ -157,8 +166,33 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (!replay_path.empty()) {
+        // A capture has no pagemap to filter pages by their flags.
+        if (pgflags_mask) {
+            std::cerr << "Page flag options can't be used with -F" << std::endl;
+            usage(EXIT_FAILURE);
+        }
+        TemporaryDir root;
+        std::set<pid_t> pids;
+        std::map<pid_t, ::android::smapinfo::ProcessRecord> records;
+        if (!::android::smapinfo::extract_capture(replay_path, root.path, std::cerr) ||
+            !::android::smapinfo::create_capture_processrecords(root.path, &pids, &records,
+                                                                std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        bool success = ::android::smapinfo::run_librank(
+                0, 0, pids, lib_prefix, all_libs, excluded_libs, mapflags_mask, format, sort_order,
+                reverse_sort, &records, std::cout, std::cerr);
+        if (!success) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
+    // Kernel threads and zombies map no libraries, skip them without reading their smaps.
     std::set<pid_t> pids;
-    if (!::android::smapinfo::get_all_pids(&pids)) {
+    std::set<pid_t> mmless_pids;
+    if (!::android::smapinfo::get_all_pids(&pids, &mmless_pids)) {
         std::cerr << "Failed to get all pids." << std::endl;
         exit(EXIT_FAILURE);
     }
@@ -25,16 +25,21 @@
 #include <unordered_map>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <meminfo/procmeminfo.h>
 #include <procinfo/process.h>
 
+#include <capture.h>
 #include <processrecord.h>
 #include <smapinfo.h>
 
 using ::android::smapinfo::SortOrder;
 
+// Number of resident anonymous pages of each process compressed with -Z.
+static constexpr uint64_t kZramSamplePages = 1024;
+
 [[noreturn]] static void usage(int exit_status) {
     std::cerr << "Usage: " << getprogname() << " [ -W ] [ -v | -r | -p | -u | -s | -h ] [-d PID]"
               << std::endl
@@ -53,6 +58,22 @@ using ::android::smapinfo::SortOrder;
               << "    -o  Show and sort by oom score against lowmemorykiller thresholds."
               << std::endl
               << "    -d  Filter to descendants of specified process (can be repeated)" << std::endl
+              << "    -H  Show transparent huge page usage, sorted by huge page backed memory."
+              << std::endl
+              << "    -b  With -H, also show memory wasted by partially mapped huge pages."
+              << std::endl
+              << "    -K  List kernel threads and zombies, which are skipped otherwise, without"
+              << std::endl
+              << "        reading any memory usage." << std::endl
+              << "    -Z  Estimate how well the anonymous memory of each process compresses in zram,"
+              << std::endl
+              << "        and the zram used by its swap, from a sample of its pages." << std::endl
+              << "    -S  Capture the memory usage of all processes to the given file and exit."
+              << std::endl
+              << "    -F  Report the memory usage in a file written with -S instead of this"
+              << std::endl
+              << "        system. Only the sort options apply, swap is not reported per process."
+              << std::endl
               << "    -h  Display this help screen." << std::endl;
     exit(exit_status);
 }
@@ -69,12 +90,21 @@ int main(int argc, char* argv[]) {
     bool get_oomadj = false;
     bool get_wss = false;
     bool reset_wss = false;
+    bool show_thp = false;
+    bool show_thp_bloat = false;
+    bool show_mmless = false;
+    bool show_zram = false;
+    std::string capture_path;
+    std::string replay_path;
 
     std::vector<pid_t> descendant_filter;
 
     int opt;
-    while ((opt = getopt(argc, argv, "cCd:hkoprRsuvwW")) != -1) {
+    while ((opt = getopt(argc, argv, "bcCd:F:hHkKoprRsS:uvwWZ")) != -1) {
         switch (opt) {
+            case 'b':
+                show_thp_bloat = true;
+                break;
             case 'c':
                 pgflags = 0;
                 pgflags_mask = (1 << KPF_SWAPBACKED);
@@ -92,12 +122,21 @@ int main(int argc, char* argv[]) {
                 descendant_filter.push_back(p);
                 break;
             }
+            case 'F':
+                replay_path = optarg;
+                break;
             case 'h':
                 usage(EXIT_SUCCESS);
+            case 'H':
+                show_thp = true;
+                break;
             case 'k':
                 pgflags = (1 << KPF_KSM);
                 pgflags_mask = (1 << KPF_KSM);
                 break;
+            case 'K':
+                show_mmless = true;
+                break;
             case 'o':
                 sort_order = SortOrder::BY_OOMADJ;
                 get_oomadj = true;
@@ -114,6 +153,9 @@ int main(int argc, char* argv[]) {
             case 's':
                 sort_order = SortOrder::BY_SWAP;
                 break;
+            case 'S':
+                capture_path = optarg;
+                break;
             case 'u':
                 sort_order = SortOrder::BY_USS;
                 break;
@@ -126,16 +168,57 @@ int main(int argc, char* argv[]) {
             case 'W':
                 reset_wss = true;
                 break;
+            case 'Z':
+                show_zram = true;
+                break;
             default:
                 usage(EXIT_FAILURE);
         }
     }
 
+    if (!capture_path.empty()) {
+        // Other options passed to procrank are ignored when capturing.
+        if (!::android::smapinfo::capture_procfs(capture_path, 0, std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
+    if (!replay_path.empty()) {
+        // A capture has no pagemap, nor processes that can be inspected any further.
+        if (pgflags_mask || get_wss || reset_wss || show_thp || show_mmless || show_zram ||
+            descendant_filter.size()) {
+            std::cerr << "Only sort options can be used with -F" << std::endl;
+            usage(EXIT_FAILURE);
+        }
+        TemporaryDir root;
+        std::set<pid_t> pids;
+        std::map<pid_t, ::android::smapinfo::ProcessRecord> records;
+        if (!::android::smapinfo::extract_capture(replay_path, root.path, std::cerr) ||
+            !::android::smapinfo::create_capture_processrecords(root.path, &pids, &records,
+                                                                std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        bool success = ::android::smapinfo::run_procrank(0, 0, pids, get_oomadj, false,
+                                                         sort_order, reverse_sort, &records,
+                                                         std::cout, std::cerr, root.path);
+        if (!success) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
+    // Kernel threads and zombies have no memory to report, telling them apart from
+    // /proc/<pid>/stat is much cheaper than building a ProcessRecord for them.
     std::set<pid_t> pids;
-    if (!::android::smapinfo::get_all_pids(&pids)) {
+    std::set<pid_t> mmless_pids;
+    if (!::android::smapinfo::get_all_pids(&pids, &mmless_pids)) {
         std::cerr << "Failed to get all pids." << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (show_mmless) {
+        pids = std::move(mmless_pids);
+    }
 
     if (descendant_filter.size()) {
         // Map from parent pid to all of its children.
@@ -176,6 +259,14 @@ int main(int argc, char* argv[]) {
         pids = std::move(final_pids);
     }
 
+    if (show_mmless) {
+        // Other options passed to procrank are ignored if show_mmless is true.
+        if (!::android::smapinfo::run_procrank_mmless(pids, std::cout, std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
     if (reset_wss) {
         for (pid_t pid : pids) {
             if (!::android::meminfo::ProcMemInfo::ResetWorkingSet(pid)) {
@@ -187,6 +278,23 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    if (show_thp) {
+        // Page flag filters and working set options don't apply to the THP report.
+        if (!::android::smapinfo::run_procrank_thp(pids, show_thp_bloat, std::cout, std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
+    if (show_zram) {
+        // Page flag filters and working set options don't apply to the zram report.
+        if (!::android::smapinfo::run_procrank_zram(pids, kZramSamplePages, std::cout,
+                                                    std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
     bool success = ::android::smapinfo::run_procrank(pgflags, pgflags_mask, pids, get_oomadj,
                                                      get_wss, sort_order, reverse_sort, nullptr,
                                                      std::cout, std::cerr);
@@ -29,10 +29,12 @@
 #include <memory>
 #include <string>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <meminfo/procmeminfo.h>
 
+#include <capture.h>
 #include <processrecord.h>
 #include <smapinfo.h>
 
@@ -40,12 +42,15 @@ using ::android::meminfo::Format;
 using ::android::meminfo::GetFormat;
 
 [[noreturn]] static void usage(int exit_status) {
-    std::cerr << "showmap [-aqtv] [-f FILE] PID\n"
+    std::cerr << "showmap [-aqtvHb] [-f FILE | -F CAPTURE] PID\n"
               << "-a\taddresses (show virtual memory map)\n"
               << "-q\tquiet (don't show error if map could not be read)\n"
               << "-t\tterse (show only items with private pages)\n"
               << "-v\tverbose (don't coalesce maps with the same name)\n"
               << "-f\tFILE (read from input from FILE instead of PID)\n"
+              << "-F\tCAPTURE (read PID from a file written with procrank -S)\n"
+              << "-H\tshow transparent huge page usage of each map\n"
+              << "-b\twith -H, also show memory wasted by partially mapped huge pages\n"
               << "-o\t[raw][json][csv] Print output in the specified format.\n"
               << "  \tDefault output format is raw text. All memory in KB.)\n";
 
@@ -66,14 +71,20 @@ int main(int argc, char* argv[]) {
     // Output options.
     bool show_addr = false;
     bool verbose = false;
+    bool show_thp = false;
+    bool show_thp_bloat = false;
     Format format = Format::RAW;
 
     // 'pid' will be ignored if a file is specified.
     std::string filename;
     pid_t pid = 0;
 
+    // The capture is unpacked to 'capture_root' for the duration of the run.
+    std::string capture_path;
+    std::unique_ptr<TemporaryDir> capture_root;
+
     int opt;
-    while ((opt = getopt_long(argc, argv, "tvaqf:o:h", longopts, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "tvaqf:F:o:hHb", longopts, nullptr)) != -1) {
         switch (opt) {
             case 't':
                 terse = true;
@@ -90,6 +101,9 @@ int main(int argc, char* argv[]) {
             case 'f':
                 filename = optarg;
                 break;
+            case 'F':
+                capture_path = optarg;
+                break;
             case 'o':
                 format = GetFormat(optarg);
                 if (format == Format::INVALID) {
@@ -97,6 +111,12 @@ int main(int argc, char* argv[]) {
                     usage(EXIT_FAILURE);
                 }
                 break;
+            case 'H':
+                show_thp = true;
+                break;
+            case 'b':
+                show_thp_bloat = true;
+                break;
             case 'h':
                 usage(EXIT_SUCCESS);
             default:
@@ -117,6 +137,27 @@ int main(int argc, char* argv[]) {
         }
         // run_showmap will read directly from this file and ignore the pid argument.
         filename = ::android::base::StringPrintf("/proc/%d/smaps", pid);
+        if (!capture_path.empty()) {
+            // A capture has no pagemap to find the bloat in.
+            if (show_thp_bloat) {
+                std::cerr << "-b can't be used with -F\n";
+                usage(EXIT_FAILURE);
+            }
+            capture_root = std::make_unique<TemporaryDir>();
+            if (!::android::smapinfo::extract_capture(capture_path, capture_root->path,
+                                                      std::cerr)) {
+                exit(EXIT_FAILURE);
+            }
+            filename = capture_root->path + filename;
+        }
+    }
+
+    if (show_thp) {
+        if (!::android::smapinfo::run_showmap_thp(pid, filename, show_thp_bloat, quiet, std::cout,
+                                                  std::cerr)) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
     }
 
     bool success = ::android::smapinfo::run_showmap(pid, filename, terse, verbose, show_addr, quiet,
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include <android-base/logging.h>
+
+#include "meminfo_private.h"
+
+namespace android {
+namespace meminfo {
+
+// The pool and worker the calling thread runs tasks for, if any.
+static thread_local WorkStealingPool* t_pool = nullptr;
+static thread_local size_t t_worker = 0;
+
+WorkStealingPool::WorkStealingPool(size_t nr_workers) {
+    if (nr_workers == 0) {
+        nr_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < nr_workers; i++) {
+        workers_.emplace_back(std::make_unique<Worker>());
+    }
+}
+
+void WorkStealingPool::Push(size_t worker, Task task) {
+    nr_pending_++;
+    {
+        std::lock_guard<std::mutex> lock(workers_[worker]->lock);
+        workers_[worker]->tasks.emplace_back(std::move(task));
+    }
+    nr_queued_++;
+    // Taking the lock orders the wakeup after a worker that is about to wait checked
+    // nr_queued_.
+    std::lock_guard<std::mutex> lock(idle_lock_);
+    idle_cv_.notify_one();
+}
+
+void WorkStealingPool::Spawn(Task task) {
+    if (t_pool != this) {
+        LOG(ERROR) << "Tasks can only be spawned from a task of the same pool";
+        return;
+    }
+    Push(t_worker, std::move(task));
+}
+
+bool WorkStealingPool::Pop(size_t worker, Task* task) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+        Worker& victim = *workers_[(worker + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (victim.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            *task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+        } else {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+        nr_queued_--;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t worker) {
+    t_pool = this;
+    t_worker = worker;
+
+    Task task;
+    while (true) {
+        if (Pop(worker, &task)) {
+            task();
+            task = nullptr;
+            if (--nr_pending_ == 0) {
+                std::lock_guard<std::mutex> lock(idle_lock_);
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock_);
+        idle_cv_.wait(lock, [this] { return nr_pending_ == 0 || nr_queued_ > 0; });
+        if (nr_pending_ == 0) {
+            break;
+        }
+    }
+
+    t_pool = nullptr;
+}
+
+void WorkStealingPool::Run(std::vector<Task> tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+
+    // Each worker runs the newest task of its deque first, so the tasks are queued in
+    // reverse to start in the order given.
+    for (size_t i = tasks.size(); i > 0; i--) {
+        Push((i - 1) % workers_.size(), std::move(tasks[i - 1]));
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers_.size(); i++) {
+        threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    }
+    WorkerLoop(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Splits 'vmas' into parts of at most 'split_pages' pages each, cutting vmas at page
+// boundaries where needed.
+static std::vector<std::vector<Vma>> split_vmas(const std::vector<Vma>& vmas,
+                                                uint64_t split_pages) {
+    const uint64_t pagesz = getpagesize();
+    std::vector<std::vector<Vma>> parts(1);
+    uint64_t nr_pages = 0;
+    for (const Vma& vma : vmas) {
+        for (uint64_t start = vma.start; start < vma.end;) {
+            if (nr_pages == split_pages) {
+                parts.emplace_back();
+                nr_pages = 0;
+            }
+            uint64_t len = std::min(vma.end - start, (split_pages - nr_pages) * pagesz);
+            Vma& part = parts.back().emplace_back(vma);
+            part.start = start;
+            part.end = start + len;
+            nr_pages += len / pagesz;
+            start += len;
+        }
+    }
+    return parts;
+}
+
+// Usage of the parts of one process, written by the tasks of the process.
+struct ProcessScan {
+    std::vector<MemUsage> parts;
+    std::atomic<bool> failed = false;
+};
+
+static void read_usage_part(pid_t pid, std::vector<Vma> vmas, MemUsage* usage,
+                            std::atomic<bool>* failed) {
+    // Each part reads the pagemap through its own object, they share no state.
+    ProcMemInfo proc(pid);
+    if (!proc.FillInVmasStats(&vmas)) {
+        *failed = true;
+        return;
+    }
+    for (const Vma& vma : vmas) {
+        add_mem_usage(usage, vma.usage);
+    }
+}
+
+bool ReadProcessesUsageParallel(const std::vector<pid_t>& pids, WorkStealingPool* pool,
+                                std::vector<ProcessUsage>* usages, uint64_t split_pages) {
+    usages->clear();
+    split_pages = std::max<uint64_t>(split_pages, 1);
+    // The page accounting is opened lazily, which is not thread safe.
+    if (!PageAcct::Instance().InitPageAcct()) {
+        LOG(ERROR) << "Failed to init page accounting";
+        return false;
+    }
+
+    std::vector<ProcessScan> scans(pids.size());
+    std::vector<WorkStealingPool::Task> tasks;
+    for (size_t i = 0; i < pids.size(); i++) {
+        tasks.emplace_back([pool, pid = pids[i], scan = &scans[i], split_pages]() {
+            ProcMemInfo proc(pid);
+            const std::vector<Vma>& vmas = proc.MapsWithoutUsageStats();
+            if (vmas.empty()) {
+                scan->failed = true;
+                return;
+            }
+
+            std::vector<std::vector<Vma>> parts = split_vmas(vmas, split_pages);
+            // Sized before any part is spawned, the parts write to their own slot.
+            scan->parts.resize(parts.size());
+            for (size_t j = 1; j < parts.size(); j++) {
+                pool->Spawn([pid, vmas = std::move(parts[j]), usage = &scan->parts[j],
+                             failed = &scan->failed]() mutable {
+                    read_usage_part(pid, std::move(vmas), usage, failed);
+                });
+            }
+            read_usage_part(pid, std::move(parts[0]), &scan->parts[0], &scan->failed);
+        });
+    }
+    pool->Run(std::move(tasks));
+
+    for (size_t i = 0; i < pids.size(); i++) {
+        if (scans[i].failed) {
+            continue;
+        }
+        ProcessUsage proc = {.pid = pids[i]};
+        for (const MemUsage& part : scans[i].parts) {
+            add_mem_usage(&proc.usage, part);
+        }
+        usages->emplace_back(proc);
+    }
+    return true;
+}
+
+}  // namespace meminfo
+}  // namespace android